@@ -0,0 +1,50 @@
+// 由zc从-生成
+typedef long z_v2i64 __attribute__((vector_size(16)));
+typedef int z_v4i32 __attribute__((vector_size(16)));
+typedef signed char z_v16i8 __attribute__((vector_size(16)));
+
+int main(void) {
+  long a[10] = {0};
+  char *s = 0;
+  z_v2i64 v0 = {0};
+  z_v4i32 v1 = {0};
+  z_v16i8 v2 = {0};
+  a[0] = 5L;
+  a[1] = (-3L);
+  a[2] = 9L;
+  a[3] = 2147483648L;
+  a[4] = (-1L);
+  a[5] = 7L;
+  a[6] = 11L;
+  a[7] = 13L;
+  a[8] = 17L;
+  a[9] = (-19L);
+  s = "abcdefghijklmnopqrstu";
+  v0 = (z_v2i64){3L, (-4L)};
+  v1 = (z_v4i32){1L, (-2L), 300L, 4L};
+  v2 = (z_v16i8){7L, 7L, 7L, 7L, 7L, 7L, 7L, 7L, 7L, 7L, 7L, 7L, 7L, 7L, 7L, 7L};
+  z_v16i8 _t1 = (z_v16i8){1000L, 1000L, 1000L, 1000L, 1000L, 1000L, 1000L, 1000L, 1000L, 1000L, 1000L, 1000L, 1000L, 1000L, 1000L, 1000L};
+  z_v2i64 _t2 = (z_v2i64){127L, 2L};
+  _t1[8] = ((long)_t2[0] + (long)_t2[1]);
+  z_v16i8 _t3 = _t1;
+  z_v16i8 _t4 = (z_v16i8){9223372036854775807L, 9223372036854775807L, 9223372036854775807L, 9223372036854775807L, 9223372036854775807L, 9223372036854775807L, 9223372036854775807L, 9223372036854775807L, 9223372036854775807L, 9223372036854775807L, 9223372036854775807L, 9223372036854775807L, 9223372036854775807L, 9223372036854775807L, 9223372036854775807L, 9223372036854775807L};
+  z_v16i8 _t5 = (z_v16i8){9223372036854775807L, 100L, 100L, 9223372036854775807L, (-7L), 9223372036854775807L, 9223372036854775807L, 3L, 1L, (-100000L), (-2147483648L), 0L, 100L, 2L, 1000L, 2L};
+  _t5[8] = 4294967297L;
+  v2 = (_t3 + (z_v16i8)(_t4 == _t5));
+  z_v2i64 _t6 = (z_v2i64){4294967297L, 4294967297L};
+  z_v2i64 _t7 = (_t6 + (z_v2i64){(-7L), (-7L)});
+  z_v2i64 _t8 = (z_v2i64){0L, 2L};
+  z_v2i64 _t9 = (_t7 + (z_v2i64){_t8[0], _t8[0]});
+  v0 = (z_v2i64)(_t9 == (z_v2i64){127L, 127L});
+  long _t10 = ((long)v0[0] + (long)v0[1]);
+  long _t11 = (_t10 + (((long)v1[0] + (long)v1[1] + (long)v1[2] + (long)v1[3]) * 3L));
+  long _t12 = (_t11 + (((long)v2[0] + (long)v2[1] + (long)v2[2] + (long)v2[3] + (long)v2[4] + (long)v2[5] + (long)v2[6] + (long)v2[7] + (long)v2[8] + (long)v2[9] + (long)v2[10] + (long)v2[11] + (long)v2[12] + (long)v2[13] + (long)v2[14] + (long)v2[15]) * 5L));
+  long _t13 = (_t12 + a[3L]);
+  long _t14 = (_t13 + (a[5L] * 7L));
+  z_v4i32 _t15 = (z_v4i32){(-7L), (-1L), (-128L), 3L};
+  _t15[1] = 3L;
+  z_v4i32 _t16 = _t15;
+  z_v4i32 _t17 = (z_v4i32){_t16[0], _t16[1], _t16[0], _t16[3]};
+  return (_t14 + ((long)_t17[0] + (long)_t17[1] + (long)_t17[2] + (long)_t17[3]));
+  return 0;
+}
@@ -0,0 +1,224 @@
+; 由zc从-生成
+
+define i32 @main() {
+entry:
+  %a = alloca [10 x i64]
+  store [10 x i64] zeroinitializer, ptr %a
+  %s = alloca ptr
+  store ptr zeroinitializer, ptr %s
+  %v0 = alloca <2 x i64>
+  store <2 x i64> zeroinitializer, ptr %v0
+  %v1 = alloca <4 x i32>
+  store <4 x i32> zeroinitializer, ptr %v1
+  %v2 = alloca <16 x i8>
+  store <16 x i8> zeroinitializer, ptr %v2
+  %.t1 = getelementptr inbounds [10 x i64], ptr %a, i64 0, i64 0
+  store i64 5, ptr %.t1
+  %.t2 = getelementptr inbounds [10 x i64], ptr %a, i64 0, i64 1
+  store i64 -3, ptr %.t2
+  %.t3 = getelementptr inbounds [10 x i64], ptr %a, i64 0, i64 2
+  store i64 9, ptr %.t3
+  %.t4 = getelementptr inbounds [10 x i64], ptr %a, i64 0, i64 3
+  store i64 2147483648, ptr %.t4
+  %.t5 = getelementptr inbounds [10 x i64], ptr %a, i64 0, i64 4
+  store i64 -1, ptr %.t5
+  %.t6 = getelementptr inbounds [10 x i64], ptr %a, i64 0, i64 5
+  store i64 7, ptr %.t6
+  %.t7 = getelementptr inbounds [10 x i64], ptr %a, i64 0, i64 6
+  store i64 11, ptr %.t7
+  %.t8 = getelementptr inbounds [10 x i64], ptr %a, i64 0, i64 7
+  store i64 13, ptr %.t8
+  %.t9 = getelementptr inbounds [10 x i64], ptr %a, i64 0, i64 8
+  store i64 17, ptr %.t9
+  %.t10 = getelementptr inbounds [10 x i64], ptr %a, i64 0, i64 9
+  store i64 -19, ptr %.t10
+  store ptr @.str.1, ptr %s
+  %.t12 = insertelement <2 x i64> undef, i64 3, i32 0
+  %.t13 = insertelement <2 x i64> %.t12, i64 -4, i32 1
+  store <2 x i64> %.t13, ptr %v0
+  %.t15 = trunc i64 1 to i32
+  %.t16 = insertelement <4 x i32> undef, i32 %.t15, i32 0
+  %.t17 = trunc i64 -2 to i32
+  %.t18 = insertelement <4 x i32> %.t16, i32 %.t17, i32 1
+  %.t19 = trunc i64 300 to i32
+  %.t20 = insertelement <4 x i32> %.t18, i32 %.t19, i32 2
+  %.t21 = trunc i64 4 to i32
+  %.t22 = insertelement <4 x i32> %.t20, i32 %.t21, i32 3
+  store <4 x i32> %.t22, ptr %v1
+  %.t25 = trunc i64 7 to i8
+  %.t24 = insertelement <16 x i8> undef, i8 %.t25, i32 0
+  %.t23 = shufflevector <16 x i8> %.t24, <16 x i8> undef, <16 x i32> zeroinitializer
+  store <16 x i8> %.t23, ptr %v2
+  %.t29 = trunc i64 1000 to i8
+  %.t28 = insertelement <16 x i8> undef, i8 %.t29, i32 0
+  %.t27 = shufflevector <16 x i8> %.t28, <16 x i8> undef, <16 x i32> zeroinitializer
+  %.t32 = insertelement <2 x i64> undef, i64 127, i32 0
+  %.t33 = insertelement <2 x i64> %.t32, i64 2, i32 1
+  %.t34 = extractelement <2 x i64> %.t33, i32 0
+  %.t35 = add i64 0, %.t34
+  %.t36 = extractelement <2 x i64> %.t33, i32 1
+  %.t37 = add i64 %.t35, %.t36
+  %.t38 = trunc i64 %.t37 to i8
+  %.t26 = insertelement <16 x i8> %.t27, i8 %.t38, i32 8
+  %.t42 = trunc i64 9223372036854775807 to i8
+  %.t41 = insertelement <16 x i8> undef, i8 %.t42, i32 0
+  %.t40 = shufflevector <16 x i8> %.t41, <16 x i8> undef, <16 x i32> zeroinitializer
+  %.t46 = trunc i64 9223372036854775807 to i8
+  %.t47 = insertelement <16 x i8> undef, i8 %.t46, i32 0
+  %.t48 = trunc i64 100 to i8
+  %.t49 = insertelement <16 x i8> %.t47, i8 %.t48, i32 1
+  %.t50 = trunc i64 100 to i8
+  %.t51 = insertelement <16 x i8> %.t49, i8 %.t50, i32 2
+  %.t52 = trunc i64 9223372036854775807 to i8
+  %.t53 = insertelement <16 x i8> %.t51, i8 %.t52, i32 3
+  %.t54 = trunc i64 -7 to i8
+  %.t55 = insertelement <16 x i8> %.t53, i8 %.t54, i32 4
+  %.t56 = trunc i64 9223372036854775807 to i8
+  %.t57 = insertelement <16 x i8> %.t55, i8 %.t56, i32 5
+  %.t58 = trunc i64 9223372036854775807 to i8
+  %.t59 = insertelement <16 x i8> %.t57, i8 %.t58, i32 6
+  %.t60 = trunc i64 3 to i8
+  %.t61 = insertelement <16 x i8> %.t59, i8 %.t60, i32 7
+  %.t62 = trunc i64 1 to i8
+  %.t63 = insertelement <16 x i8> %.t61, i8 %.t62, i32 8
+  %.t64 = trunc i64 -100000 to i8
+  %.t65 = insertelement <16 x i8> %.t63, i8 %.t64, i32 9
+  %.t66 = trunc i64 -2147483648 to i8
+  %.t67 = insertelement <16 x i8> %.t65, i8 %.t66, i32 10
+  %.t68 = trunc i64 0 to i8
+  %.t69 = insertelement <16 x i8> %.t67, i8 %.t68, i32 11
+  %.t70 = trunc i64 100 to i8
+  %.t71 = insertelement <16 x i8> %.t69, i8 %.t70, i32 12
+  %.t72 = trunc i64 2 to i8
+  %.t73 = insertelement <16 x i8> %.t71, i8 %.t72, i32 13
+  %.t74 = trunc i64 1000 to i8
+  %.t75 = insertelement <16 x i8> %.t73, i8 %.t74, i32 14
+  %.t76 = trunc i64 2 to i8
+  %.t77 = insertelement <16 x i8> %.t75, i8 %.t76, i32 15
+  %.t78 = trunc i64 4294967297 to i8
+  %.t44 = insertelement <16 x i8> %.t77, i8 %.t78, i32 8
+  %.t43 = icmp eq <16 x i8> %.t40, %.t44
+  %.t39 = sext <16 x i1> %.t43 to <16 x i8>
+  %.t79 = add <16 x i8> %.t26, %.t39
+  store <16 x i8> %.t79, ptr %v2
+  %.t82 = insertelement <2 x i64> undef, i64 4294967297, i32 0
+  %.t81 = shufflevector <2 x i64> %.t82, <2 x i64> undef, <2 x i32> zeroinitializer
+  %.t84 = insertelement <2 x i64> undef, i64 -7, i32 0
+  %.t83 = shufflevector <2 x i64> %.t84, <2 x i64> undef, <2 x i32> zeroinitializer
+  %.t85 = add <2 x i64> %.t81, %.t83
+  %.t88 = insertelement <2 x i64> undef, i64 0, i32 0
+  %.t89 = insertelement <2 x i64> %.t88, i64 2, i32 1
+  %.t86 = shufflevector <2 x i64> %.t89, <2 x i64> undef, <2 x i32> <i32 0, i32 0>
+  %.t90 = add <2 x i64> %.t85, %.t86
+  %.t93 = insertelement <2 x i64> undef, i64 127, i32 0
+  %.t92 = shufflevector <2 x i64> %.t93, <2 x i64> undef, <2 x i32> zeroinitializer
+  %.t91 = icmp eq <2 x i64> %.t90, %.t92
+  %.t80 = sext <2 x i1> %.t91 to <2 x i64>
+  store <2 x i64> %.t80, ptr %v0
+  %.t95 = load <2 x i64>, ptr %v0
+  %.t96 = extractelement <2 x i64> %.t95, i32 0
+  %.t97 = add i64 0, %.t96
+  %.t98 = extractelement <2 x i64> %.t95, i32 1
+  %.t99 = add i64 %.t97, %.t98
+  %.t101 = load <4 x i32>, ptr %v1
+  %.t102 = extractelement <4 x i32> %.t101, i32 0
+  %.t104 = sext i32 %.t102 to i64
+  %.t103 = add i64 0, %.t104
+  %.t105 = extractelement <4 x i32> %.t101, i32 1
+  %.t107 = sext i32 %.t105 to i64
+  %.t106 = add i64 %.t103, %.t107
+  %.t108 = extractelement <4 x i32> %.t101, i32 2
+  %.t110 = sext i32 %.t108 to i64
+  %.t109 = add i64 %.t106, %.t110
+  %.t111 = extractelement <4 x i32> %.t101, i32 3
+  %.t113 = sext i32 %.t111 to i64
+  %.t112 = add i64 %.t109, %.t113
+  %.t114 = mul i64 %.t112, 3
+  %.t115 = add i64 %.t99, %.t114
+  %.t117 = load <16 x i8>, ptr %v2
+  %.t118 = extractelement <16 x i8> %.t117, i32 0
+  %.t120 = sext i8 %.t118 to i64
+  %.t119 = add i64 0, %.t120
+  %.t121 = extractelement <16 x i8> %.t117, i32 1
+  %.t123 = sext i8 %.t121 to i64
+  %.t122 = add i64 %.t119, %.t123
+  %.t124 = extractelement <16 x i8> %.t117, i32 2
+  %.t126 = sext i8 %.t124 to i64
+  %.t125 = add i64 %.t122, %.t126
+  %.t127 = extractelement <16 x i8> %.t117, i32 3
+  %.t129 = sext i8 %.t127 to i64
+  %.t128 = add i64 %.t125, %.t129
+  %.t130 = extractelement <16 x i8> %.t117, i32 4
+  %.t132 = sext i8 %.t130 to i64
+  %.t131 = add i64 %.t128, %.t132
+  %.t133 = extractelement <16 x i8> %.t117, i32 5
+  %.t135 = sext i8 %.t133 to i64
+  %.t134 = add i64 %.t131, %.t135
+  %.t136 = extractelement <16 x i8> %.t117, i32 6
+  %.t138 = sext i8 %.t136 to i64
+  %.t137 = add i64 %.t134, %.t138
+  %.t139 = extractelement <16 x i8> %.t117, i32 7
+  %.t141 = sext i8 %.t139 to i64
+  %.t140 = add i64 %.t137, %.t141
+  %.t142 = extractelement <16 x i8> %.t117, i32 8
+  %.t144 = sext i8 %.t142 to i64
+  %.t143 = add i64 %.t140, %.t144
+  %.t145 = extractelement <16 x i8> %.t117, i32 9
+  %.t147 = sext i8 %.t145 to i64
+  %.t146 = add i64 %.t143, %.t147
+  %.t148 = extractelement <16 x i8> %.t117, i32 10
+  %.t150 = sext i8 %.t148 to i64
+  %.t149 = add i64 %.t146, %.t150
+  %.t151 = extractelement <16 x i8> %.t117, i32 11
+  %.t153 = sext i8 %.t151 to i64
+  %.t152 = add i64 %.t149, %.t153
+  %.t154 = extractelement <16 x i8> %.t117, i32 12
+  %.t156 = sext i8 %.t154 to i64
+  %.t155 = add i64 %.t152, %.t156
+  %.t157 = extractelement <16 x i8> %.t117, i32 13
+  %.t159 = sext i8 %.t157 to i64
+  %.t158 = add i64 %.t155, %.t159
+  %.t160 = extractelement <16 x i8> %.t117, i32 14
+  %.t162 = sext i8 %.t160 to i64
+  %.t161 = add i64 %.t158, %.t162
+  %.t163 = extractelement <16 x i8> %.t117, i32 15
+  %.t165 = sext i8 %.t163 to i64
+  %.t164 = add i64 %.t161, %.t165
+  %.t166 = mul i64 %.t164, 5
+  %.t167 = add i64 %.t115, %.t166
+  %.t168 = getelementptr inbounds i64, ptr %a, i64 3
+  %.t169 = load i64, ptr %.t168
+  %.t170 = add i64 %.t167, %.t169
+  %.t171 = getelementptr inbounds i64, ptr %a, i64 5
+  %.t172 = load i64, ptr %.t171
+  %.t173 = mul i64 %.t172, 7
+  %.t174 = add i64 %.t170, %.t173
+  %.t179 = trunc i64 -7 to i32
+  %.t180 = insertelement <4 x i32> undef, i32 %.t179, i32 0
+  %.t181 = trunc i64 -1 to i32
+  %.t182 = insertelement <4 x i32> %.t180, i32 %.t181, i32 1
+  %.t183 = trunc i64 -128 to i32
+  %.t184 = insertelement <4 x i32> %.t182, i32 %.t183, i32 2
+  %.t185 = trunc i64 3 to i32
+  %.t186 = insertelement <4 x i32> %.t184, i32 %.t185, i32 3
+  %.t187 = trunc i64 3 to i32
+  %.t177 = insertelement <4 x i32> %.t186, i32 %.t187, i32 1
+  %.t176 = shufflevector <4 x i32> %.t177, <4 x i32> undef, <4 x i32> <i32 0, i32 1, i32 0, i32 3>
+  %.t188 = extractelement <4 x i32> %.t176, i32 0
+  %.t190 = sext i32 %.t188 to i64
+  %.t189 = add i64 0, %.t190
+  %.t191 = extractelement <4 x i32> %.t176, i32 1
+  %.t193 = sext i32 %.t191 to i64
+  %.t192 = add i64 %.t189, %.t193
+  %.t194 = extractelement <4 x i32> %.t176, i32 2
+  %.t196 = sext i32 %.t194 to i64
+  %.t195 = add i64 %.t192, %.t196
+  %.t197 = extractelement <4 x i32> %.t176, i32 3
+  %.t199 = sext i32 %.t197 to i64
+  %.t198 = add i64 %.t195, %.t199
+  %.t200 = add i64 %.t174, %.t198
+  %.t201 = trunc i64 %.t200 to i32
+  ret i32 %.t201
+}
+
+@.str.1 = private unnamed_addr constant [22 x i8] c"abcdefghijklmnopqrstu\00"
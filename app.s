@@ -0,0 +1,326 @@
+  .intel_syntax noprefix
+  .data
+  .globl L.._.0
+L.._.0:
+  .byte 97
+  .byte 98
+  .byte 99
+  .byte 100
+  .byte 101
+  .byte 102
+  .byte 103
+  .byte 104
+  .byte 105
+  .byte 106
+  .byte 107
+  .byte 108
+  .byte 109
+  .byte 110
+  .byte 111
+  .byte 112
+  .byte 113
+  .byte 114
+  .byte 115
+  .byte 116
+  .byte 117
+  .text
+  .global main
+main:
+		# ----- Prologue
+  sub rsp, 136
+		# ----- Assignment.
+  lea rax, [rsp+0]
+  push rax
+		# ----- Array literal.
+  mov rax, 5
+		# ----- Store.
+  pop rdi
+  mov [rdi], rax
+		# ----- Increment address in rdi.
+  add rdi, 8
+  push rdi
+  mov rax, -3
+		# ----- Store.
+  pop rdi
+  mov [rdi], rax
+		# ----- Increment address in rdi.
+  add rdi, 8
+  push rdi
+  mov rax, 9
+		# ----- Store.
+  pop rdi
+  mov [rdi], rax
+		# ----- Increment address in rdi.
+  add rdi, 8
+  push rdi
+  mov rax, 2147483648
+		# ----- Store.
+  pop rdi
+  mov [rdi], rax
+		# ----- Increment address in rdi.
+  add rdi, 8
+  push rdi
+  mov rax, -1
+		# ----- Store.
+  pop rdi
+  mov [rdi], rax
+		# ----- Increment address in rdi.
+  add rdi, 8
+  push rdi
+  mov rax, 7
+		# ----- Store.
+  pop rdi
+  mov [rdi], rax
+		# ----- Increment address in rdi.
+  add rdi, 8
+  push rdi
+  mov rax, 11
+		# ----- Store.
+  pop rdi
+  mov [rdi], rax
+		# ----- Increment address in rdi.
+  add rdi, 8
+  push rdi
+  mov rax, 13
+		# ----- Store.
+  pop rdi
+  mov [rdi], rax
+		# ----- Increment address in rdi.
+  add rdi, 8
+  push rdi
+  mov rax, 17
+		# ----- Store.
+  pop rdi
+  mov [rdi], rax
+		# ----- Increment address in rdi.
+  add rdi, 8
+  push rdi
+  mov rax, -19
+		# ----- Last addr for array.
+		# ----- Store.
+  pop rdi
+  mov [rdi], rax
+		# ----- Assignment.
+  lea rax, [rip+L.._.0]
+  mov qword ptr [rsp+80], rax
+  sub rsp, 16
+  mov rax, 3
+  mov [rsp+0], rax
+  mov rax, -4
+  mov [rsp+8], rax
+  movdqu xmm0, [rsp]
+  add rsp, 16
+  movdqu [rsp+88], xmm0
+  sub rsp, 16
+  mov rax, 1
+  mov [rsp+0], eax
+  mov rax, -2
+  mov [rsp+4], eax
+  mov rax, 300
+  mov [rsp+8], eax
+  mov rax, 4
+  mov [rsp+12], eax
+  movdqu xmm0, [rsp]
+  add rsp, 16
+  movdqu [rsp+104], xmm0
+  mov rax, 7
+  movd xmm0, eax
+  punpcklbw xmm0, xmm0
+  punpcklwd xmm0, xmm0
+  pshufd xmm0, xmm0, 0
+  movdqu [rsp+120], xmm0
+  mov rax, 1000
+  movd xmm0, eax
+  punpcklbw xmm0, xmm0
+  punpcklwd xmm0, xmm0
+  pshufd xmm0, xmm0, 0
+  sub rsp, 16
+  movdqu [rsp], xmm0
+  sub rsp, 16
+  mov rax, 127
+  mov [rsp+0], rax
+  mov rax, 2
+  mov [rsp+8], rax
+  movdqu xmm0, [rsp]
+  add rsp, 16
+  pshufd xmm1, xmm0, 0xee
+  paddq xmm0, xmm1
+  movq rax, xmm0
+  mov [rsp+8], al
+  movdqu xmm0, [rsp]
+  add rsp, 16
+  sub rsp, 16
+  movdqu [rsp], xmm0
+  mov rax, 9223372036854775807
+  movd xmm0, eax
+  punpcklbw xmm0, xmm0
+  punpcklwd xmm0, xmm0
+  pshufd xmm0, xmm0, 0
+  sub rsp, 16
+  movdqu [rsp], xmm0
+  sub rsp, 16
+  mov rax, 9223372036854775807
+  mov [rsp+0], al
+  mov rax, 100
+  mov [rsp+1], al
+  mov rax, 100
+  mov [rsp+2], al
+  mov rax, 9223372036854775807
+  mov [rsp+3], al
+  mov rax, -7
+  mov [rsp+4], al
+  mov rax, 9223372036854775807
+  mov [rsp+5], al
+  mov rax, 9223372036854775807
+  mov [rsp+6], al
+  mov rax, 3
+  mov [rsp+7], al
+  mov rax, 1
+  mov [rsp+8], al
+  mov rax, -100000
+  mov [rsp+9], al
+  mov rax, -2147483648
+  mov [rsp+10], al
+  mov rax, 0
+  mov [rsp+11], al
+  mov rax, 100
+  mov [rsp+12], al
+  mov rax, 2
+  mov [rsp+13], al
+  mov rax, 1000
+  mov [rsp+14], al
+  mov rax, 2
+  mov [rsp+15], al
+  movdqu xmm0, [rsp]
+  add rsp, 16
+  sub rsp, 16
+  movdqu [rsp], xmm0
+  mov rax, 4294967297
+  mov [rsp+8], al
+  movdqu xmm0, [rsp]
+  add rsp, 16
+  movdqa xmm1, xmm0
+  movdqu xmm0, [rsp]
+  add rsp, 16
+  pcmpeqb xmm0, xmm1
+  movdqa xmm1, xmm0
+  movdqu xmm0, [rsp]
+  add rsp, 16
+  paddb xmm0, xmm1
+  movdqu [rsp+120], xmm0
+  mov rax, 4294967297
+  movq xmm0, rax
+  punpcklqdq xmm0, xmm0
+  sub rsp, 16
+  movdqu [rsp], xmm0
+  mov rax, -7
+  movq xmm0, rax
+  punpcklqdq xmm0, xmm0
+  movdqa xmm1, xmm0
+  movdqu xmm0, [rsp]
+  add rsp, 16
+  paddq xmm0, xmm1
+  sub rsp, 16
+  movdqu [rsp], xmm0
+  sub rsp, 16
+  mov rax, 0
+  mov [rsp+0], rax
+  mov rax, 2
+  mov [rsp+8], rax
+  movdqu xmm0, [rsp]
+  add rsp, 16
+  pshufd xmm0, xmm0, 0x44
+  movdqa xmm1, xmm0
+  movdqu xmm0, [rsp]
+  add rsp, 16
+  paddq xmm0, xmm1
+  sub rsp, 16
+  movdqu [rsp], xmm0
+  mov rax, 127
+  movq xmm0, rax
+  punpcklqdq xmm0, xmm0
+  movdqa xmm1, xmm0
+  movdqu xmm0, [rsp]
+  add rsp, 16
+  pcmpeqd xmm0, xmm1
+  pshufd xmm1, xmm0, 0xb1
+  pand xmm0, xmm1
+  movdqu [rsp+88], xmm0
+  movdqu xmm0, [rsp+88]
+  pshufd xmm1, xmm0, 0xee
+  paddq xmm0, xmm1
+  movq rax, xmm0
+  mov r10, rax
+  movdqu xmm0, [rsp+104]
+  movdqa xmm1, xmm0
+  psrad xmm1, 31
+  movdqa xmm2, xmm0
+  punpckldq xmm0, xmm1
+  punpckhdq xmm2, xmm1
+  paddq xmm0, xmm2
+  pshufd xmm1, xmm0, 0xee
+  paddq xmm0, xmm1
+  movq rax, xmm0
+  mov rdi, 3
+  imul rax, rdi
+  add rax, r10
+  mov r9, rax
+  movdqu xmm0, [rsp+120]
+  mov eax, 0x80808080
+  movd xmm1, eax
+  pshufd xmm1, xmm1, 0
+  pxor xmm0, xmm1
+  pxor xmm1, xmm1
+  psadbw xmm0, xmm1
+  pshufd xmm1, xmm0, 0xee
+  paddq xmm0, xmm1
+  movq rax, xmm0
+  sub rax, 2048
+  mov rdi, 5
+  imul rax, rdi
+  add rax, r9
+  mov r8, rax
+		# ----- Array index.
+  lea rax, [rsp+0]
+		# ----- Load.
+  mov rax, qword ptr [rax+24]
+  add rax, r8
+  mov rcx, rax
+		# ----- Array index.
+  lea rax, [rsp+0]
+		# ----- Load.
+  mov rax, qword ptr [rax+40]
+  mov rdi, 7
+  imul rax, rdi
+  add rax, rcx
+  mov rsi, rax
+  sub rsp, 16
+  mov rax, -7
+  mov [rsp+0], eax
+  mov rax, -1
+  mov [rsp+4], eax
+  mov rax, -128
+  mov [rsp+8], eax
+  mov rax, 3
+  mov [rsp+12], eax
+  movdqu xmm0, [rsp]
+  add rsp, 16
+  sub rsp, 16
+  movdqu [rsp], xmm0
+  mov rax, 3
+  mov [rsp+4], eax
+  movdqu xmm0, [rsp]
+  add rsp, 16
+  pshufd xmm0, xmm0, 0xc4
+  movdqa xmm1, xmm0
+  psrad xmm1, 31
+  movdqa xmm2, xmm0
+  punpckldq xmm0, xmm1
+  punpckhdq xmm2, xmm1
+  paddq xmm0, xmm2
+  pshufd xmm1, xmm0, 0xee
+  paddq xmm0, xmm1
+  movq rax, xmm0
+  add rax, rsi
+  add rsp, 136
+  ret
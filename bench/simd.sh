@@ -0,0 +1,33 @@
+#!/bin/bash
+
+# 向量类型的基准测试：每个内核都有标量循环（例如dot.z）和显式向量（例如dot_simd.z）两个版本，
+# 分别用默认的SSE2、-mavx2和C代码生成（--emit=c）、LLVM IR生成（--emit=llvm）编译运行，比较耗时，并检查两个版本的结果相同。
+# 在仓库的根目录下运行：`make && bench/simd.sh`
+#
+#   dot   点积：4096个int元素的数组，v4i32每次计算4个乘积，循环向量化不支持乘法，标量版本只能逐个计算
+#   find  字节查找：在4096个字符里找出第一个'#'的位置，v16i8每次比较16个字节
+
+TIMEFORMAT=%R
+
+# 编译并运行一个内核，输出耗时，退出码放在code里
+run() {
+    file="$1"
+    shift
+    rm -rf .zcache
+    ./zc.exe "$@" "$file" > /dev/null 2>&1 || { echo "【Error】! 无法编译$file"; exit 1; }
+    printf "%-22s %-12s" "$file" "$*"
+    time ./app.exe
+    code=$?
+}
+
+for kernel in dot find; do
+    for opt in "" -mavx2 --emit=c --emit=llvm; do
+        run bench/$kernel.z $opt
+        want=$code
+        run bench/${kernel}_simd.z $opt
+        if [ "$code" != "$want" ]; then
+            echo "【Error】! bench/${kernel}_simd.z的结果是$code，标量版本是$want"
+            exit 1
+        fi
+    done
+done
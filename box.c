@@ -1,7 +1,15 @@
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include "zc.h"
 
 Box *root_box;
 
+// 模块注册表的锁。并行解析依赖模块时，多个线程会同时查找和添加模块
+static pthread_mutex_t box_lock = PTHREAD_MUTEX_INITIALIZER;
+
 void print_boxes(void) {
   Box *box = root_box->children;
   while (box) {
@@ -15,9 +23,7 @@ Box *all_boxes(void) {
 }
 
 static Box *init_box(void) {
-  Box *b = malloc(sizeof(Box));
-  b->src = NULL;
-  b->children = NULL;
+  Box *b = calloc(1, sizeof(Box));
   b->nodes = calloc(1, sizeof(NodeLink));
   b->nodes->head = NULL;
   b->nodes->tail = NULL;
@@ -29,8 +35,10 @@ static Box *init_box(void) {
 }
 
 static void add_box(Box *b) {
+  pthread_mutex_lock(&box_lock);
   b->next = root_box->children;
   root_box->children = b;
+  pthread_mutex_unlock(&box_lock);
 }
 
 void init_root_box(void) {
@@ -42,18 +50,23 @@ void init_root_box(void) {
   Type *cur = &head;
   cur = cur->next = TYPE_INT;
   cur = cur->next = TYPE_CHAR;
+  cur = cur->next = TYPE_V2I64;
+  cur = cur->next = TYPE_V4I32;
+  cur = cur->next = TYPE_V16I8;
   root_box->types = head.next;
 }
 
 Box *find_box(const char *name) {
+  pthread_mutex_lock(&box_lock);
   Box *box = root_box->children;
   while (box) {
     if (strcmp(box->name, name) == 0) {
-      return box;
+      break;
     }
     box = box->next;
   }
-  return NULL;
+  pthread_mutex_unlock(&box_lock);
+  return box;
 }
 
 static const char* get_box_name(const char* path) {
@@ -85,14 +98,48 @@ Box *create_file_box(const char* path) {
   return b;
 }
 
+// 新建一个库模块。注意：暂时只支持从lib目录导入单个文件
+Box *create_lib_box(const char *name) {
+  Box *b = create_file_box(format("lib/%s.z", name));
+  b->name = name;
+  // 导入的模块往往只用到其中少数几个函数，因此默认延迟解析函数体。设置ZC_EAGER时立即解析
+  b->lazy = getenv("ZC_EAGER") == NULL;
+  return b;
+}
+
+void add_dep(Box *b, Box *dep) {
+  for (BoxList *l = b->deps; l; l = l->next) {
+    if (l->box == dep) {
+      return;
+    }
+  }
+  BoxList *l = calloc(1, sizeof(BoxList));
+  l->box = dep;
+  l->next = b->deps;
+  b->deps = l;
+}
+
 // 如果是文件模块，解析文件内容，生成AST
 // 注意：每个文件对应一个模块
 Node *parse_file(Box *b) {
   if (b->kind != BOX_FILE) {
     fprintf(stderr, "不是文件模块\n");
-    exit(-1);
+    quit(-1);
+  }
+  // 只加载了接口的模块，需要丢掉接口里的签名，重新从源码解析。
+  // 注意：其他模块引用的仍然是接口里的值量，它们只需要名称和类型，因此不受影响
+  if (b->from_iface) {
+    b->global = calloc(1, sizeof(Region));
+    b->region = b->global;
+    b->scope = calloc(1, sizeof(Scope));
+    b->nconst = 0;
+    b->from_iface = false;
   }
-  Lexer *l = init_lexer(b->path);
+  // 如果预扫描时已经读入了源码，就不需要再读一遍文件了
+  if (b->src == NULL) {
+    b->src = read_file(b->path);
+  }
+  Lexer *l = init_src_lexer(b->path, b->src);
   Parser *p = new_parser(b, l);
   Node *prog = program(p);
   b->prog = prog;
@@ -103,7 +150,14 @@ Node *parse_code(Box *b, const char *src) {
   if (b->kind != BOX_CODE) {
     fprintf(stderr, "不是源码模块");
   }
-  Lexer *l = init_lexer(src);
+  Lexer *l;
+  // 源码文件需要记录下来，生成AST快照时要用到
+  if (is_src_file(src)) {
+    b->src = read_file(src);
+    l = init_src_lexer(src, b->src);
+  } else {
+    l = init_lexer(src);
+  }
   Parser *p = new_parser(b, l);
   Node *prog = program(p);
   // 注意，这里的parts是一个链表
@@ -117,8 +171,12 @@ Node *parse_code(Box *b, const char *src) {
 }
 
 Meta *box_lookup(Box *b, const char *name) {
+  return scope_lookup(b->scope, name);
+}
+
 // 从最近的scope到更外层的scope依次查找
-  for (Scope *scope = b->scope; scope; scope = scope->parent) {
+Meta *scope_lookup(Scope *scope, const char *name) {
+  for (; scope; scope = scope->parent) {
     for (Spot *s= scope->spots; s; s=s->next) {
       if (strcmp(name, s->name) == 0) {
         return s->meta;
@@ -143,3 +201,252 @@ Type *box_find_type(Box *b, const char *name) {
   }
   return NULL;
 }
+
+// =============================
+// 依赖预扫描与并行解析
+// =============================
+
+bool box_ready(Box *b) {
+  return b->prog != NULL || b->from_iface;
+}
+
+static void scan_deps(Box *b, BoxList **todo);
+
+// 记录b依赖名为name的模块。新发现的模块如果有最新的接口文件，就直接加载接口；
+// 否则加入到todo链表中，等待解析。
+static void scan_dep(Box *b, char *name, BoxList **todo) {
+  Box *dep = find_box(name);
+  if (dep == NULL) {
+    dep = create_lib_box(name);
+    char **names;
+    if (load_iface(dep, &names)) {
+      for (char **n = names; *n; n++) {
+        scan_dep(dep, *n, todo);
+      }
+      bind_iface_deps(dep);
+    } else {
+      BoxList *item = calloc(1, sizeof(BoxList));
+      item->box = dep;
+      item->next = *todo;
+      *todo = item;
+      scan_deps(dep, todo);
+    }
+  }
+  add_dep(b, dep);
+}
+
+// 扫描模块源码中所有的`use 模块名`，记录依赖关系，并递归扫描新发现的模块。
+static void scan_deps(Box *b, BoxList **todo) {
+  if (b->src == NULL) {
+    b->src = read_file(b->path);
+  }
+  Lexer *l = init_src_lexer(b->path, b->src);
+  TokenKind prev = TK_EOF;
+  for (Token t = next_token(l); t.kind != TK_EOF; t = next_token(l)) {
+    if (prev == TK_USE && t.kind == TK_IDENT) {
+      scan_dep(b, strndup(t.pos, t.len), todo);
+    }
+    prev = t.kind;
+  }
+}
+
+static bool deps_ready(Box *b) {
+  for (BoxList *l = b->deps; l; l = l->next) {
+    if (!box_ready(l->box)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// 解析线程的数量，可以用环境变量ZC_JOBS指定，默认为CPU核数
+static int num_jobs(void) {
+  char *env = getenv("ZC_JOBS");
+  if (env) {
+    int n = atoi(env);
+    return n > 0 ? n : 1;
+  }
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return n > 0 ? (int)n : 1;
+}
+
+// 一批可以同时解析的模块，工作线程从中依次领取任务
+typedef struct {
+  Box **boxes;
+  int len;
+  int next;
+  pthread_mutex_t lock;
+} ParseJobs;
+
+static void *parse_worker(void *arg) {
+  ParseJobs *jobs = arg;
+  for (;;) {
+    pthread_mutex_lock(&jobs->lock);
+    int i = jobs->next++;
+    pthread_mutex_unlock(&jobs->lock);
+    if (i >= jobs->len) {
+      return NULL;
+    }
+    parse_file(jobs->boxes[i]);
+    // 写出接口文件，下次编译时依赖它的模块就不需要再解析它了
+    write_iface(jobs->boxes[i]);
+  }
+}
+
+// 并行解析一批互不依赖的模块。当前线程也参与解析
+static void parse_parallel(Box **boxes, int len) {
+  ParseJobs jobs = {.boxes = boxes, .len = len, .next = 0};
+  pthread_mutex_init(&jobs.lock, NULL);
+
+  int n = num_jobs();
+  if (n > len) {
+    n = len;
+  }
+  pthread_t *threads = calloc(n, sizeof(pthread_t));
+  for (int i = 1; i < n; i++) {
+    pthread_create(&threads[i], NULL, parse_worker, &jobs);
+  }
+  parse_worker(&jobs);
+  for (int i = 1; i < n; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  free(threads);
+  pthread_mutex_destroy(&jobs.lock);
+}
+
+// 预扫描b的依赖树，然后按依赖层次分批解析：每一批里的模块所依赖的模块都已经解析完毕，
+// 因此同一批的模块之间互不影响，可以并行地进行词法分析、语法分析和类型标记。
+// 这样解析b时，use()就能直接找到已经解析好的模块了。
+void load_deps(Box *b) {
+  BoxList *todo = NULL;
+  scan_deps(b, &todo);
+
+  int n = 0;
+  for (BoxList *l = todo; l; l = l->next) {
+    n++;
+  }
+  Box **batch = calloc(n, sizeof(Box*));
+
+  while (todo) {
+    int len = 0;
+    for (BoxList **l = &todo; *l;) {
+      if (deps_ready((*l)->box)) {
+        batch[len++] = (*l)->box;
+        *l = (*l)->next;
+      } else {
+        l = &(*l)->next;
+      }
+    }
+    if (len == 0) {
+      fprintf(stderr, "【模块错误】：模块之间存在循环依赖：%s\n", todo->box->name);
+      quit(1);
+    }
+    parse_parallel(batch, len);
+  }
+  free(batch);
+}
+
+// =============================
+// 常驻的模块：编译服务器在多次请求之间保留解析好的模块
+// =============================
+
+// 把模块从注册表中移除，之后再use它时会重新创建并解析
+void drop_box(Box *b) {
+  pthread_mutex_lock(&box_lock);
+  for (Box **p = &root_box->children; *p; p = &(*p)->next) {
+    if (*p == b) {
+      *p = b->next;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&box_lock);
+}
+
+static bool has_box(BoxList *l, Box *b) {
+  for (; l; l = l->next) {
+    if (l->box == b) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static void push_box(BoxList **l, Box *b) {
+  BoxList *item = calloc(1, sizeof(BoxList));
+  item->box = b;
+  item->next = *l;
+  *l = item;
+}
+
+static void collect_deps(Box *b, BoxList **seen) {
+  if (has_box(*seen, b)) {
+    return;
+  }
+  push_box(seen, b);
+  for (BoxList *l = b->deps; l; l = l->next) {
+    collect_deps(l->box, seen);
+  }
+}
+
+// 只保留b以及b直接或间接依赖的模块，这样生成代码时不会带上其他项目的模块
+void prune_boxes(Box *b) {
+  BoxList *keep = NULL;
+  collect_deps(b, &keep);
+  for (Box **p = &root_box->children; *p;) {
+    if (has_box(keep, *p)) {
+      p = &(*p)->next;
+    } else {
+      *p = (*p)->next;
+    }
+  }
+}
+
+// 文件的修改时间，精确到纳秒；文件不存在时返回-1
+long file_mtime(const char *path) {
+  struct stat st;
+  if (stat(path, &st) != 0) {
+    return -1;
+  }
+  return st.st_mtim.tv_sec * 1000000000L + st.st_mtim.tv_nsec;
+}
+
+// 记录新加载的文件模块的修改时间
+void stamp_boxes(void) {
+  for (Box *b = root_box->children; b; b = b->next) {
+    if (b->kind == BOX_FILE && b->mtime == 0) {
+      b->mtime = file_mtime(b->path);
+    }
+  }
+}
+
+// 移除源码文件有变化的模块，以及直接或间接依赖它们的模块，返回移除的模块数量。
+// 依赖者也要移除，因为它们引用的是旧模块里的值量
+int drop_changed_boxes(void) {
+  BoxList *stale = NULL;
+  for (Box *b = root_box->children; b; b = b->next) {
+    if (b->kind == BOX_FILE && file_mtime(b->path) != b->mtime) {
+      push_box(&stale, b);
+    }
+  }
+  for (bool grew = true; grew;) {
+    grew = false;
+    for (Box *b = root_box->children; b; b = b->next) {
+      if (has_box(stale, b)) {
+        continue;
+      }
+      for (BoxList *l = b->deps; l; l = l->next) {
+        if (has_box(stale, l->box)) {
+          push_box(&stale, b);
+          grew = true;
+          break;
+        }
+      }
+    }
+  }
+  int n = 0;
+  for (BoxList *l = stale; l; l = l->next) {
+    drop_box(l->box);
+    n++;
+  }
+  return n;
+}
@@ -0,0 +1,197 @@
+#define _POSIX_C_SOURCE 200809L
+#include <dirent.h>
+#include <sys/stat.h>
+#include <utime.h>
+
+#include "zc.h"
+
+// 编译缓存：以模块源码、编译器版本、编译选项、依赖模块的对外接口和用到的值量为键，缓存每个模块生成的汇编代码。
+// 模块没有变化时，直接复用缓存中的汇编，不再重新生成；
+// 依赖模块的接口（见iface.c）变化时，键也会变化，因此依赖它的模块会自动重新生成。
+
+// 默认的缓存目录和尺寸上限
+#define CACHE_DIR ".zcache"
+#define CACHE_LIMIT (64 * 1024 * 1024)
+
+static char *salt = "";
+static int hits = 0;
+static int misses = 0;
+
+void cache_salt(const char *opt) {
+  salt = format("%s %s", salt, opt);
+}
+
+bool cache_enabled(void) {
+  return getenv("ZC_NO_CACHE") == NULL;
+}
+
+const char *cache_dir(void) {
+  char *dir = getenv("ZC_CACHE_DIR");
+  return dir ? dir : CACHE_DIR;
+}
+
+static long cache_limit(void) {
+  char *limit = getenv("ZC_CACHE_LIMIT");
+  return limit ? atol(limit) : CACHE_LIMIT;
+}
+
+static uint64_t deps_src_hash(Box *b, BoxList **seen) {
+  for (BoxList *l = *seen; l; l = l->next) {
+    if (l->box == b) {
+      return 0;
+    }
+  }
+  BoxList *item = calloc(1, sizeof(BoxList));
+  item->box = b;
+  item->next = *seen;
+  *seen = item;
+  if (b->src == NULL) {
+    b->src = read_file(b->path);
+  }
+  uint64_t h = hash_str(b->src, hash_str(b->name, 0));
+  for (BoxList *l = b->deps; l; l = l->next) {
+    h += deps_src_hash(l->box, seen);
+  }
+  return h;
+}
+
+static uint64_t cache_key(Box *b) {
+  if (b->cache_key) {
+    return b->cache_key;
+  }
+  if (b->src == NULL) {
+    b->src = read_file(b->path);
+  }
+  uint64_t h = hash_str(ZC_VERSION, 0);
+  h = hash_str(salt, h);
+  h = hash_str(b->src, h);
+  // 依赖模块的顺序取决于扫描顺序，因此这里用加法组合，让结果与顺序无关
+  uint64_t deps = 0;
+  if (opt_inline) {
+    // 开启内联时，生成的代码还包含了依赖模块的函数体，因此要用所有直接和间接依赖模块的源码代替接口
+    BoxList *seen = NULL;
+    for (BoxList *l = b->deps; l; l = l->next) {
+      deps += deps_src_hash(l->box, &seen);
+    }
+  } else {
+    for (BoxList *l = b->deps; l; l = l->next) {
+      deps += box_iface_hash(l->box);
+    }
+  }
+  h = hash_bytes(&deps, sizeof(deps), h);
+  // 只生成用到的函数和常量，因此用到了哪些值量也是键的一部分
+  uint64_t used = 0;
+  for (Spot *s = b->used; s; s = s->next) {
+    used += hash_str(s->name, 0);
+  }
+  h = hash_bytes(&used, sizeof(used), h);
+  b->cache_key = h;
+  return h;
+}
+
+// 缓存文件的路径，例如：.zcache/math-0123456789abcdef.s
+static char *entry_path(Box *b, const char *path) {
+  const char *dot = strrchr(path, '.');
+  int len = dot ? (int)(dot - path) : (int)strlen(path);
+  return format("%s/%.*s-%016lx%s", cache_dir(), len, path, (unsigned long)cache_key(b), dot ? dot : "");
+}
+
+static bool copy_file(const char *from, const char *to) {
+  FILE *in = fopen(from, "rb");
+  if (!in) {
+    return false;
+  }
+  FILE *out = fopen(to, "wb");
+  if (!out) {
+    fclose(in);
+    return false;
+  }
+  char buf[4096];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), in)) > 0) {
+    fwrite(buf, 1, n, out);
+  }
+  fclose(in);
+  fclose(out);
+  return true;
+}
+
+bool cache_restore(Box *b, const char *path) {
+  if (!cache_enabled()) {
+    return false;
+  }
+  char *entry = entry_path(b, path);
+  if (!copy_file(entry, path)) {
+    misses++;
+    return false;
+  }
+  // 更新修改时间，淘汰缓存时按修改时间实现LRU
+  utime(entry, NULL);
+  hits++;
+  return true;
+}
+
+typedef struct {
+  char *path;
+  time_t mtime;
+  long size;
+} CacheEntry;
+
+static int cmp_mtime(const void *a, const void *b) {
+  const CacheEntry *x = a;
+  const CacheEntry *y = b;
+  return (x->mtime > y->mtime) - (x->mtime < y->mtime);
+}
+
+// 缓存总尺寸超过上限时，按最近最少使用的顺序删除缓存文件
+static void evict(void) {
+  DIR *dir = opendir(cache_dir());
+  if (!dir) {
+    return;
+  }
+  int cap = 64;
+  int len = 0;
+  long total = 0;
+  CacheEntry *entries = calloc(cap, sizeof(CacheEntry));
+  for (struct dirent *d = readdir(dir); d; d = readdir(dir)) {
+    if (d->d_name[0] == '.') {
+      continue;
+    }
+    char *path = format("%s/%s", cache_dir(), d->d_name);
+    struct stat st;
+    if (stat(path, &st) != 0) {
+      continue;
+    }
+    if (len == cap) {
+      cap *= 2;
+      entries = realloc(entries, cap * sizeof(CacheEntry));
+    }
+    entries[len++] = (CacheEntry){path, st.st_mtime, st.st_size};
+    total += st.st_size;
+  }
+  closedir(dir);
+
+  qsort(entries, len, sizeof(CacheEntry), cmp_mtime);
+  long limit = cache_limit();
+  for (int i = 0; i < len && total > limit; i++) {
+    remove(entries[i].path);
+    total -= entries[i].size;
+  }
+  free(entries);
+}
+
+void cache_save(Box *b, const char *path) {
+  if (!cache_enabled()) {
+    return;
+  }
+  mkdir(cache_dir(), 0755);
+  copy_file(path, entry_path(b, path));
+  evict();
+}
+
+void print_cache_stats(void) {
+  if (!cache_enabled()) {
+    return;
+  }
+  printf("编译缓存：命中 %d，未命中 %d\n", hits, misses);
+}
@@ -0,0 +1,856 @@
+#define _POSIX_C_SOURCE 200809L
+#include "zc.h"
+#include <ctype.h>
+#include <limits.h>
+#include <stdarg.h>
+
+// C代码生成（--emit=c）：把标注好类型的语法树翻译成C源码，再交给clang -O2编译，利用C编译器成熟的优化。
+// 流程与生成汇编（codegen_box）一样：先内联、折叠常量、做可达性分析，每个模块生成一个C文件，模块没有变化时直接复用编译缓存。
+//
+// Z的代码块、if和for都是表达式，而C里它们是语句：需要它们的值时，先声明一个临时值量，在各个分支的末尾把值赋给它；
+// 作为函数体的最后一个表达式时，直接在分支里return，这样尾调用在C里也是尾调用。
+// 值量都在函数的开头声明并清零，内层作用域里重名的值量加上序号区分。
+// C不保证二元运算和函数参数先左后右地求值，运算数里有赋值或调用时，先把前面的运算数存到临时值量里。
+// 函数里有取地址操作时，值量按声明的顺序放进一个结构体，与汇编的栈帧布局一致，指针运算可以从一个值量走到相邻的值量（见test.sh）。
+//
+// 主模块的函数加上前缀z_，避免与C标准库重名；其他模块的函数以模块名为前缀，例如math.square是math_square；
+// 只声明没有定义的函数（例如puts）就是C的函数，保持原名。
+// 整数运算按64位补码回绕，编译时要加上-fwrapv；向量类型用clang和gcc都支持的vector_size扩展。
+
+static FILE *fp;
+static int indent;
+static Box *main_box;
+
+// 表示"把值作为函数的返回值"的目标
+static char RET[] = "return";
+
+// 当前函数的局部值量和它们在C代码里的名称
+typedef struct CLocal CLocal;
+struct CLocal {
+  CLocal *next;
+  Meta *meta;
+  char *name;
+};
+
+static CLocal *locals;
+static int ntmp;
+// 当前函数有取地址操作，值量都放在结构体frame里
+static bool use_frame;
+
+static char *gen_expr(Node *node);
+static void gen_into(Node *node, char *dst);
+
+static void out(char *fmt, ...) {
+  va_list ap;
+  fprintf(fp, "%*s", indent * 2, "");
+  va_start(ap, fmt);
+  vfprintf(fp, fmt, ap);
+  va_end(ap);
+  fprintf(fp, "\n");
+}
+
+// =============================
+// 名称与类型
+// =============================
+
+static char *C_KEYWORDS[] = {
+  "auto", "break", "case", "char", "const", "continue", "default", "do", "double", "else", "enum",
+  "extern", "float", "for", "goto", "if", "inline", "int", "long", "register", "restrict", "return",
+  "short", "signed", "sizeof", "static", "struct", "switch", "typedef", "union", "unsigned", "void",
+  "volatile", "while", "main", "frame", NULL,
+};
+
+static bool is_c_keyword(const char *name) {
+  for (char **k = C_KEYWORDS; *k; k++) {
+    if (strcmp(*k, name) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// 把名称里C不允许的字符换成'_'
+static char *c_ident(const char *name) {
+  char *s = strdup(name);
+  for (char *c = s; *c; c++) {
+    if (!isalnum((unsigned char)*c) && *c != '_') {
+      *c = '_';
+    }
+  }
+  return s;
+}
+
+// 函数在C代码里的名称
+static char *fn_name(Meta *m) {
+  if (m->kind == META_REF) {
+    m = m->ref;
+  }
+  if (m->is_decl) {
+    return m->name;
+  }
+  if (m->owner == NULL || m->owner == main_box) {
+    return format("z_%s", m->name);
+  }
+  return format("%s_%s", c_ident(m->owner->name), m->name);
+}
+
+// 类型为ty、名为name的声明，例如`long a[3]`、`char *s`、`long (*p)[3]`。name为空时就是类型本身的写法
+static char *c_decl(Type *ty, char *name) {
+  if (ty == NULL) {
+    fprintf(stderr, "【C代码生成错误】：值量%s的类型未知\n", name);
+    quit(1);
+  }
+  char *sep = name[0] ? " " : "";
+  switch (ty->kind) {
+  case TY_INT:
+  case TY_FN:
+    return format("long%s%s", sep, name);
+  case TY_CHAR:
+    return format("char%s%s", sep, name);
+  case TY_STR:
+    return format("char *%s", name);
+  case TY_PTR:
+    if (ty->target->kind == TY_ARRAY) {
+      return c_decl(ty->target, format("(*%s)", name));
+    }
+    return c_decl(ty->target, format("*%s", name));
+  case TY_ARRAY:
+    return c_decl(ty->target, format("%s[%zu]", name, ty->len));
+  case TY_VEC:
+    return format("z_%s%s%s", ty->name, sep, name);
+  case TY_TYPE:
+    return format("struct %s%s%s", ty->name, sep, name);
+  }
+  return NULL;
+}
+
+// 临时值量的类型：整数和字符都用long，数组退化成指向元素的指针
+static Type *tmp_type(Type *ty) {
+  if (ty == NULL || is_num(ty) || ty->kind == TY_FN) {
+    return TYPE_INT;
+  }
+  if (ty->kind == TY_ARRAY) {
+    return pointer_to(ty->target);
+  }
+  return ty;
+}
+
+static char *new_tmp(Type *ty, char *init) {
+  char *name = format("_t%d", ++ntmp);
+  out("%s = %s;", c_decl(tmp_type(ty), name), init);
+  return name;
+}
+
+static CLocal *find_clocal(Meta *meta) {
+  for (CLocal *l = locals; l; l = l->next) {
+    if (l->meta == meta) {
+      return l;
+    }
+  }
+  return NULL;
+}
+
+static bool name_taken(const char *name) {
+  for (CLocal *l = locals; l; l = l->next) {
+    if (strcmp(l->name, name) == 0) {
+      return true;
+    }
+  }
+  return is_c_keyword(name);
+}
+
+// 登记一个局部值量。内联展开的函数体和内层作用域里可能有重名的值量，要加上序号区分
+static void add_local(Meta *meta) {
+  if (meta == NULL || meta->kind != META_LET || find_clocal(meta)) {
+    return;
+  }
+  char *name = c_ident(meta->name);
+  if (name[0] == '_' || name_taken(name)) {
+    int i = 1;
+    while (name_taken(format("%s_%d", name, i))) {
+      i++;
+    }
+    name = format("%s_%d", name, i);
+  }
+  CLocal *l = calloc(1, sizeof(CLocal));
+  l->meta = meta;
+  l->name = name;
+  // 保持声明的顺序，取地址时结构体的布局要与之一致
+  CLocal **p = &locals;
+  while (*p) {
+    p = &(*p)->next;
+  }
+  *p = l;
+}
+
+static char *local_name(Meta *meta) {
+  CLocal *l = find_clocal(meta);
+  if (l == NULL) {
+    add_local(meta);
+    l = find_clocal(meta);
+  }
+  return use_frame ? format("frame.%s", l->name) : l->name;
+}
+
+// 按源码顺序找出函数体里的值量，以及有没有取地址操作
+static void collect(Node *node) {
+  if (node == NULL || node->kind == ND_FN || node->kind == ND_CTCALL) {
+    return;
+  }
+  if (node->kind == ND_IDENT) {
+    add_local(node->meta);
+  }
+  if (node->kind == ND_ADDR) {
+    use_frame = true;
+  }
+  collect(node->lhs);
+  collect(node->rhs);
+  collect(node->cond);
+  collect(node->then);
+  collect(node->els);
+  for (Node *n = node->body; n; n = n->next) {
+    collect(n);
+  }
+  for (Node *n = node->args; n; n = n->next) {
+    collect(n);
+  }
+  for (Node *n = node->elems; n; n = n->next) {
+    collect(n);
+  }
+}
+
+static void collect_list(Node *list) {
+  for (Node *n = list; n; n = n->next) {
+    collect(n);
+  }
+}
+
+static bool is_scalar(Type *ty) {
+  return ty->kind == TY_INT || ty->kind == TY_CHAR || ty->kind == TY_PTR || ty->kind == TY_STR;
+}
+
+// 在函数的开头声明所有的值量，并清零。params里的参数已经由函数的参数传入
+static void declare_locals(Meta *params) {
+  if (use_frame) {
+    out("struct {");
+    indent++;
+    for (CLocal *l = locals; l; l = l->next) {
+      out("%s;", c_decl(l->meta->type, l->name));
+    }
+    indent--;
+    out("} frame = {0};");
+    for (Meta *p = params; p; p = p->next) {
+      out("frame.%s = %s;", find_clocal(p)->name, find_clocal(p)->name);
+    }
+    return;
+  }
+  for (CLocal *l = locals; l; l = l->next) {
+    bool is_param = false;
+    for (Meta *p = params; p; p = p->next) {
+      is_param |= p == l->meta;
+    }
+    if (!is_param) {
+      out("%s = %s;", c_decl(l->meta->type, l->name), is_scalar(l->meta->type) ? "0" : "{0}");
+    }
+  }
+}
+
+// =============================
+// 表达式
+// =============================
+
+static bool contains(Node *node, NodeKind kind) {
+  if (node == NULL || node->kind == ND_FN || node->kind == ND_CTCALL) {
+    return false;
+  }
+  if (node->kind == kind) {
+    return true;
+  }
+  if (contains(node->lhs, kind) || contains(node->rhs, kind) || contains(node->cond, kind) ||
+      contains(node->then, kind) || contains(node->els, kind)) {
+    return true;
+  }
+  for (Node *n = node->body; n; n = n->next) {
+    if (contains(n, kind)) {
+      return true;
+    }
+  }
+  for (Node *n = node->args; n; n = n->next) {
+    if (contains(n, kind)) {
+      return true;
+    }
+  }
+  for (Node *n = node->elems; n; n = n->next) {
+    if (contains(n, kind)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// 有副作用的表达式：赋值和调用。内建函数里的store()会写内存，简单起见，内建函数都当作有副作用
+static bool has_effect(Node *node) {
+  return contains(node, ND_ASN) || contains(node, ND_CALL) || contains(node, ND_INTRIN);
+}
+
+// 翻译成C时需要先输出语句的表达式
+static bool needs_stmt(Node *node) {
+  return contains(node, ND_BLOCK) || contains(node, ND_IF) || contains(node, ND_FOR) ||
+         contains(node, ND_ARRAY) || contains(node, ND_INTRIN);
+}
+
+static bool is_const(Node *node) {
+  return node->kind == ND_NUM || node->kind == ND_CHAR || node->kind == ND_STR;
+}
+
+// 把表达式的值存到临时值量里，之后的运算数再怎么赋值也不会影响它
+static char *pin(Node *node, char *e) {
+  if (is_const(node)) {
+    return e;
+  }
+  return new_tmp(node->type, e);
+}
+
+// 要用到多次的运算数：不是值量或常量时先存到临时值量里
+static char *once(Node *node) {
+  char *e = gen_expr(node);
+  if (node->kind == ND_IDENT) {
+    return e;
+  }
+  return pin(node, e);
+}
+
+static char *c_num(long val) {
+  if (val == LONG_MIN) {
+    return "(-9223372036854775807L - 1)";
+  }
+  return val < 0 ? format("(%ldL)", val) : format("%ldL", val);
+}
+
+static char *c_char(char c) {
+  if (isprint((unsigned char)c) && c != '\'' && c != '\\') {
+    return format("'%c'", c);
+  }
+  return format("%d", c);
+}
+
+// 字符串字面量。源码里的字符原样输出，其他字符用八进制转义；'?'也要转义，避免组成三字符组
+static char *c_str(const char *s, size_t len) {
+  char *buf;
+  size_t n;
+  FILE *f = open_memstream(&buf, &n);
+  fputc('"', f);
+  for (size_t i = 0; i < len; i++) {
+    unsigned char c = s[i];
+    if (c == '"' || c == '\\' || c == '?') {
+      fprintf(f, "\\%c", c);
+    } else if (isprint(c)) {
+      fputc(c, f);
+    } else {
+      fprintf(f, "\\%03o", c);
+    }
+  }
+  fputc('"', f);
+  fclose(f);
+  return buf;
+}
+
+static char *binary_op(NodeKind kind) {
+  switch (kind) {
+  case ND_PLUS:
+    return "+";
+  case ND_MINUS:
+    return "-";
+  case ND_MUL:
+    return "*";
+  case ND_DIV:
+    return "/";
+  case ND_MOD:
+    return "%";
+  case ND_EQ:
+    return "==";
+  case ND_NE:
+    return "!=";
+  case ND_LT:
+    return "<";
+  case ND_LE:
+    return "<=";
+  default:
+    return NULL;
+  }
+}
+
+// 先左后右地计算两个运算数：右侧有副作用或者要先输出语句时，左侧先存到临时值量里
+static char *gen_lhs(Node *lhs, Node *rhs) {
+  char *l = gen_expr(lhs);
+  if (!is_const(rhs) && (has_effect(lhs) || has_effect(rhs) || needs_stmt(rhs))) {
+    return pin(lhs, l);
+  }
+  return l;
+}
+
+// 逐个计算参数。有参数带副作用时，按顺序把参数都存到临时值量里
+static char *gen_args(Node *args) {
+  bool ordered = false;
+  for (Node *a = args; a; a = a->next) {
+    ordered |= has_effect(a) || needs_stmt(a);
+  }
+  char *s = "";
+  for (Node *a = args; a; a = a->next) {
+    char *e = ordered ? pin(a, gen_expr(a)) : gen_expr(a);
+    s = format("%s%s%s", s, a == args ? "" : ", ", e);
+  }
+  return s;
+}
+
+// 数组字面量逐个元素赋值
+static void gen_array_asn(char *lhs, Node *array) {
+  int i = 0;
+  for (Node *n = array->elems; n; n = n->next, i++) {
+    char *elem = format("%s[%d]", lhs, i);
+    if (n->kind == ND_ARRAY) {
+      gen_array_asn(elem, n);
+    } else {
+      out("%s = %s;", elem, gen_expr(n));
+    }
+  }
+}
+
+// =============================
+// 向量类型
+// =============================
+
+// 向量的各个元素用sep连接，fmt里的%s是向量，两个%d都是元素的下标
+static char *lanes(Type *ty, char *fmt, char *v, char *sep) {
+  char *s = "";
+  for (int k = 0; k < (int)ty->len; k++) {
+    s = format("%s%s%s", s, k == 0 ? "" : sep, format(fmt, v, k, k));
+  }
+  return s;
+}
+
+static char *gen_intrin(Node *node) {
+  Node *a0 = node->args;
+  Node *a1 = a0 ? a0->next : NULL;
+  // 向量的类型与codegen.c一致
+  Type *ty = node->intrin == IN_STORE ? a1->next->type : is_vec(a0->type) ? a0->type : node->type;
+  char *vt = c_decl(ty, "");
+  switch (node->intrin) {
+  case IN_MAKE:
+    if (a1 == NULL) {
+      return format("(%s){%s}", vt, lanes(ty, "%s", once(a0), ", "));
+    }
+    return format("(%s){%s}", vt, gen_args(a0));
+  case IN_LOAD: {
+    char *arr = once(a0);
+    char *i = once(a1);
+    return format("(%s){%s}", vt, lanes(ty, format("%s[%%s + %%d]", arr), i, ", "));
+  }
+  case IN_STORE: {
+    char *arr = once(a0);
+    char *i = once(a1);
+    char *v = once(a1->next);
+    for (int k = 0; k < (int)ty->len; k++) {
+      out("%s[%s + %d] = %s[%d];", arr, i, k, v, k);
+    }
+    return "0L";
+  }
+  case IN_LANE:
+    return format("(long)%s[%ld]", once(a0), a1->val);
+  case IN_SET_LANE: {
+    char *v = new_tmp(ty, gen_expr(a0));
+    out("%s[%ld] = %s;", v, a1->val, gen_expr(a1->next));
+    return v;
+  }
+  case IN_SHUFFLE: {
+    char *v = once(a0);
+    char *s = "";
+    for (Node *k = a1; k; k = k->next) {
+      s = format("%s%s%s[%ld]", s, k == a1 ? "" : ", ", v, k->val);
+    }
+    return format("(%s){%s}", vt, s);
+  }
+  case IN_CMPEQ: {
+    // 比较的结果是同样宽度的有符号整数向量，相等的元素是-1
+    char *l = gen_lhs(a0, a1);
+    return format("(%s)(%s == %s)", vt, l, gen_expr(a1));
+  }
+  case IN_MASK:
+    return format("(%s)", lanes(ty, "((long)(%s[%d] < 0) << %d)", once(a0), " | "));
+  case IN_HSUM:
+    return format("(%s)", lanes(ty, "(long)%s[%d]", once(a0), " + "));
+  }
+  return NULL;
+}
+
+// =============================
+// 语句
+// =============================
+
+// 把表达式e的值交给dst：dst为NULL时只需要它的副作用，为RET时作为函数的返回值
+static void set_result(char *dst, Node *node, char *e) {
+  if (dst == NULL) {
+    if (node && has_effect(node)) {
+      out("%s;", e);
+    }
+    return;
+  }
+  // 代码块、if和for的值都是整数，指针要转换一下
+  if (node && node->type && !is_num(node->type) && !is_vec(node->type)) {
+    e = format("(long)%s", e);
+  }
+  if (dst == RET) {
+    out("return %s;", e);
+  } else {
+    out("%s = %s;", dst, e);
+  }
+}
+
+static void gen_list_into(Node *list, char *dst) {
+  if (list == NULL) {
+    set_result(dst, NULL, "0L");
+  }
+  for (Node *n = list; n; n = n->next) {
+    gen_into(n, n->next ? NULL : dst);
+  }
+}
+
+// 输出计算node的语句，并把值交给dst
+static void gen_into(Node *node, char *dst) {
+  switch (node->kind) {
+  case ND_BLOCK:
+    out("{");
+    indent++;
+    gen_list_into(node->body, dst);
+    indent--;
+    out("}");
+    return;
+  case ND_IF:
+    out("if (%s) {", gen_expr(node->cond));
+    indent++;
+    gen_into(node->then, dst);
+    indent--;
+    if (node->els || dst) {
+      out("} else {");
+      indent++;
+      if (node->els) {
+        gen_into(node->els, dst);
+      } else {
+        set_result(dst, NULL, "0L");
+      }
+      indent--;
+    }
+    out("}");
+    return;
+  case ND_FOR:
+    if (!needs_stmt(node->cond)) {
+      out("while (%s) {", gen_expr(node->cond));
+      indent++;
+    } else {
+      out("for (;;) {");
+      indent++;
+      out("if (!%s) break;", gen_expr(node->cond));
+    }
+    gen_into(node->body, NULL);
+    indent--;
+    out("}");
+    set_result(dst, NULL, "0L");
+    return;
+  case ND_FN:
+  case ND_USE:
+  case ND_TYPE:
+    set_result(dst, NULL, "0L");
+    return;
+  case ND_ASN:
+    if (node->rhs->kind == ND_ARRAY) {
+      gen_array_asn(gen_expr(node->lhs), node->rhs);
+      set_result(dst, NULL, "0L");
+      return;
+    }
+    if (dst == NULL) {
+      char *l = gen_expr(node->lhs);
+      out("%s = %s;", l, gen_expr(node->rhs));
+      return;
+    }
+    break;
+  default:
+    break;
+  }
+  set_result(dst, node, gen_expr(node));
+}
+
+// 翻译表达式，返回C表达式的写法。需要先执行的语句直接输出
+static char *gen_expr(Node *node) {
+  if (binary_op(node->kind)) {
+    char *l = gen_lhs(node->lhs, node->rhs);
+    return format("(%s %s %s)", l, binary_op(node->kind), gen_expr(node->rhs));
+  }
+  switch (node->kind) {
+  case ND_NUM:
+    return c_num(node->val);
+  case ND_CHAR:
+    return c_char(node->cha);
+  case ND_STR:
+    return c_str(node->str, node->len);
+  case ND_IDENT:
+    if (node->meta->kind != META_LET) {
+      error_tok(node->token, "【C代码生成错误】：不支持的值量：%s\n", node->meta->name);
+    }
+    return local_name(node->meta);
+  case ND_NOT:
+    return format("(!%s)", gen_expr(node->lhs));
+  case ND_NEG:
+    return format("(-%s)", gen_expr(node->rhs));
+  case ND_ADDR:
+    // 数组的地址就是第一个元素的地址
+    if (node->rhs->type->kind == TY_ARRAY) {
+      return gen_expr(node->rhs);
+    }
+    return format("(&%s)", gen_expr(node->rhs));
+  case ND_DEREF:
+    return format("(*%s)", gen_expr(node->rhs));
+  case ND_INDEX: {
+    char *l = gen_lhs(node->lhs, node->rhs);
+    return format("%s[%s]", l, gen_expr(node->rhs));
+  }
+  case ND_ASN: {
+    char *l = gen_expr(node->lhs);
+    if (node->rhs->kind == ND_ARRAY) {
+      gen_array_asn(l, node->rhs);
+      return "0L";
+    }
+    return format("(%s = %s)", l, gen_expr(node->rhs));
+  }
+  case ND_CALL:
+    return format("%s(%s)", fn_name(node->meta), gen_args(node->args));
+  case ND_CTCALL: {
+    // 编译期调用：用解释器求出结果
+    Value *val = interpret(new_ctcall_node(node->meta->def, node));
+    return c_num(val->as.num);
+  }
+  case ND_INTRIN:
+    return gen_intrin(node);
+  case ND_ARRAY:
+    // 长度为1的数组与普通值量一样，见codegen.c
+    if (node->len == 1) {
+      return gen_expr(node->elems);
+    }
+    return format("(%s){%s}", c_decl(node->type, ""), gen_args(node->elems));
+  case ND_BLOCK:
+  case ND_IF:
+  case ND_FOR: {
+    // 只有一个表达式的代码块，例如(1+2)
+    if (node->kind == ND_BLOCK && node->body && node->body->next == NULL && !needs_stmt(node->body)) {
+      return gen_expr(node->body);
+    }
+    char *t = new_tmp(TYPE_INT, "0");
+    gen_into(node, t);
+    return t;
+  }
+  case ND_FN:
+  case ND_USE:
+  case ND_TYPE:
+    return "0L";
+  default:
+    error_tok(node->token, "【C代码生成错误】：不支持的节点：%d\n", node->kind);
+  }
+  return NULL;
+}
+
+// =============================
+// 函数与模块
+// =============================
+
+static char *fn_proto(Meta *m) {
+  if (m->kind == META_REF) {
+    m = m->ref;
+  }
+  if (m->is_decl) {
+    return format("long %s()", m->name);
+  }
+  load_fn_body(m);
+  char *params = "";
+  for (Meta *p = m->params; p; p = p->next) {
+    params = format("%s%s%s", params, p == m->params ? "" : ", ", c_decl(p->type, ""));
+  }
+  bool is_static = m->owner == NULL || m->owner == main_box;
+  return format("%slong %s(%s)", is_static ? "static " : "", fn_name(m), params[0] ? params : "void");
+}
+
+// 调用到的其他模块的函数，以及只声明的函数，需要在文件开头声明
+static void declare_calls(Node *node, Box *b, Spot **seen) {
+  if (node == NULL || node->kind == ND_FN || node->kind == ND_CTCALL) {
+    return;
+  }
+  if (node->kind == ND_CALL) {
+    Meta *m = node->meta->kind == META_REF ? node->meta->ref : node->meta;
+    bool found = false;
+    for (Spot *s = *seen; s; s = s->next) {
+      found |= strcmp(s->name, fn_name(m)) == 0;
+    }
+    if (!found && (m->is_decl || m->owner != b)) {
+      Spot *s = calloc(1, sizeof(Spot));
+      s->name = fn_name(m);
+      s->meta = m;
+      s->next = *seen;
+      *seen = s;
+      out("%s;", fn_proto(m));
+    }
+  }
+  declare_calls(node->lhs, b, seen);
+  declare_calls(node->rhs, b, seen);
+  declare_calls(node->cond, b, seen);
+  declare_calls(node->then, b, seen);
+  declare_calls(node->els, b, seen);
+  for (Node *n = node->body; n; n = n->next) {
+    declare_calls(n, b, seen);
+  }
+  for (Node *n = node->args; n; n = n->next) {
+    declare_calls(n, b, seen);
+  }
+}
+
+static void reset_fn(void) {
+  locals = NULL;
+  ntmp = 0;
+  use_frame = false;
+}
+
+static void gen_fn(Meta *m) {
+  reset_fn();
+  for (Meta *p = m->params; p; p = p->next) {
+    add_local(p);
+  }
+  collect_list(m->body);
+  char *params = "";
+  for (Meta *p = m->params; p; p = p->next) {
+    params = format("%s%s%s", params, p == m->params ? "" : ", ", c_decl(p->type, find_clocal(p)->name));
+  }
+  bool is_static = m->owner == main_box;
+  out("");
+  out("%slong %s(%s) {", is_static ? "static " : "", fn_name(m), params[0] ? params : "void");
+  indent++;
+  declare_locals(m->params);
+  gen_list_into(m->body, RET);
+  indent--;
+  out("}");
+}
+
+// 文件开头：向量类型、自定义类型，以及所有函数的声明
+static void gen_header(Box *b, Meta *main_fn) {
+  out("// 由zc从%s生成", b->path);
+  out("typedef long z_v2i64 __attribute__((vector_size(16)));");
+  out("typedef int z_v4i32 __attribute__((vector_size(16)));");
+  out("typedef signed char z_v16i8 __attribute__((vector_size(16)));");
+  for (Node *n = b->prog->body; n; n = n->next) {
+    if (n->kind != ND_TYPE) {
+      continue;
+    }
+    out("struct %s {", n->type->name);
+    for (Field *f = n->type->fields; f; f = f->next) {
+      out("  %s;", c_decl(f->ty, f->name));
+    }
+    out("};");
+  }
+
+  Spot *seen = NULL;
+  for (Meta *m = b->prog->meta->region->locals; m; m = m->next) {
+    if (m->kind == META_FN && !m->is_decl && is_used(m) && strcmp(m->name, "main") != 0) {
+      out("%s;", fn_proto(m));
+      for (Node *n = m->body; n; n = n->next) {
+        declare_calls(n, b, &seen);
+      }
+    }
+  }
+  if (b == main_box) {
+    for (Node *n = b->prog->body; n; n = n->next) {
+      declare_calls(n, b, &seen);
+    }
+    if (main_fn) {
+      for (Node *n = main_fn->body; n; n = n->next) {
+        declare_calls(n, b, &seen);
+      }
+    }
+  }
+}
+
+static void gen_functions(Box *b) {
+  for (Meta *m = b->prog->meta->region->locals; m; m = m->next) {
+    if (m->kind == META_FN && !m->is_decl && is_used(m) && strcmp(m->name, "main") != 0) {
+      gen_fn(m);
+    }
+  }
+}
+
+// 主模块：顶层代码和main函数的函数体合在一起，成为C的main函数。最后一个表达式的值就是退出码
+static void cgen_main(Box *b, const char *path) {
+  fp = fopen(path, "w");
+  Meta *main_fn = NULL;
+  for (Meta *m = b->prog->meta->region->locals; m; m = m->next) {
+    if (m->kind == META_FN && strcmp(m->name, "main") == 0) {
+      main_fn = m;
+    }
+  }
+  gen_header(b, main_fn);
+  gen_functions(b);
+
+  reset_fn();
+  collect_list(b->prog->body);
+  if (main_fn) {
+    collect_list(main_fn->body);
+  }
+  out("");
+  out("int main(void) {");
+  indent++;
+  declare_locals(NULL);
+  for (Node *n = b->prog->body; n; n = n->next) {
+    gen_into(n, n->next || main_fn ? NULL : RET);
+  }
+  if (main_fn) {
+    gen_list_into(main_fn->body, RET);
+  }
+  out("return 0;");
+  indent--;
+  out("}");
+  fclose(fp);
+}
+
+static void cgen_lib(Box *b, const char *path) {
+  fp = fopen(path, "w");
+  gen_header(b, NULL);
+  gen_functions(b);
+  fclose(fp);
+}
+
+char *cgen_box(Box *b) {
+  main_box = b;
+  inline_box(b, true);
+  fold_consts(b->prog);
+  mark_reachable(b);
+  char *files = "app.c";
+
+  for (Box *bo = all_boxes(); bo; bo = bo->next) {
+    if (strcmp(bo->name, b->name) == 0 || bo->used == NULL) {
+      continue;
+    }
+    char *path = format("%s.c", c_ident(bo->name));
+    files = format("%s %s", files, path);
+    if (cache_restore(bo, path)) {
+      continue;
+    }
+    if (bo->prog == NULL) {
+      parse_file(bo);
+    }
+    inline_box(bo, false);
+    fold_consts(bo->prog);
+    cgen_lib(bo, path);
+    cache_save(bo, path);
+  }
+
+  if (!cache_restore(b, "app.c")) {
+    cgen_main(b, "app.c");
+    cache_save(b, "app.c");
+  }
+  print_cache_stats();
+  return files;
+}
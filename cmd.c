@@ -30,20 +30,63 @@ void parse(const char *src) {
 Value *eval(const char *src) {
   printf("zi>> %s\n", src);
   init_root_box();
-  Box *b = create_code_box();
-  Node *prog = parse_code(b, src);
+  // 脚本文件没有变化时，直接加载上次保存的AST快照，快照里的语法树已经折叠过常量了
+  Node *prog = is_src_file(src) ? load_snapshot(src) : NULL;
+  if (prog == NULL) {
+    Box *b = create_code_box();
+    prog = parse_code(b, src);
+    fold_consts(prog);
+    if (is_src_file(src)) {
+      save_snapshot(src, prog);
+    }
+  }
   Value *val = interpret(prog);
   return val;;
 }
 
-// 编译源码
-void compile(const char *file) {
-  printf("Compiling '%s' to app.exe\nRun with `./app.exe; echo $?`\n", file);
+// 编译源码，成功时返回0
+int compile(const char *file) {
+  // 先删掉上次的app.exe：解析出错时会直接退出，不能留下旧的程序，让人误以为编译成功了
+  remove("app.exe");
   init_root_box();
   Box *b = create_file_box(file);
+  // 先预扫描并并行解析所有依赖的模块，再解析主模块
+  load_deps(b);
+  if (build(b) != 0) {
+    fprintf(stderr, "【错误】：编译失败，没有生成app.exe\n");
+    return 1;
+  }
+  return 0;
+}
+
+EmitKind emit_kind = EMIT_ASM;
+char *cc_opt_level = "-O2";
+bool cc_lto = false;
+
+// 解析主模块，生成汇编（或C代码、LLVM IR）并链接成app.exe。依赖的模块都已经加载好了
+int build(Box *b) {
+  printf("Compiling '%s' to app.exe\nRun with `./app.exe; echo $?`\n", b->path);
   parse_file(b);
-  codegen_box(b);
+  if (instrument && emit_kind != EMIT_ASM) {
+    printf("--instrument只支持汇编后端，这次不插桩\n");
+  }
+  if (emit_kind == EMIT_C) {
+    char *files = cgen_box(b);
+    // Z的整数运算按补码回绕，要加上-fwrapv；-fno-builtin让puts之类的函数可以按Z的方式声明
+    fflush(stdout);
+    return system(format("clang %s %s-fwrapv -fno-builtin %s-o app.exe %s", cc_opt_level, cc_lto ? "-flto " : "",
+                         target_avx2 ? "-mavx2 " : "", files));
+  }
+  if (emit_kind == EMIT_LLVM) {
+    char *files = llgen_box(b);
+    // 优化、向量化和链接时优化都交给LLVM
+    fflush(stdout);
+    return system(format("clang %s %s%s-o app.exe %s", cc_opt_level, cc_lto ? "-flto " : "",
+                         target_avx2 ? "-mavx2 " : "", files));
+  }
+  char *files = codegen_box(b);
 
-  // 调用clang将汇编编译成可执行文件
-  system("clang -o app.exe *.s");
+  // 调用clang将汇编编译成可执行文件。插桩时还要链接输出报告的运行时，它和zc.exe一起由make编译好
+  fflush(stdout);
+  return system(format("clang -o app.exe %s%s", files, instrument ? format(" %s/rt/zprof.o", exe_dir()) : ""));
 }
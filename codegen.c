@@ -1,9 +1,36 @@
 #include "zc.h"
+#include <ctype.h>
+#include <limits.h>
 #include <stdarg.h>
 
 static char *arg_regs[] = {"rdi", "rsi", "rdx", "rcx", "r8", "r9"};
+static char *arg_regs8[] = {"dil", "sil", "dl", "cl", "r8b", "r9b"};
+// 叶子函数里用来存放值量的寄存器。rax、rdi和rdx在计算表达式时会用到，不能用来存放值量
+static char *var_regs[] = {"rsi", "rcx", "r8", "r9", "r10", "r11"};
+#define NUM_VAR_REGS 6
 static FILE *fp;
 
+bool omit_frame_pointer = true;
+bool target_avx2 = false;
+bool instrument = false;
+
+// 当前函数栈帧的尺寸，以及计算表达式时临时压栈的字节数。省略帧指针时，要用它们计算相对rsp的偏移
+static size_t frame_size;
+static int depth;
+// 正在生成的函数，顶层代码和main函数里为NULL
+static Meta *cur_fn;
+// 当前函数里用来存放值量的寄存器，以及正在用来保存中间结果的寄存器，按位标记，位序与var_regs一致
+static int fn_regs;
+static int tmp_used;
+
+// 尾调用直接跳转到被调用的函数，不会再回到当前函数
+static bool is_tail_call(Node *node) {
+  return node->kind == ND_CALL && node->is_tail && cur_fn;
+}
+
+static void gen_leave(void);
+static void gen_prof_exit(const char *name);
+
 Node *new_node_num(long val) {
   Node *node = calloc(1, sizeof(Node));
   node->kind = ND_NUM;
@@ -31,6 +58,7 @@ Node *new_ctcall_node(Node* def, Node* ctcall) {
 }
 
 static void gen_expr(Node *node);
+static char *gen_elem_addr(Node *node);
 
 static void emit(char *fmt, ...) {
   va_list ap;
@@ -64,14 +92,34 @@ static int count(void) {
   return i++;
 }
 
+// 将寄存器的值压入栈中
+static void push_reg(char *reg) {
+  emit("push %s", reg);
+  depth += 8;
+}
+
 // 将rax寄存器的值压入栈中
 static void push(void) {
-  emit("push rax");
+  push_reg("rax");
 }
 
 // 将栈顶的值弹出到指定的寄存器中
 static void pop(char *reg) {
   emit("pop %s", reg);
+  depth -= 8;
+}
+
+// 局部值量的栈槽地址
+static char *slot(Meta *meta) {
+  if (omit_frame_pointer) {
+    return format("[rsp+%d]", (int)frame_size + depth - meta->offset);
+  }
+  return format("[rbp-%d]", meta->offset);
+}
+
+// 按单个字节读写的类型。注意字符串的尺寸是它的长度，但字符串值量存的是8字节的指针
+static bool is_byte(Type *type) {
+  return type->kind == TY_CHAR;
 }
 
 // 将地址中的值加载到rax寄存器中，需要在前一句代码中emit出地址，例如gen_addr或gen_deref
@@ -83,18 +131,26 @@ static void load(Type *type) {
     return;
   }
   // 将变量的值加载到rax寄存器中
-  if (type->size == CHAR_SIZE) {
+  if (is_byte(type)) {
     emit("movsx rax, byte ptr [rax]");
   } else {
     emit("mov rax, [rax]");
   }
 }
 
-// 将rax寄存器的值存入到栈顶的地址中
-static void store(void) {
+// 将rax寄存器的值存入到栈顶的地址中，按类型的尺寸只写入对应的字节数。
+// 数组字面量的最后一个元素由赋值语句存入，这时按元素的类型存储
+static void store(Type *type) {
   comment("Store.");
   pop("rdi");
-  emit("mov [rdi], rax");
+  while (type && type->kind == TY_ARRAY) {
+    type = type->target;
+  }
+  if (type && is_byte(type)) {
+    emit("mov [rdi], al");
+  } else {
+    emit("mov [rdi], rax");
+  }
 }
 
 // 获取值量对应的局部地址，放在rax中
@@ -105,7 +161,7 @@ static void gen_addr(Node *node) {
     if (node->meta->is_global) {
       emit("lea rax, [rip-%d]", offset);
     } else {
-      emit("lea rax, [rbp-%d]", offset);
+      emit("lea rax, %s", slot(node->meta));
     }
     return;
   }
@@ -118,18 +174,1057 @@ static void gen_addr(Node *node) {
     emit("lea rax, [rip+%s]", node->meta->name);
     return;
   }
+  case ND_INDEX:
+    emit("lea rax, %s", gen_elem_addr(node));
+    return;
   default:
     error_tok(node->token, "【ZC错误】：不支持的地址类型：%d\n", node->kind);
   }
 }
 
+// =============================
+// 运算数
+// =============================
+
+// 二元运算不再把两侧的值都压栈：右侧是立即数、寄存器里的值量或栈上的值量时，直接作为指令的运算数，例如`add rax, 5`；
+// 两侧都需要计算时，按Sethi-Ullman的方法先计算需要寄存器更多的一侧，中间结果放在空闲的寄存器里。
+// 可用的寄存器是var_regs里没有被当前函数的值量占用的那些。rdx会被除法的cqo/idiv改写，因此不用来保存中间结果。
+// 后计算的一侧如果有函数调用，调用会改写这些寄存器，这时中间结果仍然压栈保存。
+// 两侧有赋值或调用时，它们的先后顺序会影响结果，这时保持先左后右的顺序。
+
+// 能直接放在栈槽里读写的值量
+static bool in_slot(Meta *meta) {
+  return meta->kind == META_LET && !meta->is_global && meta->reg == 0 && meta->type->kind != TY_ARRAY;
+}
+
+// 节点如果可以直接作为指令的运算数，返回运算数的写法，否则返回NULL。
+// 栈槽的地址与当前的压栈深度有关，因此返回值要马上使用
+static char *operand(Node *node) {
+  switch (node->kind) {
+  case ND_NUM:
+    if (node->val == (int)node->val) {
+      return format("%ld", node->val);
+    }
+    return NULL;
+  case ND_CHAR:
+    return format("%d", node->cha);
+  case ND_IDENT:
+    if (node->meta->reg > 0) {
+      return var_regs[node->meta->reg - 1];
+    }
+    if (in_slot(node->meta) && !is_byte(node->meta->type)) {
+      return format("qword ptr %s", slot(node->meta));
+    }
+    return NULL;
+  default:
+    return NULL;
+  }
+}
+
+static bool is_binary(Node *node) {
+  switch (node->kind) {
+  case ND_PLUS:
+  case ND_MINUS:
+  case ND_MUL:
+  case ND_DIV:
+  case ND_MOD:
+  case ND_EQ:
+  case ND_NE:
+  case ND_LT:
+  case ND_LE:
+    return true;
+  default:
+    return false;
+  }
+}
+
+// 子树里是否有指定种类的节点
+static bool contains(Node *node, NodeKind kind) {
+  if (node == NULL || node->kind == ND_FN) {
+    return false;
+  }
+  if (node->kind == kind) {
+    return true;
+  }
+  if (contains(node->lhs, kind) || contains(node->rhs, kind) || contains(node->cond, kind) ||
+      contains(node->then, kind) || contains(node->els, kind)) {
+    return true;
+  }
+  Node *lists[] = {node->body, node->args, node->elems};
+  for (size_t i = 0; i < sizeof(lists) / sizeof(lists[0]); i++) {
+    for (Node *n = lists[i]; n; n = n->next) {
+      if (contains(n, kind)) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+// 子树里是否有写内存的内建函数store()
+static bool has_store(Node *node) {
+  if (node == NULL || node->kind == ND_FN) {
+    return false;
+  }
+  if (node->kind == ND_INTRIN && node->intrin == IN_STORE) {
+    return true;
+  }
+  if (has_store(node->lhs) || has_store(node->rhs) || has_store(node->cond) || has_store(node->then) ||
+      has_store(node->els)) {
+    return true;
+  }
+  Node *lists[] = {node->body, node->args, node->elems};
+  for (size_t i = 0; i < sizeof(lists) / sizeof(lists[0]); i++) {
+    for (Node *n = lists[i]; n; n = n->next) {
+      if (has_store(n)) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+static bool has_effect(Node *node) {
+  return contains(node, ND_ASN) || contains(node, ND_CALL) || has_store(node);
+}
+
+// Sethi-Ullman标号：计算子树需要的临时寄存器个数
+static int need(Node *node) {
+  if (operand(node)) {
+    return 0;
+  }
+  if (!is_binary(node)) {
+    return 1;
+  }
+  int l = need(node->lhs);
+  if (operand(node->rhs)) {
+    return l > 1 ? l : 1;
+  }
+  int r = need(node->rhs);
+  return l == r ? l + 1 : (l > r ? l : r);
+}
+
+// 分配一个空闲的寄存器保存中间结果，没有时返回-1
+static int alloc_tmp(void) {
+  for (int r = 0; r < NUM_VAR_REGS; r++) {
+    if (!((fn_regs | tmp_used) & (1 << r))) {
+      tmp_used |= 1 << r;
+      return r;
+    }
+  }
+  return -1;
+}
+
+// 运算数可以交换的运算
+static bool is_commutative(Node *node) {
+  switch (node->kind) {
+  case ND_PLUS:
+    return !is_ptr(node->lhs->type) && !is_ptr(node->rhs->type);
+  case ND_MUL:
+  case ND_EQ:
+  case ND_NE:
+    return true;
+  default:
+    return false;
+  }
+}
+
+// 计算二元运算的两个运算数：左侧的值放在rax里，返回右侧运算数的写法。
+// 可以交换的运算，两侧的位置也可以互换
+static char *gen_operands(Node *node) {
+  Node *lhs = node->lhs;
+  Node *rhs = node->rhs;
+  bool swap = is_commutative(node);
+  char *opd = operand(rhs);
+  if (opd) {
+    gen_expr(lhs);
+    return operand(rhs);
+  }
+
+  bool ordered = has_effect(lhs) || has_effect(rhs);
+  // 左侧可以直接作为运算数时，先算右侧
+  if (!ordered && operand(lhs)) {
+    gen_expr(rhs);
+    if (swap) {
+      return operand(lhs);
+    }
+    emit("mov rdi, rax");
+    gen_expr(lhs);
+    return "rdi";
+  }
+
+  bool rhs_first = !ordered && need(rhs) > need(lhs);
+  Node *second = rhs_first ? lhs : rhs;
+  int t = contains(second, ND_CALL) ? -1 : alloc_tmp();
+  if (t < 0) {
+    // 没有空闲的寄存器，中间结果压栈
+    gen_expr(lhs);
+    push();
+    gen_expr(rhs);
+    emit("mov rdi, rax");
+    pop("rax");
+    return "rdi";
+  }
+  char *tmp = var_regs[t];
+  if (rhs_first) {
+    gen_expr(rhs);
+    emit("mov %s, rax", tmp);
+    gen_expr(lhs);
+  } else {
+    gen_expr(lhs);
+    emit("mov %s, rax", tmp);
+    gen_expr(rhs);
+    if (!swap) {
+      emit("mov rdi, rax");
+      emit("mov rax, %s", tmp);
+      tmp = "rdi";
+    }
+  }
+  tmp_used &= ~(1 << t);
+  return tmp;
+}
+
+// 把运算数放到寄存器里：有些指令不支持立即数运算数
+static char *in_reg(char *opd) {
+  if (isdigit(opd[0]) || opd[0] == '-' || strncmp(opd, "qword", 5) == 0) {
+    emit("mov rdi, %s", opd);
+    return "rdi";
+  }
+  return opd;
+}
+
+// 把运算数放到rdi里，用于要改写运算数的指令，不能直接改写存放值量的寄存器
+static char *to_rdi(char *opd) {
+  if (strcmp(opd, "rdi") != 0) {
+    emit("mov rdi, %s", opd);
+  }
+  return "rdi";
+}
+
+// =============================
+// 数组下标与指针运算
+// =============================
+
+// 2的幂对应的指数，不是2的幂时返回-1
+static int log2_of(long n) {
+  for (int k = 0; k < 63; k++) {
+    if (n == 1L << k) {
+      return k;
+    }
+  }
+  return -1;
+}
+
+// 把寄存器中的值乘以元素的尺寸，2的幂用移位代替乘法
+static void scale(char *reg, int size) {
+  int k = log2_of(size);
+  if (k == 0) {
+    return;
+  }
+  if (k > 0) {
+    emit("shl %s, %d", reg, k);
+  } else {
+    emit("imul %s, %d", reg, size);
+  }
+}
+
+// 计算数组元素的地址：基址放在rax里，返回对应的寻址写法，例如[rax+rdi*8]。
+// 下标是常量时直接算出位移；元素尺寸是1、2、4、8时使用带比例因子的寻址，其他尺寸先把下标乘以尺寸
+static char *gen_elem_addr(Node *node) {
+  int size = node->lhs->type->target->size;
+  Node *idx = node->rhs;
+  if (idx->kind == ND_NUM && idx->val * size == (int)(idx->val * size)) {
+    gen_expr(node->lhs);
+    return format("[rax+%ld]", idx->val * size);
+  }
+  char *opd = in_reg(gen_operands(node));
+  if (size == 1 || size == 2 || size == 4 || size == 8) {
+    return format("[rax+%s*%d]", opd, size);
+  }
+  opd = to_rdi(opd);
+  scale(opd, size);
+  return "[rax+rdi]";
+}
+
+// =============================
+// 除以常量
+// =============================
+
+// idiv要几十个时钟周期，除数是常量时换成移位或乘法：
+// 2的幂用算术右移，负数先加上2^k-1，让结果向0取整；
+// 其他除数乘以2^(64+s)/d的近似值（魔数），取乘积的高64位再右移s位，负数的结果加1修正为向0取整。
+// 魔数的算法见《Hacker's Delight》第10章。余数由x - x/d*d得到
+
+// 有符号除以d（|d| >= 2且不是2的幂）的魔数和移位数
+static long magic_of(long d, int *shift) {
+  const unsigned long two63 = 1UL << 63;
+  unsigned long ad = d < 0 ? -(unsigned long)d : (unsigned long)d;
+  unsigned long t = two63 + ((unsigned long)d >> 63);
+  unsigned long anc = t - 1 - t % ad;
+  unsigned long q1 = two63 / anc;
+  unsigned long r1 = two63 - q1 * anc;
+  unsigned long q2 = two63 / ad;
+  unsigned long r2 = two63 - q2 * ad;
+  unsigned long delta;
+  int p = 63;
+  do {
+    p++;
+    q1 *= 2;
+    r1 *= 2;
+    if (r1 >= anc) {
+      q1++;
+      r1 -= anc;
+    }
+    q2 *= 2;
+    r2 *= 2;
+    if (r2 >= ad) {
+      q2++;
+      r2 -= ad;
+    }
+    delta = ad - r2;
+  } while (q1 < delta || (q1 == delta && r1 == 0));
+  *shift = p - 64;
+  long m = (long)(q2 + 1);
+  return d < 0 ? -m : m;
+}
+
+// rax除以常量d（d不是0），is_mod为真时求余数。会改写rdx和rdi
+static void gen_div_const(long d, bool is_mod) {
+  if (d == 1 || d == -1) {
+    if (is_mod) {
+      emit("mov rax, 0");
+    } else if (d == -1) {
+      emit("neg rax");
+    }
+    return;
+  }
+  // 最小的负数取不了绝对值，仍然用idiv
+  if (d == LONG_MIN) {
+    emit("mov rdi, %ld", d);
+    emit("cqo");
+    emit("idiv rdi");
+    if (is_mod) {
+      emit("mov rax, rdx");
+    }
+    return;
+  }
+  int k = log2_of(d < 0 ? -d : d);
+  if (k > 0) {
+    comment("Divide by 2^%d", k);
+    emit("mov rdx, rax");
+    emit("sar rdx, 63");
+    emit("shr rdx, %d", 64 - k);
+    emit("add rdx, rax");
+    if (is_mod) {
+      // 余数的符号和被除数相同，与除数的符号无关
+      emit("sar rdx, %d", k);
+      emit("shl rdx, %d", k);
+      emit("sub rax, rdx");
+      return;
+    }
+    emit("sar rdx, %d", k);
+    emit("mov rax, rdx");
+    if (d < 0) {
+      emit("neg rax");
+    }
+    return;
+  }
+
+  int s;
+  long m = magic_of(d, &s);
+  comment("Divide by %ld with magic number", d);
+  emit("mov rdi, rax");
+  emit("movabs rax, %ld", m);
+  emit("imul rdi");
+  if (d > 0 && m < 0) {
+    emit("add rdx, rdi");
+  } else if (d < 0 && m > 0) {
+    emit("sub rdx, rdi");
+  }
+  if (s > 0) {
+    emit("sar rdx, %d", s);
+  }
+  emit("mov rax, rdx");
+  emit("shr rax, 63");
+  emit("add rax, rdx");
+  if (is_mod) {
+    if (d == (int)d) {
+      emit("imul rax, rax, %ld", d);
+    } else {
+      emit("movabs rdx, %ld", d);
+      emit("imul rax, rdx");
+    }
+    emit("sub rdi, rax");
+    emit("mov rax, rdi");
+  }
+}
+
+// =============================
+// 循环向量化
+// =============================
+
+// 可以向量化的循环（见opt.c的can_vectorize()）先用向量指令每次处理W个元素（SSE2是2个，AVX2是4个），
+// 剩下不足W个的元素再交给原来的标量循环处理。向量循环里只用到rax、rdx、rdi和向量寄存器，
+// 值量所在的寄存器都不受影响。
+//
+// 向量寄存器的分配与opt.c一致：xmm0到xmm7计算表达式，xmm8起是归约的累加器，xmm12起存放广播成向量的不变量。
+// 数组元素的地址是[基址+rdi*8]，rdi是当前的下标。SSE2指令的内存运算数要求16字节对齐，因此都先用movdqu读到寄存器里
+
+#define VREG_ACC 8
+#define VREG_INV 12
+
+static Node *vec_invs[4];
+static int vec_ninv;
+
+static char *vreg(int r) {
+  return format("%s%d", target_avx2 ? "ymm" : "xmm", r);
+}
+
+// 向量运算：SSE2是两个运算数的形式，AVX2是三个运算数的形式
+static void vop(char *op, int dst, char *src) {
+  if (target_avx2) {
+    emit("v%s %s, %s, %s", op, vreg(dst), vreg(dst), src);
+  } else {
+    emit("%s %s, %s", op, vreg(dst), src);
+  }
+}
+
+static bool is_vec_leaf(Node *node) {
+  return node->kind == ND_NUM || node->kind == ND_IDENT;
+}
+
+static int vec_inv(Node *node) {
+  for (int k = 0; k < vec_ninv; k++) {
+    Node *n = vec_invs[k];
+    if (n->kind == node->kind && (n->kind == ND_NUM ? n->val == node->val : n->meta == node->meta)) {
+      return k;
+    }
+  }
+  vec_invs[vec_ninv] = node;
+  return vec_ninv++;
+}
+
+// 找出表达式里的不变量
+static void collect_invs(Node *node) {
+  if (is_vec_leaf(node)) {
+    vec_inv(node);
+  } else if (node->kind != ND_INDEX) {
+    if (node->lhs) {
+      collect_invs(node->lhs);
+    }
+    collect_invs(node->rhs);
+  }
+}
+
+// 把rax里的值广播到向量寄存器r的每个元素
+static void broadcast(int r) {
+  if (target_avx2) {
+    emit("vmovq xmm%d, rax", r);
+    emit("vpbroadcastq ymm%d, xmm%d", r, r);
+  } else {
+    emit("movq xmm%d, rax", r);
+    emit("punpcklqdq xmm%d, xmm%d", r, r);
+  }
+}
+
+// 读取a[rdi]开始的W个元素
+static void vload(int r, Node *elem) {
+  gen_expr(elem->lhs);
+  emit("%s %s, [rax+rdi*8]", target_avx2 ? "vmovdqu" : "movdqu", vreg(r));
+}
+
+// 计算表达式，结果放在向量寄存器r里，可以用到r之后的寄存器
+static void gen_vexpr(Node *node, int r) {
+  switch (node->kind) {
+    case ND_INDEX:
+      vload(r, node);
+      return;
+    case ND_NUM:
+    case ND_IDENT:
+      emit("%s %s, %s", target_avx2 ? "vmovdqa" : "movdqa", vreg(r), vreg(VREG_INV + vec_inv(node)));
+      return;
+    case ND_NEG:
+      gen_vexpr(node->rhs, r);
+      vop("pxor", r + 1, vreg(r + 1));
+      vop("psubq", r + 1, vreg(r));
+      emit("%s %s, %s", target_avx2 ? "vmovdqa" : "movdqa", vreg(r), vreg(r + 1));
+      return;
+    case ND_PLUS:
+    case ND_MINUS: {
+      gen_vexpr(node->lhs, r);
+      char *src;
+      if (is_vec_leaf(node->rhs)) {
+        src = vreg(VREG_INV + vec_inv(node->rhs));
+      } else {
+        gen_vexpr(node->rhs, r + 1);
+        src = vreg(r + 1);
+      }
+      vop(node->kind == ND_PLUS ? "paddq" : "psubq", r, src);
+      return;
+    }
+    default:
+      error_tok(node->token, "【CodeGen错误】：不能向量化的表达式：%d\n", node->kind);
+  }
+}
+
+// 把rax存入值量
+static void store_var(Node *ident) {
+  Meta *m = ident->meta;
+  if (m->reg > 0) {
+    emit("mov %s, rax", var_regs[m->reg - 1]);
+  } else if (in_slot(m)) {
+    emit("mov qword ptr %s, rax", slot(m));
+  } else {
+    emit("mov rdx, rax");
+    gen_addr(ident);
+    emit("mov qword ptr [rax], rdx");
+  }
+}
+
+// 比较xmm a和xmm b，较小（is_min）或较大的元素放到a里。会改写xmm1
+static void vselect(int a, int b, bool is_min, bool wide) {
+  char *p = wide ? "ymm" : "xmm";
+  if (is_min) {
+    emit("vpcmpgtq %s1, %s%d, %s%d", p, p, a, p, b);
+  } else {
+    emit("vpcmpgtq %s1, %s%d, %s%d", p, p, b, p, a);
+  }
+  emit("vblendvpd %s%d, %s%d, %s%d, %s1", p, a, p, a, p, b, p);
+}
+
+// 把累加器r的各个元素归约成一个值，放在rax里
+static void vreduce(int r, VecStmtKind kind) {
+  if (kind == VS_ADD || kind == VS_SUB) {
+    if (target_avx2) {
+      emit("vextracti128 xmm0, ymm%d, 1", r);
+      emit("vpaddq xmm0, xmm0, xmm%d", r);
+    } else {
+      emit("movdqa xmm0, xmm%d", r);
+    }
+    if (target_avx2) {
+      emit("vpshufd xmm1, xmm0, 0xEE");
+      emit("vpaddq xmm0, xmm0, xmm1");
+      emit("vmovq rax, xmm0");
+    } else {
+      emit("pshufd xmm1, xmm0, 0xEE");
+      emit("paddq xmm0, xmm1");
+      emit("movq rax, xmm0");
+    }
+    return;
+  }
+  // 最小值和最大值只有AVX2才会向量化
+  emit("vextracti128 xmm0, ymm%d, 1", r);
+  vselect(r, 0, kind == VS_MIN, false);
+  emit("vpshufd xmm0, xmm%d, 0xEE", r);
+  vselect(r, 0, kind == VS_MIN, false);
+  emit("vmovq rax, xmm%d", r);
+}
+
+static void gen_vector_loop(Node *loop, VecLoop *v, int c) {
+  int w = target_avx2 ? 4 : 2;
+  Node iv = {.kind = ND_IDENT, .meta = v->iv, .type = v->iv->type, .token = loop->token};
+  comment("Vectorized loop, %d elements per iteration", w);
+
+  // 不变量广播到向量寄存器里；求和的累加器从0开始，最小值和最大值的累加器从值量当前的值开始
+  vec_ninv = 0;
+  for (VecStmt *s = v->stmts; s; s = s->next) {
+    collect_invs(s->expr);
+  }
+  for (int k = 0; k < vec_ninv; k++) {
+    gen_expr(vec_invs[k]);
+    broadcast(VREG_INV + k);
+  }
+  int acc = VREG_ACC;
+  for (VecStmt *s = v->stmts; s; s = s->next) {
+    if (s->kind == VS_ADD || s->kind == VS_SUB) {
+      vop("pxor", acc, vreg(acc));
+      acc++;
+    } else if (s->kind == VS_MIN || s->kind == VS_MAX) {
+      gen_expr(s->target);
+      broadcast(acc);
+      acc++;
+    }
+  }
+
+  // 还剩至少W个元素时执行向量循环
+  emit(".L.vec.%d:", c);
+  char *bound = operand(v->bound);
+  if (!bound) {
+    gen_expr(v->bound);
+    emit("mov rdx, rax");
+    bound = "rdx";
+  }
+  gen_expr(&iv);
+  emit("mov rdi, rax");
+  emit("add rax, %d", w);
+  emit("cmp rax, %s", bound);
+  emit("jg .L.vend.%d", c);
+  acc = VREG_ACC;
+  for (VecStmt *s = v->stmts; s; s = s->next) {
+    gen_vexpr(s->expr, 0);
+    switch (s->kind) {
+      case VS_STORE:
+        gen_expr(s->target->lhs);
+        emit("%s [rax+rdi*8], %s", target_avx2 ? "vmovdqu" : "movdqu", vreg(0));
+        break;
+      case VS_ADD:
+      case VS_SUB:
+        vop(s->kind == VS_ADD ? "paddq" : "psubq", acc++, vreg(0));
+        break;
+      case VS_MIN:
+      case VS_MAX:
+        vselect(acc++, 0, s->kind == VS_MIN, true);
+        break;
+    }
+  }
+  emit("lea rax, [rdi+%d]", w);
+  store_var(&iv);
+  emit("jmp .L.vec.%d", c);
+  emit(".L.vend.%d:", c);
+
+  // 累加器归约到值量里。求和的累加器从0开始，要加上值量原来的值
+  acc = VREG_ACC;
+  for (VecStmt *s = v->stmts; s; s = s->next) {
+    if (s->kind == VS_STORE) {
+      continue;
+    }
+    vreduce(acc++, s->kind);
+    if (s->kind == VS_ADD || s->kind == VS_SUB) {
+      emit("mov rdi, rax");
+      gen_expr(s->target);
+      emit("add rax, rdi");
+    }
+    store_var(s->target);
+  }
+  if (target_avx2) {
+    emit("vzeroupper");
+  }
+}
+
+// =============================
+// 向量类型
+// =============================
+
+// 向量类型（v2i64、v4i32、v16i8）的值放在xmm0里，就像整数的值放在rax里一样。
+// 二元运算先算左侧，右侧是值量或者数组读取时直接读到xmm1里，否则把左侧的值暂存到栈上。
+// 只用到SSE2的指令，例外是v16i8的shuffle()用到SSSE3的pshufb，开启-mavx2时v4i32的乘法用SSE4.1的pmulld。
+// 计算时只会改写rax、rdx、rdi和xmm0到xmm3，保存中间结果的寄存器不受影响
+
+static void gen_vec(Node *node);
+static void gen_intrin(Node *node);
+
+// 元素宽度对应的指令后缀
+static char vsuffix(Type *ty) {
+  return ty->len == 2 ? 'q' : ty->len == 4 ? 'd' : 'b';
+}
+
+// 写入一个元素时用到的rax的部分
+static char *lane_reg(Type *ty) {
+  return ty->len == 2 ? "rax" : ty->len == 4 ? "eax" : "al";
+}
+
+// 把xmm0暂存到栈上
+static void push_vec(void) {
+  emit("sub rsp, 16");
+  emit("movdqu [rsp], xmm0");
+  depth += 16;
+}
+
+static void pop_vec(char *reg) {
+  emit("movdqu %s, [rsp]", reg);
+  emit("add rsp, 16");
+  depth -= 16;
+}
+
+// 计算向量读写的数组元素arr[idx]的地址，返回寻址写法
+static char *gen_vec_addr(Node *node) {
+  Node index = {.kind = ND_INDEX, .lhs = node->args, .rhs = node->args->next, .token = node->token};
+  return gen_elem_addr(&index);
+}
+
+// 值量和数组读取可以直接读到任意的向量寄存器里。计算数组下标时不能再用到向量寄存器
+static bool is_vec_simple(Node *node) {
+  if (node->kind == ND_IDENT) {
+    return in_slot(node->meta);
+  }
+  return node->kind == ND_INTRIN && node->intrin == IN_LOAD && !contains(node->args, ND_INTRIN) &&
+         !contains(node->args->next, ND_INTRIN);
+}
+
+// 把简单的向量读到xmm r里。v4i32读取int数组时要把8个字节的元素截断成4个字节，还会用到xmm tmp
+static void gen_vec_to(Node *node, int r, int tmp) {
+  if (node->kind == ND_IDENT) {
+    emit("movdqu xmm%d, %s", r, slot(node->meta));
+    return;
+  }
+  char *addr = gen_vec_addr(node);
+  if (node->type->len != 4) {
+    emit("movdqu xmm%d, %s", r, addr);
+    return;
+  }
+  emit("lea rax, %s", addr);
+  emit("movdqu xmm%d, [rax]", r);
+  emit("movdqu xmm%d, [rax+16]", tmp);
+  emit("shufps xmm%d, xmm%d, 0x88", r, tmp);
+}
+
+// 左侧的值放在xmm0里，右侧的值放在xmm1里。有一侧是简单的向量时，先算另一侧，不用暂存到栈上
+static void gen_vec_pair(Node *lhs, Node *rhs) {
+  if (is_vec_simple(rhs)) {
+    gen_vec(lhs);
+    gen_vec_to(rhs, 1, 2);
+    return;
+  }
+  if (is_vec_simple(lhs) && !has_effect(rhs)) {
+    gen_vec(rhs);
+    emit("movdqa xmm1, xmm0");
+    gen_vec_to(lhs, 0, 2);
+    return;
+  }
+  gen_vec(lhs);
+  push_vec();
+  gen_vec(rhs);
+  emit("movdqa xmm1, xmm0");
+  pop_vec("xmm0");
+}
+
+// xmm0 = xmm0 * xmm1。SSE2只有无符号32位乘以32位得到64位的pmuludq，乘积的低位与有符号的乘法一样：
+// v4i32分别算出偶数和奇数位置的元素，再交错合并；v2i64按 lo*lo + (hi*lo + lo*hi) << 32 计算
+static void gen_vec_mul(Type *ty) {
+  if (ty->len == 4) {
+    if (target_avx2) {
+      emit("pmulld xmm0, xmm1");
+      return;
+    }
+    emit("movdqa xmm2, xmm0");
+    emit("pmuludq xmm0, xmm1");
+    emit("psrlq xmm2, 32");
+    emit("movdqa xmm3, xmm1");
+    emit("psrlq xmm3, 32");
+    emit("pmuludq xmm2, xmm3");
+    emit("pshufd xmm0, xmm0, 0x08");
+    emit("pshufd xmm2, xmm2, 0x08");
+    emit("punpckldq xmm0, xmm2");
+    return;
+  }
+  emit("movdqa xmm2, xmm0");
+  emit("psrlq xmm2, 32");
+  emit("pmuludq xmm2, xmm1");
+  emit("movdqa xmm3, xmm1");
+  emit("psrlq xmm3, 32");
+  emit("pmuludq xmm3, xmm0");
+  emit("paddq xmm2, xmm3");
+  emit("psllq xmm2, 32");
+  emit("pmuludq xmm0, xmm1");
+  emit("paddq xmm0, xmm2");
+}
+
+static void gen_vec(Node *node) {
+  if (is_vec_simple(node)) {
+    gen_vec_to(node, 0, 1);
+    return;
+  }
+  switch (node->kind) {
+    case ND_IDENT:
+      gen_addr(node);
+      emit("movdqu xmm0, [rax]");
+      return;
+    case ND_ASN:
+      if (node->lhs->kind == ND_IDENT && in_slot(node->lhs->meta)) {
+        gen_vec(node->rhs);
+        emit("movdqu %s, xmm0", slot(node->lhs->meta));
+        return;
+      }
+      gen_addr(node->lhs);
+      push();
+      gen_vec(node->rhs);
+      pop("rdi");
+      emit("movdqu [rdi], xmm0");
+      return;
+    case ND_PLUS:
+    case ND_MINUS:
+      gen_vec_pair(node->lhs, node->rhs);
+      emit("%s%c xmm0, xmm1", node->kind == ND_PLUS ? "padd" : "psub", vsuffix(node->type));
+      return;
+    case ND_MUL:
+      gen_vec_pair(node->lhs, node->rhs);
+      gen_vec_mul(node->type);
+      return;
+    case ND_INTRIN:
+      gen_intrin(node);
+      return;
+    default:
+      error_tok(node->token, "【CodeGen错误】：不支持的向量运算：%d\n", node->kind);
+  }
+}
+
+// 把rax广播到xmm0的每个元素
+static void gen_splat(Type *ty) {
+  switch (ty->len) {
+    case 2:
+      emit("movq xmm0, rax");
+      emit("punpcklqdq xmm0, xmm0");
+      return;
+    case 4:
+      emit("movd xmm0, eax");
+      emit("pshufd xmm0, xmm0, 0");
+      return;
+    default:
+      emit("movd xmm0, eax");
+      emit("punpcklbw xmm0, xmm0");
+      emit("punpcklwd xmm0, xmm0");
+      emit("pshufd xmm0, xmm0, 0");
+      return;
+  }
+}
+
+// 把xmm0的两个64位元素加起来，放在rax里
+static void gen_hsum_q(void) {
+  emit("pshufd xmm1, xmm0, 0xee");
+  emit("paddq xmm0, xmm1");
+  emit("movq rax, xmm0");
+}
+
+// 把xmm0的v4i32元素符号扩展成64位，低两个放在xmm0里，高两个放在xmm2里
+static void gen_widen_d(void) {
+  emit("movdqa xmm1, xmm0");
+  emit("psrad xmm1, 31");
+  emit("movdqa xmm2, xmm0");
+  emit("punpckldq xmm0, xmm1");
+  emit("punpckhdq xmm2, xmm1");
+}
+
+static void gen_intrin(Node *node) {
+  Node *a0 = node->args;
+  Node *a1 = a0 ? a0->next : NULL;
+  // 向量的类型：store()是写入的值的类型，构造和读取时是结果的类型，其他内建函数是第一个参数的类型
+  Type *ty = node->intrin == IN_STORE ? a1->next->type : is_vec(a0->type) ? a0->type : node->type;
+  int width = 16 / ty->len;
+  switch (node->intrin) {
+    case IN_MAKE:
+      if (a1 == NULL && a0->kind == ND_NUM && a0->val == 0) {
+        emit("pxor xmm0, xmm0");
+        return;
+      }
+      if (a1 == NULL) {
+        gen_expr(a0);
+        gen_splat(ty);
+        return;
+      }
+      // 逐个元素写到栈上，再一起读出来
+      emit("sub rsp, 16");
+      depth += 16;
+      int off = 0;
+      for (Node *arg = a0; arg; arg = arg->next, off += width) {
+        gen_expr(arg);
+        emit("mov [rsp+%d], %s", off, lane_reg(ty));
+      }
+      pop_vec("xmm0");
+      return;
+    case IN_LOAD:
+      gen_vec_to(node, 0, 1);
+      return;
+    case IN_STORE: {
+      Node *v = a1->next;
+      // 数组的地址里没有向量运算时，先算要写入的值，不用把地址压栈
+      char *addr;
+      if (!contains(a0, ND_INTRIN) && !contains(a1, ND_INTRIN)) {
+        gen_vec(v);
+        addr = gen_vec_addr(node);
+        if (ty->len == 4) {
+          emit("lea rdi, %s", addr);
+          addr = "[rdi]";
+        }
+      } else {
+        emit("lea rax, %s", gen_vec_addr(node));
+        push();
+        gen_vec(v);
+        pop("rdi");
+        addr = "[rdi]";
+      }
+      if (ty->len != 4) {
+        emit("movdqu %s, xmm0", addr);
+      } else {
+        // v4i32的元素符号扩展成8个字节的int
+        gen_widen_d();
+        emit("movdqu [rdi], xmm0");
+        emit("movdqu [rdi+16], xmm2");
+      }
+      emit("xor eax, eax");
+      return;
+    }
+    case IN_LANE: {
+      long k = a1->val;
+      gen_vec(a0);
+      if (ty->len == 2) {
+        if (k == 1) {
+          emit("pshufd xmm0, xmm0, 0xee");
+        }
+        emit("movq rax, xmm0");
+      } else if (ty->len == 4) {
+        if (k > 0) {
+          emit("pshufd xmm0, xmm0, %ld", k);
+        }
+        emit("movd eax, xmm0");
+        emit("movsxd rax, eax");
+      } else {
+        emit("pextrw eax, xmm0, %ld", k / 2);
+        if (k % 2) {
+          emit("shr eax, 8");
+        }
+        emit("movsx rax, al");
+      }
+      return;
+    }
+    case IN_SET_LANE:
+      // 先把向量暂存到栈上，替换掉其中一个元素，再读回来
+      gen_vec(a0);
+      push_vec();
+      gen_expr(a1->next);
+      emit("mov [rsp+%ld], %s", a1->val * width, lane_reg(ty));
+      pop_vec("xmm0");
+      return;
+    case IN_SHUFFLE: {
+      gen_vec(a0);
+      if (ty->len == 16) {
+        // pshufb的控制字节：第j个字节是第j个元素来自的下标
+        unsigned long half[2] = {0, 0};
+        int j = 0;
+        for (Node *k = a1; k; k = k->next, j++) {
+          half[j / 8] |= (unsigned long)k->val << (j % 8 * 8);
+        }
+        emit("mov rax, %ld", (long)half[1]);
+        push();
+        emit("mov rax, %ld", (long)half[0]);
+        push();
+        emit("movdqu xmm1, [rsp]");
+        emit("add rsp, 16");
+        depth -= 16;
+        emit("pshufb xmm0, xmm1");
+        return;
+      }
+      // pshufd按32位选择，64位的元素k对应32位的2k和2k+1
+      int imm = 0;
+      int j = 0;
+      for (Node *k = a1; k; k = k->next) {
+        if (ty->len == 4) {
+          imm |= k->val << (2 * j++);
+        } else {
+          imm |= (2 * k->val) << (2 * j++);
+          imm |= (2 * k->val + 1) << (2 * j++);
+        }
+      }
+      emit("pshufd xmm0, xmm0, 0x%02x", imm);
+      return;
+    }
+    case IN_CMPEQ:
+      gen_vec_pair(a0, a1);
+      if (ty->len == 2) {
+        // SSE2没有64位的比较：32位的两半都相等时才相等
+        emit("pcmpeqd xmm0, xmm1");
+        emit("pshufd xmm1, xmm0, 0xb1");
+        emit("pand xmm0, xmm1");
+      } else {
+        emit("pcmpeq%c xmm0, xmm1", vsuffix(ty));
+      }
+      return;
+    case IN_MASK:
+      gen_vec(a0);
+      emit("%s eax, xmm0", ty->len == 2 ? "movmskpd" : ty->len == 4 ? "movmskps" : "pmovmskb");
+      return;
+    case IN_HSUM:
+      gen_vec(a0);
+      if (ty->len == 4) {
+        gen_widen_d();
+        emit("paddq xmm0, xmm2");
+      } else if (ty->len == 16) {
+        // psadbw把8个无符号字节加到一起：先把有符号的字节都加上128变成无符号数，最后再减去16*128
+        emit("mov eax, 0x80808080");
+        emit("movd xmm1, eax");
+        emit("pshufd xmm1, xmm1, 0");
+        emit("pxor xmm0, xmm1");
+        emit("pxor xmm1, xmm1");
+        emit("psadbw xmm0, xmm1");
+      }
+      gen_hsum_q();
+      if (ty->len == 16) {
+        emit("sub rax, 2048");
+      }
+      return;
+  }
+}
+
+// =============================
+// 条件跳转
+// =============================
+
+// 比较运算对应的条件跳转指令，negate表示取反
+static char *jcc(NodeKind kind, bool negate) {
+  switch (kind) {
+  case ND_EQ:
+    return negate ? "jne" : "je";
+  case ND_NE:
+    return negate ? "je" : "jne";
+  case ND_LT:
+    return negate ? "jge" : "jl";
+  case ND_LE:
+    return negate ? "jg" : "jle";
+  default:
+    return NULL;
+  }
+}
+
+// 条件跳转：条件成立时跳到true_label，不成立时跳到false_label，标签为NULL表示顺序往下执行。
+// 比较运算直接用cmp和条件跳转指令，不再用setcc把比较的结果放到rax里再和0比较；取反只需要交换两个标签
+static void gen_cond(Node *node, char *true_label, char *false_label) {
+  if (node->kind == ND_NOT) {
+    gen_cond(node->lhs, false_label, true_label);
+    return;
+  }
+  if (node->kind == ND_NUM) {
+    char *target = node->val ? true_label : false_label;
+    if (target) {
+      emit("jmp %s", target);
+    }
+    return;
+  }
+  if (jcc(node->kind, false)) {
+    char *opd = gen_operands(node);
+    emit("cmp rax, %s", opd);
+    if (true_label) {
+      emit("%s %s", jcc(node->kind, false), true_label);
+      if (false_label) {
+        emit("jmp %s", false_label);
+      }
+    } else if (false_label) {
+      emit("%s %s", jcc(node->kind, true), false_label);
+    }
+    return;
+  }
+  gen_expr(node);
+  emit("cmp rax, 0");
+  if (true_label) {
+    emit("jne %s", true_label);
+    if (false_label) {
+      emit("jmp %s", false_label);
+    }
+  } else if (false_label) {
+    emit("je %s", false_label);
+  }
+}
+
 static void gen_expr(Node *node) {
+  if (is_vec(node->type)) {
+    gen_vec(node);
+    return;
+  }
   switch (node->kind) {
+    case ND_INTRIN:
+      gen_intrin(node);
+      return;
     case ND_IF: {
       int c = count();
-      gen_expr(node->cond);
-      emit("cmp rax, 0");
-      emit("je .L.else.%d", c);
+      gen_cond(node->cond, NULL, format(".L.else.%d", c));
       gen_expr(node->then);
       emit("jmp .L.end.%d", c);
       emit(".L.else.%d:", c);
@@ -140,14 +1235,18 @@ static void gen_expr(Node *node) {
       return;
     }
     case ND_FOR: {
+      // 把条件放在循环体的后面，每次循环只需要一个条件跳转
       int c = count();
+      VecLoop v;
+      char *reason;
+      if (opt_vectorize && can_vectorize(node, &v, &reason)) {
+        gen_vector_loop(node, &v, c);
+      }
+      emit("jmp .L.cond.%d", c);
       emit(".L.begin.%d:", c);
-      gen_expr(node->cond);
-      emit("cmp rax, 0");
-      emit("je .L.end.%d", c);
       gen_expr(node->body);
-      emit("jmp .L.begin.%d", c);
-      emit(".L.end.%d:", c);
+      emit(".L.cond.%d:", c);
+      gen_cond(node->cond, format(".L.begin.%d", c), NULL);
       return;
     }
     case ND_FN:
@@ -170,9 +1269,36 @@ static void gen_expr(Node *node) {
         pop(arg_regs[i]);
       }
 
+      // 尾调用：调用自己时直接跳回函数体的开头，重新处理参数；调用其他函数时先释放栈帧再跳转，
+      // 被调用的函数返回时，直接返回到当前函数的调用者
+      if (is_tail_call(node)) {
+        if (strcmp(node->meta->name, cur_fn->name) == 0) {
+          comment("Tail call to self");
+          emit("jmp .L.body.%s", cur_fn->name);
+        } else {
+          comment("Tail call %s()", node->meta->name);
+          gen_leave();
+          // 跳转之后不会再回到当前函数，要先记下退出
+          if (instrument) {
+            gen_prof_exit(cur_fn->name);
+          }
+          emit("mov rax, 0");
+          emit("jmp %s", node->meta->name);
+        }
+        return;
+      }
+
       comment("Calling %s()", node->meta->name);
+      // 调用时rsp要对齐到16字节，栈帧本身已经对齐，只需要考虑临时压栈的部分
+      bool pad = depth % 16 != 0;
+      if (pad) {
+        emit("sub rsp, 8");
+      }
       emit("mov rax, 0");
       emit("call %s", node->meta->name);
+      if (pad) {
+        emit("add rsp, 8");
+      }
       return;
     }
     case ND_CTCALL: {
@@ -201,15 +1327,41 @@ static void gen_expr(Node *node) {
       emit("neg rax");
       return;
     case ND_IDENT:
+      if (node->meta->reg > 0) {
+        emit("mov rax, %s", var_regs[node->meta->reg - 1]);
+        return;
+      }
+      if (in_slot(node->meta)) {
+        if (is_byte(node->meta->type)) {
+          emit("movsx rax, byte ptr %s", slot(node->meta));
+        } else {
+          emit("mov rax, qword ptr %s", slot(node->meta));
+        }
+        return;
+      }
       gen_addr(node);
       load(node->type);
       return;
     case ND_ASN:
       comment("Assignment.");
+      if (node->lhs->kind == ND_IDENT && node->lhs->meta->reg > 0) {
+        gen_expr(node->rhs);
+        emit("mov %s, rax", var_regs[node->lhs->meta->reg - 1]);
+        return;
+      }
+      if (node->lhs->kind == ND_IDENT && in_slot(node->lhs->meta)) {
+        gen_expr(node->rhs);
+        if (is_byte(node->lhs->meta->type)) {
+          emit("mov byte ptr %s, al", slot(node->lhs->meta));
+        } else {
+          emit("mov qword ptr %s, rax", slot(node->lhs->meta));
+        }
+        return;
+      }
       gen_addr(node->lhs);
       push();
       gen_expr(node->rhs);
-      store();
+      store(node->lhs->type);
       return;
     case ND_ADDR:
       comment("Get addr for pointer.");
@@ -235,14 +1387,15 @@ static void gen_expr(Node *node) {
         gen_expr(n);
         // 递增rdi中的地址，并存到栈顶。这是因为store()函数是从栈顶获取地址，并放到rdi中进行计算的
         // TODO: 优化store()和load()函数，减少地址压栈操作
+        // 最后一个元素的地址已经在栈顶了，由赋值语句存入
         if (k < node->len - 1) {
-          store();
+          store(n->type);
           comment("Increment address in rdi.");
           emit("add rdi, %ld", n->type->size);
+          push_reg("rdi");
         } else {
           comment("Last addr for array.");
         }
-        emit("push rdi");
         k++;
       }
       return;
@@ -250,81 +1403,80 @@ static void gen_expr(Node *node) {
     case ND_INDEX: {
       comment("Array index.");
       // array
-      Node *array_ident = node->lhs;
-      gen_expr(array_ident);
-      push();
-      // index
-      gen_expr(node->rhs);
-      push();
-
-      Type *elem_type = array_ident->type->target;
-
-      // 获取地址偏移
-      pop("rdi");
-      pop("rax");
-      emit("imul rdi, %d", elem_type->size);
-      emit("add rax, rdi");
-
-      load(node->lhs->type->target);
+      char *addr = gen_elem_addr(node);
+      Type *elem_type = node->lhs->type->target;
+      if (elem_type->kind == TY_ARRAY) {
+        emit("lea rax, %s", addr);
+      } else if (is_byte(elem_type)) {
+        emit("movsx rax, byte ptr %s", addr);
+      } else {
+        emit("mov rax, qword ptr %s", addr);
+      }
       return;
     }
     case ND_USE:
       return;
+    case ND_DIV:
+    case ND_MOD:
+      if (node->rhs->kind == ND_NUM && node->rhs->val != 0) {
+        gen_expr(node->lhs);
+        gen_div_const(node->rhs->val, node->kind == ND_MOD);
+        return;
+      }
+      break;
     default:
       break;
   }
 
-  // 计算左侧结果并压栈
-  gen_expr(node->lhs);
-  push();
-  // 计算右侧结果并压栈
-  gen_expr(node->rhs);
-  push();
-  // 把盏顶的两个值弹出到rax和rdi
-  pop("rdi");
-  pop("rax");
-  // TODO: 上面的计算如果左右顺序反过来，就可以节省一次push和pop，未来可以考虑优化
+  // 左侧的值在rax里，右侧是运算数opd
+  char *opd = gen_operands(node);
 
   // 执行计算
   switch (node->kind) {
-    case ND_PLUS: {
-      // ptr + num
-      if (node->lhs->type->kind == TY_PTR) {
-        // 如果加法左侧是指针类型，那么所加的值应当乘以8，即ptr+1相当于地址移动8个字节
-        emit("imul rdi, %d", OFFSET_SIZE /*node->lhs->type->target->size*/);
-      }
-
-      emit("add rax, rdi");
-      return;
-    }
+    case ND_PLUS:
     case ND_MINUS: {
-      // ptr - num
+      char *op = node->kind == ND_PLUS ? "add" : "sub";
+      // ptr + num、ptr - num：所加减的值要乘以指向的类型的尺寸，例如int指针加1相当于地址移动8个字节
       if (is_ptr(node->lhs->type) && is_num(node->rhs->type)) {
-        // 如果减法左侧是指针类型，那么所减的值应当乘以8，即ptr-1相当于地址移动-8个字节
-        emit("imul rdi, %d", OFFSET_SIZE /*node->lhs->type->target->size*/);
-      }
-      emit("sub rax, rdi");
-      // ptr - ptr
-      if (is_ptr(node->lhs->type) && is_ptr(node->rhs->type)) {
-        emit("cqo");
-        emit("mov rdi, %d", OFFSET_SIZE /*node->lhs->type->target->size*/);
-        emit("idiv rdi");
-        return;
+        int size = node->lhs->type->target->size;
+        if (node->rhs->kind == ND_NUM && node->rhs->val * size == (int)(node->rhs->val * size)) {
+          emit("%s rax, %ld", op, node->rhs->val * size);
+          return;
+        }
+        opd = to_rdi(opd);
+        scale("rdi", size);
+      }
+      emit("%s rax, %s", op, opd);
+      // ptr - ptr：地址的差要除以类型的尺寸，得到相差的元素个数
+      if (node->kind == ND_MINUS && is_ptr(node->lhs->type) && is_ptr(node->rhs->type)) {
+        int size = node->lhs->type->target->size;
+        if (log2_of(size) >= 0) {
+          emit("sar rax, %d", log2_of(size));
+        } else {
+          emit("cqo");
+          emit("mov rdi, %d", size);
+          emit("idiv rdi");
+        }
       }
       return;
     }
     case ND_MUL:
-      emit("imul rax, rdi");
+      emit("imul rax, %s", in_reg(opd));
       return;
     case ND_DIV:
+    case ND_MOD:
+      opd = in_reg(opd);
       emit("cqo");
-      emit("idiv rdi");
+      emit("idiv %s", opd);
+      if (node->kind == ND_MOD) {
+        emit("mov rax, rdx");
+      }
       return;
     case ND_EQ:
     case ND_NE:
     case ND_LT:
     case ND_LE: {
-      emit("cmp rax, rdi");
+      emit("cmp rax, %s", opd);
       if (node->kind== ND_EQ) {
         emit("sete al");
       } else if (node->kind== ND_NE) {
@@ -348,53 +1500,377 @@ static int align_to(int n, int align) {
   return (n + align - 1) / align * align;
 }
 
-static void set_local_offsets(Meta *fmeta) {
-  int offset = 0;
-  for (Meta *meta= fmeta->region->locals; meta; meta=meta->next) {
+// =============================
+// 栈帧布局
+// =============================
+
+// 按作用域的嵌套关系分配局部值量的栈槽：按源码顺序遍历函数体，值量第一次出现（即声明）时，在当前的栈顶分配；
+// 离开一个代码块时，栈顶退回到进入代码块之前的位置，这样兄弟代码块（例如if的两个分支、先后两个{}）里的值量就共用同一段栈空间。
+// 内联展开的函数体也是一个代码块，因此同样适用。
+// 栈槽从栈帧的底部（低地址）往上分配，后声明的值量地址更高，与原来的布局一致。
+//
+// 省略帧指针时，叶子函数（不调用其他函数）里的整数和指针值量放在寄存器里，寄存器也按代码块回收；
+// 参数尽量留在原来的参数寄存器里。所有值量都放进寄存器时，叶子函数就完全不需要栈帧了。
+// 函数里只要有取地址操作，值量就都放在栈上：指针运算可能会从一个值量的地址走到相邻的值量（见test.sh）。
+
+// 尚未分配栈槽的标记
+#define SLOT_NONE -1
+
+static int frame_top; // 当前已经分配到的位置
+static int frame_max; // 栈帧的最大尺寸
+static bool is_leaf; // 当前函数是否是叶子函数
+static bool has_addr; // 当前函数里是否有取地址操作
+static bool has_ptr_arith; // 当前函数里是否有指针加减法
+static int reg_used; // 已经分配出去的寄存器，按位标记
+
+// 类型的对齐要求
+static int align_of(Type *type) {
+  switch (type->kind) {
+  case TY_CHAR:
+    return CHAR_SIZE;
+  case TY_ARRAY:
+    return align_of(type->target);
+  default:
+    return OFFSET_SIZE;
+  }
+}
+
+// 值量在栈上占用的空间。字符串值量存的是指向常量的指针
+static int slot_size(Type *type) {
+  if (type->kind == TY_STR) {
+    return PTR_SIZE;
+  }
+  return type->size;
+}
+
+static void reset_slots(Region *region) {
+  for (Meta *meta = region->locals; meta; meta = meta->next) {
     if (meta->kind == META_LET) {
-      // 注意，这里数组的size实际是(元素尺寸*len)
-      size_t size = meta->type->size;
-      if (meta->type->kind == TY_STR) {
-        size = OFFSET_SIZE;
+      meta->offset = SLOT_NONE;
+      meta->reg = 0;
+      meta->addr_taken = false;
+    }
+  }
+}
+
+// 找出函数里的调用、取地址操作和指针加减法
+static void scan(Node *node) {
+  if (node == NULL || node->kind == ND_FN || node->kind == ND_CTCALL) {
+    return;
+  }
+  if (node->kind == ND_CALL && !is_tail_call(node)) {
+    is_leaf = false;
+  }
+  if (node->kind == ND_ADDR) {
+    has_addr = true;
+    if (node->rhs->kind == ND_IDENT) {
+      node->rhs->meta->addr_taken = true;
+    }
+  }
+  if ((node->kind == ND_PLUS || node->kind == ND_MINUS) && node->lhs->type && node->lhs->type->kind == TY_PTR) {
+    has_ptr_arith = true;
+  }
+  scan(node->lhs);
+  scan(node->rhs);
+  scan(node->cond);
+  scan(node->then);
+  scan(node->els);
+  for (Node *n = node->body; n; n = n->next) {
+    scan(n);
+  }
+  for (Node *n = node->args; n; n = n->next) {
+    scan(n);
+  }
+  for (Node *n = node->elems; n; n = n->next) {
+    scan(n);
+  }
+}
+
+// 取过地址的值量要放在栈上。取了地址又做指针加减法时，指针可能移到相邻的值量上，所有值量都要放在栈上
+static bool can_reg(Meta *meta) {
+  return omit_frame_pointer && is_leaf && !meta->addr_taken && !(has_addr && has_ptr_arith) &&
+         meta->kind == META_LET && (meta->type->kind == TY_INT || meta->type->kind == TY_PTR);
+}
+
+// 分配第i个寄存器，i<0表示任意一个空闲的寄存器
+static bool alloc_reg(Meta *meta, int i) {
+  for (int r = 0; r < NUM_VAR_REGS; r++) {
+    if ((i < 0 || r == i) && !(reg_used & (1 << r))) {
+      reg_used |= 1 << r;
+      fn_regs |= 1 << r;
+      meta->reg = r + 1;
+      return true;
+    }
+  }
+  return false;
+}
+
+// 为值量分配寄存器或栈槽。栈槽分配在栈顶，这时offset暂存的是栈槽相对栈帧底部的位置
+static void place(Meta *meta) {
+  if (meta->kind != META_LET || meta->offset != SLOT_NONE || meta->reg > 0) {
+    return;
+  }
+  if (can_reg(meta) && alloc_reg(meta, -1)) {
+    return;
+  }
+  meta->offset = align_to(frame_top, align_of(meta->type));
+  frame_top = meta->offset + slot_size(meta->type);
+  if (frame_top > frame_max) {
+    frame_max = frame_top;
+  }
+}
+
+static void layout(Node *node);
+
+static void layout_list(Node *list) {
+  for (Node *n = list; n; n = n->next) {
+    layout(n);
+  }
+}
+
+static void layout(Node *node) {
+  if (node == NULL || node->kind == ND_FN) {
+    return;
+  }
+  if (node->meta && (node->kind == ND_IDENT || node->kind == ND_ASN)) {
+    place(node->meta);
+  }
+  int saved = frame_top;
+  int saved_regs = reg_used;
+  layout(node->lhs);
+  layout(node->rhs);
+  layout(node->cond);
+  layout(node->then);
+  layout(node->els);
+  layout_list(node->body);
+  layout_list(node->args);
+  layout_list(node->elems);
+  // 代码块结束，块内的值量都不再使用了
+  if (node->kind == ND_BLOCK) {
+    frame_top = saved;
+    reg_used = saved_regs;
+  }
+}
+
+// 没有在函数体中出现过的值量，放在栈帧的最后
+static void place_rest(Region *region) {
+  frame_top = frame_max;
+  for (Meta *meta = region->locals; meta; meta = meta->next) {
+    place(meta);
+  }
+}
+
+// 把栈槽的位置换算成相对rbp的偏移
+static void finish_slots(Region *region, int stack_size) {
+  for (Meta *meta = region->locals; meta; meta = meta->next) {
+    if (meta->kind == META_LET) {
+      meta->offset = meta->reg > 0 ? 0 : stack_size - meta->offset;
+    }
+  }
+}
+
+static void set_local_offsets(Meta *fmeta, Node *body, Meta *main_fn, Node *main_body) {
+  frame_top = 0;
+  frame_max = 0;
+  reg_used = 0;
+  fn_regs = 0;
+  tmp_used = 0;
+  is_leaf = true;
+  has_addr = false;
+  has_ptr_arith = false;
+  reset_slots(fmeta->region);
+  for (Node *n = body; n; n = n->next) {
+    scan(n);
+  }
+  if (main_fn) {
+    reset_slots(main_fn->region);
+    for (Node *n = main_body; n; n = n->next) {
+      scan(n);
+    }
+  }
+  // 参数先留在原来的参数寄存器里，剩下的参数再按顺序分配寄存器或栈槽，放在最前面
+  int i = 0;
+  for (Meta *p = fmeta->params; p; p = p->next, i++) {
+    for (int r = 0; r < NUM_VAR_REGS; r++) {
+      if (can_reg(p) && strcmp(var_regs[r], arg_regs[i]) == 0) {
+        alloc_reg(p, r);
       }
-      offset += size;
-      meta->offset = offset;
     }
   }
-  fmeta->stack_size = align_to(offset, 16);
+  for (Meta *p = fmeta->params; p; p = p->next) {
+    place(p);
+  }
+  layout_list(body);
+  if (main_fn) {
+    layout_list(main_body);
+  }
+  // 先把所有值量都放好，才能确定栈帧的尺寸
+  place_rest(fmeta->region);
+  if (main_fn) {
+    place_rest(main_fn->region);
+  }
+  if (!omit_frame_pointer) {
+    fmeta->stack_size = align_to(frame_max, 16);
+  } else if (is_leaf && frame_max == 0) {
+    // 叶子函数的值量都在寄存器里，不需要栈帧
+    fmeta->stack_size = 0;
+  } else {
+    // 进入函数时rsp是16字节对齐再减去返回地址，栈帧的尺寸补上这8个字节，让函数体里的rsp保持对齐
+    fmeta->stack_size = align_to(frame_max + 8, 16) - 8;
+  }
+  finish_slots(fmeta->region, fmeta->stack_size);
+  if (main_fn) {
+    finish_slots(main_fn->region, fmeta->stack_size);
+  }
+}
+
+// 进入函数：建立栈帧
+static void gen_prologue(Meta *meta) {
+  comment("Prologue");
+  frame_size = meta->stack_size;
+  depth = 0;
+  if (!omit_frame_pointer) {
+    emit("push rbp");
+    emit("mov rbp, rsp");
+    emit("sub rsp, %zu", frame_size);
+  } else if (frame_size > 0) {
+    emit("sub rsp, %zu", frame_size);
+  }
+}
+
+// 释放栈帧
+static void gen_leave(void) {
+  if (!omit_frame_pointer) {
+    emit("mov rsp, rbp");
+    emit("pop rbp");
+  } else if (frame_size > 0) {
+    emit("add rsp, %zu", frame_size);
+  }
+}
+
+// 退出函数：释放栈帧并返回
+static void gen_epilogue(void) {
+  gen_leave();
+  emit("ret");
+}
+
+// =============================
+// 插桩（zc --instrument）
+// =============================
+
+// 每个函数在.bss里有4个计数：调用次数、累计周期数、当前的递归层数、最外层调用开始时的周期数。
+// 只有最外层的调用读rdtsc，递归调用只加两个计数，所以周期数是包含时间。
+// zprof段里记下函数名和计数的地址，程序退出时由运行时rt/zprof.c遍历这个段，输出报告
+
+// 读rdtsc到rax。rdtsc会覆盖rdx，调用者要先保存
+static void gen_rdtsc(void) {
+  emit("rdtsc");
+  emit("shl rdx, 32");
+  emit("or rax, rdx");
+}
+
+// 进入函数：在建立栈帧之前，这时rdx可能是第3个参数，r11还没有用到
+static void gen_prof_enter(const char *name) {
+  comment("Instrument: enter %s", name);
+  emit("inc qword ptr [rip + .L.zprof.%s]", name);
+  emit("inc qword ptr [rip + .L.zprof.%s + 16]", name);
+  emit("cmp qword ptr [rip + .L.zprof.%s + 16], 1", name);
+  emit("jne .L.zprof.enter.%s", name);
+  emit("mov r11, rdx");
+  gen_rdtsc();
+  emit("mov [rip + .L.zprof.%s + 24], rax", name);
+  emit("mov rdx, r11");
+  emit(".L.zprof.enter.%s:", name);
+}
+
+// 退出函数：返回之前，或者尾调用其他函数之前。要保留rax里的返回值和rdx里的第3个参数
+static void gen_prof_exit(const char *name) {
+  int c = count();
+  comment("Instrument: exit %s", name);
+  emit("dec qword ptr [rip + .L.zprof.%s + 16]", name);
+  emit("jnz .L.zprof.exit.%d", c);
+  emit("push rax");
+  emit("mov r11, rdx");
+  gen_rdtsc();
+  emit("sub rax, [rip + .L.zprof.%s + 24]", name);
+  emit("add [rip + .L.zprof.%s + 8], rax", name);
+  emit("mov rdx, r11");
+  emit("pop rax");
+  emit(".L.zprof.exit.%d:", c);
+}
+
+// 函数的计数和zprof段里的记录
+static void gen_prof_data(const char *name) {
+  emit(".bss");
+  emit(".balign 8");
+  emit(".L.zprof.%s:", name);
+  emit(".zero 32");
+  emit(".section .rodata");
+  emit(".L.zprof.name.%s:", name);
+  emit(".string \"%s\"", name);
+  emit(".section zprof, \"aw\"");
+  emit(".balign 8");
+  emit(".quad .L.zprof.name.%s", name);
+  emit(".quad .L.zprof.%s", name);
 }
 
 static void gen_fn(Meta *meta) {
+  // 延迟解析的函数，生成代码前要先解析函数体
+  load_fn_body(meta);
   emit("\t\t# ===== [Define Function: %s]", meta->name);
-  set_local_offsets(meta);
+  cur_fn = meta;
+  // 内联之后可能出现新的尾调用
+  Node *body = opt_loops(meta, meta->body, meta->region);
+  mark_tail_calls(body);
+  set_local_offsets(meta, body, NULL, NULL);
+  // 前面可能刚生成了字符串常量，要切换回代码段
+  emit(".text");
   emit("\n  .global %s", meta->name);
   emit("%s:", meta->name);
 
-  // Prologue
-  comment("Prologue");
-  emit("push rbp");
-  emit("mov rbp, rsp");
-  emit("sub rsp, %zu", meta->stack_size);
+  if (instrument) {
+    gen_prof_enter(meta->name);
+  }
+  gen_prologue(meta);
 
-  // 处理参数
+  // 处理参数：先把栈上的参数存好，再移动寄存器里的参数，避免覆盖还没有存好的参数寄存器。
+  // 尾调用自己时跳转到这里
+  emit(".L.body.%s:", meta->name);
   comment("Handle params");
   int i = 0;
-  for (Meta *p = meta->params; p; p = p->next) {
-    emit("mov [rbp-%d], %s", p->offset, arg_regs[i++]);
+  for (Meta *p = meta->params; p; p = p->next, i++) {
+    if (p->reg > 0) {
+      continue;
+    }
+    if (is_byte(p->type)) {
+      emit("mov %s, %s", slot(p), arg_regs8[i]);
+    } else {
+      emit("mov %s, %s", slot(p), arg_regs[i]);
+    }
+  }
+  i = 0;
+  for (Meta *p = meta->params; p; p = p->next, i++) {
+    if (p->reg > 0 && strcmp(var_regs[p->reg - 1], arg_regs[i]) != 0) {
+      emit("mov %s, %s", var_regs[p->reg - 1], arg_regs[i]);
+    }
   }
 
   comment("Function body");
   // 生成函数体
-  for (Node *n = meta->body; n; n = n->next) {
+  for (Node *n = body; n; n = n->next) {
     gen_expr(n);
   }
 
   // Epilogue
   comment("Epilogue");
   emit(".L.return.%s:", meta->name);
-  emit("mov rsp, rbp");
-  emit("pop rbp");
-  emit("ret");
+  if (instrument) {
+    gen_prof_exit(meta->name);
+  }
+  gen_epilogue();
+  if (instrument) {
+    gen_prof_data(meta->name);
+  }
 }
 
 
@@ -417,8 +1893,6 @@ void codegen_main(Node *prog) {
   // 打开目标汇编文件，并写入汇编代码
   fp = fopen("app.s", "w");
 
-  set_local_offsets(prog->meta);
-
   emit(".intel_syntax noprefix");
 
   // 生成自定义函数的代码
@@ -429,13 +1903,13 @@ void codegen_main(Node *prog) {
       if (strcmp(meta->name, "main") == 0) {
         mainFn = meta;
       } else {
-        // 单独声明没有定义的话，就不处理了。
-        if (meta->is_decl) {
+        // 单独声明没有定义的话，就不处理了。没有用到的函数也不生成
+        if (meta->is_decl || !is_used(meta)) {
           continue;
         }
         gen_fn(meta);
       }
-    } else if (meta->kind == META_CONST) {
+    } else if (meta->kind == META_CONST && is_used(meta)) {
       if (!has_global_data) {
         emit(".data");
         has_global_data = true;
@@ -444,41 +1918,48 @@ void codegen_main(Node *prog) {
     }
   }
 
+  // 顶层代码和main函数的函数体共用一个栈帧
+  cur_fn = NULL;
+  Node *body = opt_loops(NULL, prog->body, prog->meta->region);
+  Node *main_body = mainFn ? opt_loops(mainFn, mainFn->body, mainFn->region) : NULL;
+  set_local_offsets(prog->meta, body, mainFn, main_body);
+
   emit(".text");
   emit(".global main");
   label("main");
 
+  if (instrument) {
+    gen_prof_enter("main");
+  }
+  gen_prologue(prog->meta);
 
-  // Prologue
-  emit("push rbp");
-  emit("mov rbp, rsp");
-  emit("sub rsp, %zu", prog->meta->stack_size);
-
-  for (Node *n = prog->body; n; n = n->next) {
+  for (Node *n = body; n; n = n->next) {
     gen_expr(n);
   }
 
   // 如果有main定义，在这里生成
   if (mainFn) {
-    for (Node *n = mainFn->body; n; n = n->next) {
+    for (Node *n = main_body; n; n = n->next) {
       gen_expr(n);
     }
   }
 
   // Epilogue
-  emit("mov rsp, rbp");
-  emit("pop rbp");
-  emit("ret");
+  if (instrument) {
+    gen_prof_exit("main");
+  }
+  gen_epilogue();
+  if (instrument) {
+    gen_prof_data("main");
+  }
 
   fclose(fp);
 }
 
-void codegen_lib(Box *b) {
-  char *buf = calloc(1, 1024);
-  sprintf(buf, "%s.s", b->name);
-  fp = fopen(buf, "w");
+void codegen_lib(Box *b, const char *path) {
+  fp = fopen(path, "w");
 
-  set_local_offsets(b->prog->meta);
+  set_local_offsets(b->prog->meta, b->prog->body, NULL, NULL);
 
   emit(".intel_syntax noprefix");
 
@@ -489,13 +1970,13 @@ void codegen_lib(Box *b) {
       if (strcmp(meta->name, "main") == 0) {
         printf("DEBUG: Got main definition in lib, ignored.\n");
       } else {
-        // 单独声明没有定义的话，就不处理了。
-        if (meta->is_decl) {
+        // 单独声明没有定义的话，就不处理了。没有用到的函数也不生成
+        if (meta->is_decl || !is_used(meta)) {
           continue;
         }
         gen_fn(meta);
       }
-    } else if (meta->kind == META_CONST) {
+    } else if (meta->kind == META_CONST && is_used(meta)) {
       if (!has_global_data) {
         emit(".data");
         has_global_data = true;
@@ -508,18 +1989,40 @@ void codegen_lib(Box *b) {
 }
 
 
-void codegen_box(Box *b) {
+char *codegen_box(Box *b) {
+  // 先内联主模块里的调用并折叠常量，再做可达性分析：只有用到的函数和常量才生成代码，完全被内联的函数就不需要生成了
+  inline_box(b, true);
+  fold_consts(b->prog);
+  mark_reachable(b);
+  char *files = "app.s";
 
   // 生成use引用到的模块
   for (Box *bo = all_boxes(); bo; bo = bo->next) {
-    // 忽略掉主模块
-    if (strcmp(bo->name, b->name) == 0) {
+    // 忽略掉主模块，以及一个值量都没用到的模块
+    if (strcmp(bo->name, b->name) == 0 || bo->used == NULL) {
+      continue;
+    }
+    char *path = format("%s.s", bo->name);
+    files = format("%s %s", files, path);
+    // 模块没有变化时，直接复用缓存中的汇编
+    if (cache_restore(bo, path)) {
       continue;
     }
-    codegen_lib(bo);
+    // 只加载了接口的模块，生成代码前需要先解析源码
+    if (bo->prog == NULL) {
+      parse_file(bo);
+    }
+    inline_box(bo, false);
+    fold_consts(bo->prog);
+    codegen_lib(bo, path);
+    cache_save(bo, path);
   }
 
   // 生成主模块的代码
-  codegen_main(b->prog);
+  if (!cache_restore(b, "app.s")) {
+    codegen_main(b->prog);
+    cache_save(b, "app.s");
+  }
+  print_cache_stats();
+  return files;
 }
-
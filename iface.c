@@ -0,0 +1,352 @@
+#define _POSIX_C_SOURCE 200809L
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "zc.h"
+
+// 模块接口文件：记录模块对外的值量签名，导入模块时直接映射接口文件，而不需要解析整个源码。
+//
+// 文件格式（按写入顺序排列，整数为本机字节序）：
+//   "ZIF1" | u64 源码哈希 | u64 接口哈希
+//   u32 依赖数 | 依赖模块名 ...
+//   u32 值量数 | 值量签名 ...
+//   每个函数定义的源码，顺序与值量签名一致，用于编译期调用等需要函数体的场景
+// 字符串存为 u32长度 + 内容 + '\0'，加载时名称直接指向映射的内存，不需要复制。
+
+#define IFACE_MAGIC "ZIF2"
+
+// =============================
+// 写入
+// =============================
+
+static void put_u8(FILE *out, uint8_t v) {
+  fwrite(&v, sizeof(v), 1, out);
+}
+
+static void put_u32(FILE *out, uint32_t v) {
+  fwrite(&v, sizeof(v), 1, out);
+}
+
+static void put_u64(FILE *out, uint64_t v) {
+  fwrite(&v, sizeof(v), 1, out);
+}
+
+static void put_str(FILE *out, const char *s, size_t len) {
+  put_u32(out, len);
+  fwrite(s, 1, len, out);
+  fputc('\0', out);
+}
+
+static void put_type(FILE *out, Type *ty) {
+  if (!ty) {
+    put_u8(out, 0);
+    return;
+  }
+  put_u8(out, 1);
+  put_u8(out, ty->kind);
+  put_u64(out, ty->size);
+  put_u64(out, ty->len);
+  const char *name = ty->name ? ty->name : "";
+  put_str(out, name, strlen(name));
+  put_type(out, ty->target);
+  put_type(out, ty->ret_type);
+  uint32_t n = 0;
+  for (Type *t = ty->param_types; t; t = t->next) {
+    n++;
+  }
+  put_u32(out, n);
+  for (Type *t = ty->param_types; t; t = t->next) {
+    put_type(out, t);
+  }
+}
+
+// 只有顶层的函数和值量才属于模块的接口；字符串常量和导入的引用都不算
+static bool is_exported(Meta *m) {
+  return m->kind == META_FN || m->kind == META_LET;
+}
+
+static void put_sigs(FILE *out, Box *b) {
+  uint32_t n = 0;
+  for (Meta *m = b->prog->meta->region->locals; m; m = m->next) {
+    if (is_exported(m)) {
+      n++;
+    }
+  }
+  put_u32(out, n);
+  for (Meta *m = b->prog->meta->region->locals; m; m = m->next) {
+    if (!is_exported(m)) {
+      continue;
+    }
+    put_u8(out, m->kind);
+    put_u8(out, m->is_decl);
+    put_str(out, m->name, strlen(m->name));
+    put_type(out, m->type);
+  }
+}
+
+// 接口哈希只覆盖值量签名，修改函数体不会改变接口哈希
+uint64_t box_iface_hash(Box *b) {
+  if (b->iface_hash) {
+    return b->iface_hash;
+  }
+  char *buf;
+  size_t len;
+  FILE *out = open_memstream(&buf, &len);
+  put_sigs(out, b);
+  fclose(out);
+  b->iface_hash = hash_bytes(buf, len, hash_str(b->name, 0));
+  free(buf);
+  return b->iface_hash;
+}
+
+static uint64_t src_hash(const char *src) {
+  return hash_str(src, hash_str(ZC_VERSION, 0));
+}
+
+static char *iface_path(Box *b) {
+  return format("%s/%s.zif", cache_dir(), b->name);
+}
+
+void write_iface(Box *b) {
+  if (!cache_enabled()) {
+    return;
+  }
+  mkdir(cache_dir(), 0755);
+  char *path = iface_path(b);
+  // 先写入临时文件再改名，这样其他进程不会读到写了一半的接口文件
+  char *tmp = format("%s.%d.tmp", path, (int)getpid());
+  FILE *out = fopen(tmp, "wb");
+  if (!out) {
+    return;
+  }
+
+  fwrite(IFACE_MAGIC, 1, 4, out);
+  put_u64(out, src_hash(b->src));
+  put_u64(out, box_iface_hash(b));
+
+  uint32_t ndeps = 0;
+  for (BoxList *l = b->deps; l; l = l->next) {
+    ndeps++;
+  }
+  put_u32(out, ndeps);
+  for (BoxList *l = b->deps; l; l = l->next) {
+    put_str(out, l->box->name, strlen(l->box->name));
+  }
+
+  put_sigs(out, b);
+
+  for (Meta *m = b->prog->meta->region->locals; m; m = m->next) {
+    if (!is_exported(m)) {
+      continue;
+    }
+    if (m->kind == META_FN && m->src_pos) {
+      put_str(out, m->src_pos, m->src_len);
+    } else {
+      put_str(out, "", 0);
+    }
+  }
+
+  fclose(out);
+  rename(tmp, path);
+}
+
+// =============================
+// 加载
+// =============================
+
+typedef struct {
+  char *pos;
+  char *end;
+  bool ok;
+} Reader;
+
+static void *take(Reader *r, size_t n) {
+  if (!r->ok || r->end - r->pos < (long)n) {
+    r->ok = false;
+    return NULL;
+  }
+  void *p = r->pos;
+  r->pos += n;
+  return p;
+}
+
+static uint8_t get_u8(Reader *r) {
+  uint8_t *p = take(r, sizeof(uint8_t));
+  return p ? *p : 0;
+}
+
+static uint32_t get_u32(Reader *r) {
+  uint32_t v = 0;
+  void *p = take(r, sizeof(v));
+  if (p) {
+    memcpy(&v, p, sizeof(v));
+  }
+  return v;
+}
+
+static uint64_t get_u64(Reader *r) {
+  uint64_t v = 0;
+  void *p = take(r, sizeof(v));
+  if (p) {
+    memcpy(&v, p, sizeof(v));
+  }
+  return v;
+}
+
+static char *get_str(Reader *r, size_t *len) {
+  uint32_t n = get_u32(r);
+  char *s = take(r, n + 1);
+  if (len) {
+    *len = n;
+  }
+  return s;
+}
+
+static Type *get_type(Reader *r) {
+  if (!get_u8(r)) {
+    return NULL;
+  }
+  TypeKind kind = get_u8(r);
+  size_t size = get_u64(r);
+  size_t len = get_u64(r);
+  char *name = get_str(r, NULL);
+  if (!r->ok) {
+    return NULL;
+  }
+  // 内置类型复制全局的单例：参数的类型用next串成链表，不能改动单例的next（全局的类型列表）
+  if ((kind == TY_INT && strcmp(name, "int") == 0) || (kind == TY_CHAR && strcmp(name, "char") == 0)) {
+    get_type(r);
+    get_type(r);
+    get_u32(r);
+    Type *ty = copy_type(kind == TY_INT ? TYPE_INT : TYPE_CHAR);
+    ty->next = NULL;
+    return ty;
+  }
+  Type *ty = calloc(1, sizeof(Type));
+  ty->kind = kind;
+  ty->size = size;
+  ty->len = len;
+  ty->name = name[0] ? name : NULL;
+  ty->target = get_type(r);
+  ty->ret_type = get_type(r);
+  Type head = {0};
+  Type *cur = &head;
+  for (uint32_t n = get_u32(r); n > 0 && r->ok; n--) {
+    cur = cur->next = get_type(r);
+    if (!cur) {
+      r->ok = false;
+      return NULL;
+    }
+  }
+  ty->param_types = head.next;
+  return ty;
+}
+
+// 映射b对应的接口文件。如果接口文件存在并且与当前源码一致，就用它填充模块的作用域，
+// 并把依赖模块的名称存入deps（以NULL结尾），返回true；否则返回false，模块需要从源码解析。
+bool load_iface(Box *b, char ***deps) {
+  if (!cache_enabled()) {
+    return false;
+  }
+  int fd = open(iface_path(b), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < 20) {
+    close(fd);
+    return false;
+  }
+  char *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    return false;
+  }
+
+  Reader r = {map, map + st.st_size, true};
+  char *magic = take(&r, 4);
+  if (memcmp(magic, IFACE_MAGIC, 4) != 0) {
+    munmap(map, st.st_size);
+    return false;
+  }
+  // 源码变了，接口文件已经过期
+  if (b->src == NULL) {
+    b->src = read_file(b->path);
+  }
+  if (get_u64(&r) != src_hash(b->src)) {
+    munmap(map, st.st_size);
+    return false;
+  }
+  uint64_t iface_hash = get_u64(&r);
+
+  uint32_t ndeps = get_u32(&r);
+  char **names = calloc(ndeps + 1, sizeof(char*));
+  for (uint32_t i = 0; i < ndeps; i++) {
+    names[i] = get_str(&r, NULL);
+  }
+
+  uint32_t n = get_u32(&r);
+  Meta **metas = calloc(n + 1, sizeof(Meta*));
+  for (uint32_t i = 0; i < n && r.ok; i++) {
+    Meta *m = calloc(1, sizeof(Meta));
+    m->kind = get_u8(&r);
+    m->is_decl = get_u8(&r);
+    m->name = get_str(&r, NULL);
+    m->type = get_type(&r);
+    m->owner = b;
+    metas[i] = m;
+  }
+  for (uint32_t i = 0; i < n && r.ok; i++) {
+    size_t len;
+    char *def = get_str(&r, &len);
+    if (len > 0) {
+      metas[i]->src_pos = def;
+      metas[i]->src_len = len;
+    }
+  }
+
+  if (!r.ok) {
+    fprintf(stderr, "【警告】：接口文件损坏，将重新解析模块：%s\n", b->name);
+    munmap(map, st.st_size);
+    return false;
+  }
+
+  // 保持与源码解析时相同的顺序：locals和spots都是后声明的在前
+  Meta meta_head = {0};
+  Meta *cur = &meta_head;
+  Spot spot_head = {0};
+  Spot *spot = &spot_head;
+  for (uint32_t i = 0; i < n; i++) {
+    cur = cur->next = metas[i];
+    spot = spot->next = calloc(1, sizeof(Spot));
+    spot->name = metas[i]->name;
+    spot->meta = metas[i];
+  }
+  b->global->locals = meta_head.next;
+  b->scope->spots = spot_head.next;
+  b->iface_hash = iface_hash;
+  b->from_iface = true;
+  free(metas);
+
+  *deps = names;
+  return true;
+}
+
+// 接口文件里的函数定义要在模块的作用域里重新解析，函数体里可能通过`模块名.成员`引用导入的模块，
+// 因此要像use()那样把依赖的模块名绑定到作用域里。依赖的模块由调用者按deps加载，这时都已经存在了
+void bind_iface_deps(Box *b) {
+  for (BoxList *l = b->deps; l; l = l->next) {
+    Meta *meta = calloc(1, sizeof(Meta));
+    meta->kind = META_BOX;
+    meta->name = (char *)l->box->name;
+    meta->body = l->box->prog;
+    meta->box = l->box;
+    Spot *spot = calloc(1, sizeof(Spot));
+    spot->name = meta->name;
+    spot->meta = meta;
+    spot->next = b->scope->spots;
+    b->scope->spots = spot;
+  }
+}
@@ -2,6 +2,13 @@
 
 Value *gen_expr(Node *node);
 
+// 尾调用时要执行的函数。尾调用不再递归，而是给参数赋值后返回，由最外层的调用接着执行这个函数，
+// 因此尾递归只占用固定的C栈空间
+static Meta *tail_fn = NULL;
+
+// 即时编译出的函数。参数少于6个时，多传的参数不影响调用
+typedef long (*JitFn)(long, long, long, long, long, long);
+
 static size_t get_addr(Node *node) {
   if (node->kind != ND_IDENT) {
     error_tok(node->token, "不是值量，不能取地址");
@@ -68,35 +75,239 @@ static Value* val_str(Node *node) {
   return val;
 }
 
+// =============================
+// 向量
+// =============================
+
+// 向量运算在解释器里逐个元素计算，结果与codegen.c里的SIMD指令一致：
+// 元素按宽度截断（回绕），v4i32读取int数组时截断成32位，写入时符号扩展
+
+static Value *val_vec(int len) {
+  Value *val = malloc(sizeof(Value));
+  val->kind = VAL_VEC;
+  val->as.vec = calloc(1, sizeof(ValVec));
+  val->as.vec->len = len;
+  return val;
+}
+
+static long num_of(Value *val) {
+  return val->kind == VAL_CHAR ? val->as.cha : val->as.num;
+}
+
+// 截断成len个元素的向量的元素宽度，再符号扩展
+static long wrap_lane(unsigned long x, int len) {
+  switch (len) {
+    case 16:
+      return (signed char)(x & 0xff);
+    case 4:
+      return (int)(x & 0xffffffff);
+    default:
+      return (long)x;
+  }
+}
+
+static Value *vec_binary(Node *node) {
+  ValVec *a = gen_expr(node->lhs)->as.vec;
+  ValVec *b = gen_expr(node->rhs)->as.vec;
+  Value *val = val_vec(a->len);
+  for (int i = 0; i < a->len; i++) {
+    unsigned long x = a->lanes[i];
+    unsigned long y = b->lanes[i];
+    unsigned long r = node->kind == ND_PLUS ? x + y : node->kind == ND_MINUS ? x - y : x * y;
+    val->as.vec->lanes[i] = wrap_lane(r, a->len);
+  }
+  return val;
+}
 
-static void set_local_offsets(Meta *fmeta) {
+// 检查向量读写的范围，返回数组或字符串的长度
+static size_t vec_range(Node *node, Value *arr, long i, int n) {
+  size_t len;
+  if (arr->kind == VAL_ARRAY) {
+    len = arr->as.array->len;
+  } else if (arr->kind == VAL_STR) {
+    len = arr->as.str->len;
+  } else {
+    error_tok(node->token, "【ZI错误】：%s()的参数不是数组", node->name);
+    return 0;
+  }
+  if (i < 0 || (size_t)i + n > len) {
+    error_tok(node->token, "【ZI错误】：%s()越界：下标%ld开始的%d个元素超出了数组的长度%zu", node->name, i, n, len);
+  }
+  return len;
+}
+
+static Value *gen_intrin(Node *node) {
+  Node *a0 = node->args;
+  Node *a1 = a0 ? a0->next : NULL;
+  switch (node->intrin) {
+    case IN_MAKE: {
+      int len = node->type->len;
+      Value *val = val_vec(len);
+      long x = num_of(gen_expr(a0));
+      Node *arg = a0;
+      for (int i = 0; i < len; i++) {
+        if (a1) {
+          x = num_of(gen_expr(arg));
+          arg = arg->next;
+        }
+        val->as.vec->lanes[i] = wrap_lane(x, len);
+      }
+      return val;
+    }
+    case IN_LOAD: {
+      Value *arr = gen_expr(a0);
+      long i = num_of(gen_expr(a1));
+      int len = node->type->len;
+      vec_range(node, arr, i, len);
+      Value *val = val_vec(len);
+      for (int k = 0; k < len; k++) {
+        long x = arr->kind == VAL_STR ? arr->as.str->str[i + k] : num_of(&arr->as.array->elems[i + k]);
+        val->as.vec->lanes[k] = wrap_lane(x, len);
+      }
+      return val;
+    }
+    case IN_STORE: {
+      Value *arr = gen_expr(a0);
+      long i = num_of(gen_expr(a1));
+      ValVec *v = gen_expr(a1->next)->as.vec;
+      vec_range(node, arr, i, v->len);
+      for (int k = 0; k < v->len; k++) {
+        arr->as.array->elems[i + k] = v->len == 16 ? *val_char(v->lanes[k]) : *val_num(v->lanes[k]);
+      }
+      return val_num(0);
+    }
+    case IN_LANE:
+      return val_num(gen_expr(a0)->as.vec->lanes[a1->val]);
+    case IN_SET_LANE: {
+      ValVec *v = gen_expr(a0)->as.vec;
+      long x = num_of(gen_expr(a1->next));
+      Value *val = val_vec(v->len);
+      *val->as.vec = *v;
+      val->as.vec->lanes[a1->val] = wrap_lane(x, v->len);
+      return val;
+    }
+    case IN_SHUFFLE: {
+      ValVec *v = gen_expr(a0)->as.vec;
+      Value *val = val_vec(v->len);
+      int i = 0;
+      for (Node *k = a1; k; k = k->next) {
+        val->as.vec->lanes[i++] = v->lanes[k->val];
+      }
+      return val;
+    }
+    case IN_CMPEQ: {
+      ValVec *a = gen_expr(a0)->as.vec;
+      ValVec *b = gen_expr(a1)->as.vec;
+      Value *val = val_vec(a->len);
+      for (int i = 0; i < a->len; i++) {
+        val->as.vec->lanes[i] = a->lanes[i] == b->lanes[i] ? -1 : 0;
+      }
+      return val;
+    }
+    case IN_MASK: {
+      ValVec *v = gen_expr(a0)->as.vec;
+      long m = 0;
+      for (int i = 0; i < v->len; i++) {
+        if (v->lanes[i] < 0) {
+          m |= 1L << i;
+        }
+      }
+      return val_num(m);
+    }
+    case IN_HSUM: {
+      ValVec *v = gen_expr(a0)->as.vec;
+      unsigned long sum = 0;
+      for (int i = 0; i < v->len; i++) {
+        sum += v->lanes[i];
+      }
+      return val_num((long)sum);
+    }
+  }
+  return val_num(0);
+}
+
+// 栈上替换：把循环用到的值量传给机器码，从当前的状态接着执行循环，结束后再写回。
+// 值量不是整数或字符时（例如在循环外被赋成了数组）返回false，继续解释执行
+static bool osr_loop(JitLoop *loop, Value **ret) {
+  long vars[loop->nvars + 1];
+  for (int i = 0; i < loop->nvars; i++) {
+    Value *val = get_val(loop->vars[i]);
+    if (val && val->kind != VAL_INT && val->kind != VAL_CHAR) {
+      return false;
+    }
+    vars[i] = val ? num_of(val) : 0;
+  }
+  if (*ret && (*ret)->kind != VAL_INT && (*ret)->kind != VAL_CHAR) {
+    return false;
+  }
+  long (*native)(long *, long);
+  memcpy(&native, &loop->code, sizeof(native));
+  long r = native(vars, num_of(*ret));
+  for (int i = 0; i < loop->nvars; i++) {
+    Meta *m = loop->vars[i];
+    set_val(m, m->type->kind == TY_CHAR && vars[i] == (char)vars[i] ? val_char(vars[i]) : val_num(vars[i]));
+  }
+  *ret = val_num(r);
+  return true;
+}
+
+// 每次调用函数时，在values里从frame_top开始给它的值量分配一段槽位（栈帧），返回时再恢复调用者的偏移量。
+// 这样嵌套调用和递归调用的值量不会互相覆盖；编译期调用的函数（见codegen.c）也在这里得到偏移量
+static int frame_top; // values里已经用掉的槽位数
+static Meta *cur_fn; // 正在执行的函数，顶层代码是NULL
+static int cur_base; // 当前栈帧的起始位置
+
+// 返回值量的个数
+static int set_local_offsets(Meta *fmeta, int base) {
   int offset = 1;
   int num_locals = 0;
-  if (!fmeta->region) return;
+  if (!fmeta->region) return 0;
   for (Meta *m = fmeta->region->locals; m; m=m->next) {
     num_locals++;
   }
   for (Meta *m = fmeta->region->locals; m; m=m->next) {
-    m->offset = num_locals - offset++;
+    m->offset = base + num_locals - offset++;
+  }
+  return num_locals;
+}
+
+// 从base开始给被调用的函数分配栈帧
+static void enter_frame(Node *call, Meta *fmeta, int base) {
+  cur_fn = fmeta;
+  cur_base = base;
+  frame_top = base + set_local_offsets(fmeta, base);
+  if (frame_top > MAX_VALUES) {
+    error_tok(call->token, "【ZI错误】：调用层数太深，值量超过了%d个", MAX_VALUES);
   }
 }
 
 Value *gen_expr(Node *node) {
   Value *ret;
+  if (profile_enabled) {
+    node->hits++;
+  }
   switch (node->kind) {
     case ND_IF: {
       Value *cond = gen_expr(node->cond);
       // TODO: cond应该是bool型
       if (cond->as.num) {
         return gen_expr(node->then);
-      } else {
+      } else if (node->els) {
         return gen_expr(node->els);
       }
+      return val_num(0);
     }
     case ND_FOR: {
       // TODO: cond应该是bool型
+      // 一次都没有执行循环体时，值为0
+      ret = val_num(0);
       while (gen_expr(node->cond)->as.num) {
         ret = gen_expr(node->body);
+        // 循环执行得多时，剩下的迭代交给机器码执行
+        JitLoop *loop = jit_enabled ? jit_loop(node) : NULL;
+        if (loop && osr_loop(loop, &ret)) {
+          break;
+        }
       }
       return ret;
     }
@@ -104,7 +315,7 @@ Value *gen_expr(Node *node) {
       return val_num(0);
     }
     case ND_FN: {
-      set_local_offsets(node->meta);
+      // 调用时才分配值量的槽位
       return val_num(0);
     }
     case ND_CTCALL: // 在解释器里并没有编译期的概念，因此CTCALL和普通的CALL是一样的
@@ -114,6 +325,8 @@ Value *gen_expr(Node *node) {
       if (fmeta->kind == META_REF) {
         fmeta = fmeta->ref;
       }
+      // 从接口文件加载的函数，需要先解析出函数体
+      load_fn_body(fmeta);
       // builtin function: puts
       // TODO：把内置函数放到单独的模块里
       if (strcmp(fmeta->name, "puts") == 0) {
@@ -121,17 +334,77 @@ Value *gen_expr(Node *node) {
         printf("%s\n", arg->as.str->str);
         return val_num(0);
       }
-      Meta *param = fmeta->params;
-      if (param) {
-        for (Node *n=node->args; n; n=n->next) {
-          Value *arg = gen_expr(n);
-          if (param) {
-            set_val(param, arg);
-            param = param->next;
+      // 先求出所有的实参，再赋给参数：实参里可能还用到了参数原来的值，例如尾递归的f(n-1, acc+n)
+      int nargs = 0;
+      for (Node *n = node->args; n; n = n->next) {
+        nargs++;
+      }
+      Value *args[nargs + 1];
+      int i = 0;
+      for (Node *n = node->args; n; n = n->next) {
+        args[i++] = gen_expr(n);
+      }
+      // 开启即时编译时，调用得多的函数直接执行机器码
+      if (jit_enabled && nargs <= 6) {
+        void *code = jit_entry(fmeta);
+        if (code) {
+          JitFn native;
+          memcpy(&native, &code, sizeof(native));
+          long a[6] = {0};
+          for (i = 0; i < nargs; i++) {
+            a[i] = num_of(args[i]);
+          }
+          if (profile_enabled) {
+            prof_enter(fmeta);
+          }
+          long r = native(a[0], a[1], a[2], a[3], a[4], a[5]);
+          if (profile_enabled) {
+            prof_exit();
           }
+          return val_num(r);
+        }
+      }
+      // 尾调用直接替换当前的栈帧
+      if (node->is_tail) {
+        enter_frame(node, fmeta, cur_base);
+        i = 0;
+        for (Meta *param = fmeta->params; param && i < nargs; param = param->next) {
+          set_val(param, args[i++]);
         }
+        tail_fn = fmeta;
+        return val_num(0);
+      }
+      Meta *caller = cur_fn;
+      int caller_base = cur_base;
+      int caller_top = frame_top;
+      enter_frame(node, fmeta, frame_top);
+      i = 0;
+      for (Meta *param = fmeta->params; param && i < nargs; param = param->next) {
+        set_val(param, args[i++]);
+      }
+      if (profile_enabled) {
+        prof_enter(fmeta);
       }
       ret = gen_expr(fmeta->body);
+      while (tail_fn) {
+        Meta *f = tail_fn;
+        tail_fn = NULL;
+        // 尾调用在性能分析里仍然算作一次调用，替换掉调用栈上原来的函数
+        if (profile_enabled) {
+          prof_exit();
+          prof_enter(f);
+        }
+        ret = gen_expr(f->body);
+      }
+      if (profile_enabled) {
+        prof_exit();
+      }
+      cur_fn = caller;
+      cur_base = caller_base;
+      frame_top = caller_top;
+      if (caller) {
+        set_local_offsets(caller, caller_base);
+      }
       return ret;
     }
     case ND_BLOCK: {
@@ -146,15 +419,29 @@ Value *gen_expr(Node *node) {
       return val_char(node->cha);
     case ND_STR:
       return val_str(node);
+    case ND_INTRIN:
+      return gen_intrin(node);
     case ND_PLUS:
       // TODO: 所有的运算都应该加上类型判断，暂时只有int型所以还没处理
+      if (is_vec(node->type)) {
+        return vec_binary(node);
+      }
       return val_num(gen_expr(node->lhs)->as.num + gen_expr(node->rhs)->as.num);
     case ND_MINUS:
+      if (is_vec(node->type)) {
+        return vec_binary(node);
+      }
       return val_num(gen_expr(node->lhs)->as.num - gen_expr(node->rhs)->as.num);
     case ND_MUL:
+      if (is_vec(node->type)) {
+        return vec_binary(node);
+      }
       return val_num(gen_expr(node->lhs)->as.num * gen_expr(node->rhs)->as.num);
     case ND_DIV:
-      return val_num(gen_expr(node->lhs)->as.num / gen_expr(node->rhs)->as.num);
+      return val_num(num_of(gen_expr(node->lhs)) / num_of(gen_expr(node->rhs)));
+    case ND_MOD:
+      // 运算数可能是字符，例如s[i] % 7，字符只设置了as.cha
+      return val_num(num_of(gen_expr(node->lhs)) % num_of(gen_expr(node->rhs)));
     case ND_EQ:
       return gen_expr(node->lhs)->as.num == gen_expr(node->rhs)->as.num ? val_true() : val_false();
     case ND_NE:
@@ -174,6 +461,15 @@ Value *gen_expr(Node *node) {
         ret = val_num(0);
       }
       Node *ident = node->lhs;
+      if (ident->kind == ND_DEREF) {
+        // 通过指针赋值：*p = v
+        long addr = gen_expr(ident->rhs)->as.num;
+        if (addr < 0 || addr >= MAX_VALUES) {
+          error_tok(ident->token, "地址越界");
+        }
+        set_val_by_addr(addr, ret);
+        return ret;
+      }
       set_val(ident->meta, ret);
       return ret;
     }
@@ -210,12 +506,21 @@ Value *gen_expr(Node *node) {
 
 
 Value *interpret(Node *prog) {
-  set_local_offsets(prog->meta);
+  cur_fn = NULL;
+  cur_base = 0;
+  frame_top = set_local_offsets(prog->meta, 0);
   Value *r;
+  if (profile_enabled) {
+    prof_enter(NULL);
+  }
   for (Node *e = prog->body; e; e = e->next) {
     r = gen_expr(e);
     printf("= %s\n", val_to_str(r));
   }
+  if (profile_enabled) {
+    prof_exit();
+    prof_report(prog);
+  }
   print_values();
   return r;
 }
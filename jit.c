@@ -0,0 +1,774 @@
+#define _DEFAULT_SOURCE
+#include "zc.h"
+#include <stdarg.h>
+#include <stdint.h>
+#include <sys/mman.h>
+
+// 即时编译（zi --jit）：把解释器里执行得多的函数和循环直接编码成x86-64机器码，放进mmap出的可执行内存。
+//
+// 分层执行：函数先由解释器执行，调用次数达到jit_threshold时编译成基线JIT，达到jit_opt_threshold时再编译成优化JIT。
+// 基线JIT与codegen.c的思路一样以rax为累加器，二元运算的左侧先压栈；它在入口统计调用次数，
+// 因此只在机器码之间互相调用的函数也能升级。优化JIT不再计数，常量和值量直接作为指令的操作数，
+// 比较的结果直接用于条件跳转。
+// 解释器里的循环执行了osr_threshold次之后，把循环本身编译成机器码，从当前的状态接着执行剩下的迭代（栈上替换，OSR）。
+//
+// 所有的值量都放在栈帧里（[rbp-8*k]）。参数按System V的约定通过rdi、rsi、rdx、rcx、r8、r9传入，
+// 返回值放在rax里，因此解释器可以像调用普通的C函数一样调用它。
+// 调用其他函数时通过被调用函数的jit_code间接调用，函数升级之后，已有的调用方也会调用新的机器码。
+// 自身的尾递归编码成给参数赋值后跳回函数体的开头，不占用栈空间。
+//
+// 只支持整数和字符的运算：函数里出现数组、字符串、指针、向量、外部函数（例如puts）或者函数外的值量时，
+// 编译失败，这个函数继续由解释器执行。
+
+bool jit_enabled = false;
+bool trace_tiers = false;
+long jit_threshold = 2;
+long jit_opt_threshold = 1000;
+long osr_threshold = 1000;
+
+static const char *TIER_NAMES[] = {
+  [TIER_INTERP] = "解释执行",
+  [TIER_BASELINE] = "基线JIT",
+  [TIER_OPT] = "优化JIT",
+};
+
+static void trace(char *fmt, ...) {
+  if (!trace_tiers) {
+    return;
+  }
+  va_list ap;
+  va_start(ap, fmt);
+  fprintf(stderr, "【分层执行】");
+  vfprintf(stderr, fmt, ap);
+  fprintf(stderr, "\n");
+  va_end(ap);
+}
+
+#if defined(__x86_64__)
+
+// 生成中的机器码
+typedef struct {
+  uint8_t *buf;
+  size_t len;
+  size_t cap;
+} Code;
+
+static Code code;
+static Meta *cur_fn; // 正在编译的函数，编译循环时为NULL
+static bool optimize; // 是否生成优化JIT
+static Meta **slots; // 栈帧里的值量，第k个放在[rbp-8*(k+1)]
+static int nslots;
+static int depth; // 当前压栈的个数，调用函数前用来对齐栈
+static size_t body_start; // 函数体开始的位置，自身的尾递归跳到这里
+static bool failed;
+
+// 参数寄存器的编号：rdi, rsi, rdx, rcx, r8, r9
+static int arg_regs[] = {7, 6, 2, 1, 8, 9};
+
+static void *compile_fn(Meta *fn, Tier tier);
+
+// =============================
+// x86-64指令编码
+// =============================
+
+static void byte(int b) {
+  if (code.len == code.cap) {
+    code.cap = code.cap ? code.cap * 2 : 256;
+    code.buf = realloc(code.buf, code.cap);
+  }
+  code.buf[code.len++] = (uint8_t)b;
+}
+
+static void bytes(int n, ...) {
+  va_list ap;
+  va_start(ap, n);
+  for (int i = 0; i < n; i++) {
+    byte(va_arg(ap, int));
+  }
+  va_end(ap);
+}
+
+static void imm32(int32_t v) {
+  for (int i = 0; i < 4; i++) {
+    byte((uint32_t)v >> (i * 8) & 0xff);
+  }
+}
+
+static void imm64(int64_t v) {
+  for (int i = 0; i < 8; i++) {
+    byte((uint64_t)v >> (i * 8) & 0xff);
+  }
+}
+
+// mov reg, imm64
+static void mov_addr(int reg, const void *p) {
+  bytes(2, 0x48 | (reg >= 8 ? 1 : 0), 0xb8 | (reg & 7));
+  imm64((int64_t)(intptr_t)p);
+}
+
+// 回填rel32：at是rel32所在的位置，目标是to
+static void patch(size_t at, size_t to) {
+  int32_t rel = (int32_t)(to - (at + 4));
+  memcpy(code.buf + at, &rel, 4);
+}
+
+static bool is_imm32(long v) {
+  return v == (int32_t)v;
+}
+
+// mov rax, imm
+static void mov_imm(long v) {
+  if (is_imm32(v)) {
+    bytes(3, 0x48, 0xc7, 0xc0);
+    imm32(v);
+  } else {
+    bytes(2, 0x48, 0xb8);
+    imm64(v);
+  }
+}
+
+// mov [rbp+disp], reg 或 mov reg, [rbp+disp]
+static void mov_slot(int reg, int disp, bool load) {
+  bytes(3, 0x48 | (reg >= 8 ? 4 : 0), load ? 0x8b : 0x89, 0x85 | (reg & 7) << 3);
+  imm32(disp);
+}
+
+// mov [rdi+disp], rax 或 mov rax, [rdi+disp]
+static void mov_rdi(int disp, bool load) {
+  bytes(3, 0x48, load ? 0x8b : 0x89, 0x87);
+  imm32(disp);
+}
+
+static void push_rax(void) {
+  byte(0x50);
+  depth++;
+}
+
+static void pop_reg(int reg) {
+  if (reg >= 8) {
+    byte(0x41);
+  }
+  byte(0x58 | (reg & 7));
+  depth--;
+}
+
+// jmp/jcc rel32，返回rel32的位置以便回填
+static size_t jump(int cc) {
+  if (cc) {
+    bytes(2, 0x0f, cc);
+  } else {
+    byte(0xe9);
+  }
+  imm32(0);
+  return code.len - 4;
+}
+
+// test rax, rax
+static void test_rax(void) {
+  bytes(3, 0x48, 0x85, 0xc0);
+}
+
+// setcc al; movzx rax, al
+static void set_rax(int cc) {
+  bytes(3, 0x0f, cc, 0xc0);
+  bytes(4, 0x48, 0x0f, 0xb6, 0xc0);
+}
+
+// =============================
+// 值量
+// =============================
+
+static int slot_of(Meta *meta) {
+  for (int i = 0; i < nslots; i++) {
+    if (slots[i] == meta) {
+      return -8 * (i + 1);
+    }
+  }
+  return 0;
+}
+
+static void add_slot(Meta *meta) {
+  if (slot_of(meta) == 0) {
+    slots = realloc(slots, sizeof(Meta *) * (nslots + 1));
+    slots[nslots++] = meta;
+  }
+}
+
+// 函数自己的值量：参数和存储域里的局部值量。编译循环时，循环用到的值量都从解释器读入
+static bool is_own(Meta *meta) {
+  if (cur_fn == NULL) {
+    return true;
+  }
+  for (Meta *p = cur_fn->params; p; p = p->next) {
+    if (p == meta) {
+      return true;
+    }
+  }
+  for (Meta *m = cur_fn->region ? cur_fn->region->locals : NULL; m; m = m->next) {
+    if (m == meta) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// 能放进栈槽的值量：整数或字符值量
+static bool is_var(Meta *meta) {
+  return meta->kind == META_LET && is_num(meta->type) && slot_of(meta) != 0;
+}
+
+// 预先为值量分配栈槽，以便在序言里清零或者读入
+static void scan(Node *node) {
+  if (node == NULL) {
+    return;
+  }
+  if (node->kind == ND_IDENT && node->meta->kind == META_LET && is_own(node->meta)) {
+    add_slot(node->meta);
+  }
+  scan(node->lhs);
+  scan(node->rhs);
+  scan(node->cond);
+  scan(node->then);
+  scan(node->els);
+  for (Node *n = node->body; n; n = n->next) {
+    scan(n);
+  }
+  for (Node *n = node->args; n; n = n->next) {
+    scan(n);
+  }
+}
+
+// =============================
+// 表达式
+// =============================
+
+static void fail(void) {
+  failed = true;
+}
+
+static void gen(Node *node);
+
+// 调用函数：实参依次压栈，再弹出到参数寄存器（自身的尾递归则弹出到参数的栈槽）
+static void gen_call(Node *node) {
+  Meta *fn = node->meta->kind == META_REF ? node->meta->ref : node->meta;
+  // 被调用的函数还在解释执行时，先把它编译成基线JIT
+  if (fn != cur_fn && fn->tier == TIER_INTERP) {
+    load_fn_body(fn);
+    if (compile_fn(fn, TIER_BASELINE)) {
+      trace("%s：%s -> %s（被调用）", fn->name, TIER_NAMES[TIER_INTERP], TIER_NAMES[TIER_BASELINE]);
+    }
+  }
+  if (fn != cur_fn && fn->jit_code == NULL) {
+    fail();
+    return;
+  }
+  int nargs = 0;
+  for (Node *a = node->args; a; a = a->next) {
+    gen(a);
+    push_rax();
+    nargs++;
+  }
+  if (nargs > 6) {
+    fail();
+    return;
+  }
+  if (node->is_tail && fn == cur_fn) {
+    int i = nargs;
+    for (Meta *p = fn->params; p; p = p->next) {
+      i--;
+    }
+    // 参数个数不符时不做尾递归
+    if (i == 0) {
+      Meta *params[6];
+      for (Meta *p = fn->params; p; p = p->next) {
+        params[i++] = p;
+      }
+      for (i = nargs - 1; i >= 0; i--) {
+        pop_reg(0);
+        mov_slot(0, slot_of(params[i]), false);
+      }
+      patch(jump(0), body_start);
+      return;
+    }
+  }
+  for (int i = nargs - 1; i >= 0; i--) {
+    pop_reg(arg_regs[i]);
+  }
+  // 调用前rsp要对齐到16字节
+  bool pad = depth % 2;
+  if (pad) {
+    bytes(4, 0x48, 0x83, 0xec, 0x08);
+  }
+  // mov rax, &fn->jit_code; call [rax]
+  mov_addr(0, &fn->jit_code);
+  bytes(2, 0xff, 0x10);
+  if (pad) {
+    bytes(4, 0x48, 0x83, 0xc4, 0x08);
+  }
+}
+
+static int setcc(NodeKind kind) {
+  switch (kind) {
+  case ND_EQ:
+    return 0x94;
+  case ND_NE:
+    return 0x95;
+  case ND_LT:
+    return 0x9c;
+  default:
+    return 0x9e;
+  }
+}
+
+static bool is_cmp(Node *node) {
+  return node->kind == ND_EQ || node->kind == ND_NE || node->kind == ND_LT || node->kind == ND_LE;
+}
+
+// 计算二元运算的两侧：左侧放在rax，右侧放在rdi。
+// 优化JIT里右侧是常量时不计算，返回true，由指令直接使用常量；右侧是值量时直接从栈槽读取，不用压栈
+static bool gen_operands(Node *node, long *imm) {
+  Node *rhs = node->rhs;
+  if (optimize && (rhs->kind == ND_NUM || rhs->kind == ND_CHAR)) {
+    *imm = rhs->kind == ND_NUM ? rhs->val : rhs->cha;
+    if (is_imm32(*imm)) {
+      gen(node->lhs);
+      return true;
+    }
+  }
+  if (optimize && rhs->kind == ND_IDENT && is_var(rhs->meta)) {
+    gen(node->lhs);
+    mov_slot(7, slot_of(rhs->meta), true);
+    return false;
+  }
+  gen(node->lhs);
+  push_rax();
+  gen(rhs);
+  bytes(3, 0x48, 0x89, 0xc7); // mov rdi, rax
+  pop_reg(0);
+  return false;
+}
+
+// cmp rax, rdi 或 cmp rax, imm
+static void gen_cmp(Node *node) {
+  long imm;
+  if (gen_operands(node, &imm)) {
+    bytes(2, 0x48, 0x3d);
+    imm32(imm);
+  } else {
+    bytes(3, 0x48, 0x39, 0xf8);
+  }
+}
+
+static void gen_binary(Node *node) {
+  if (is_cmp(node)) {
+    gen_cmp(node);
+    set_rax(setcc(node->kind));
+    return;
+  }
+  long imm;
+  bool is_imm = gen_operands(node, &imm);
+  switch (node->kind) {
+  case ND_PLUS:
+    if (is_imm) {
+      bytes(2, 0x48, 0x05);
+      imm32(imm);
+    } else {
+      bytes(3, 0x48, 0x01, 0xf8);
+    }
+    return;
+  case ND_MINUS:
+    if (is_imm) {
+      bytes(2, 0x48, 0x2d);
+      imm32(imm);
+    } else {
+      bytes(3, 0x48, 0x29, 0xf8);
+    }
+    return;
+  case ND_MUL:
+    if (is_imm) {
+      bytes(3, 0x48, 0x69, 0xc0);
+      imm32(imm);
+    } else {
+      bytes(4, 0x48, 0x0f, 0xaf, 0xc7);
+    }
+    return;
+  default:
+    if (is_imm) {
+      bytes(3, 0x48, 0xc7, 0xc7); // mov rdi, imm
+      imm32(imm);
+    }
+    bytes(2, 0x48, 0x99); // cqo
+    bytes(3, 0x48, 0xf7, 0xff); // idiv rdi
+    if (node->kind == ND_MOD) {
+      bytes(3, 0x48, 0x89, 0xd0); // mov rax, rdx
+    }
+    return;
+  }
+}
+
+// 计算条件并设置标志位，返回条件不成立时跳转用的jcc。
+// 优化JIT里比较的结果直接用于跳转，不再转换成0和1
+static int gen_test(Node *cond) {
+  if (optimize && is_cmp(cond)) {
+    gen_cmp(cond);
+    switch (cond->kind) {
+    case ND_EQ:
+      return 0x85; // jne
+    case ND_NE:
+      return 0x84; // je
+    case ND_LT:
+      return 0x8d; // jge
+    default:
+      return 0x8f; // jg
+    }
+  }
+  gen(cond);
+  test_rax();
+  return 0x84; // je
+}
+
+// 循环的值与解释器一样，是最后一次执行循环体的值。进入循环时rax是循环的初始值
+static void gen_loop(Node *node) {
+  size_t cond = code.len;
+  push_rax();
+  int cc = gen_test(node->cond);
+  pop_reg(0); // pop不影响标志位
+  size_t to_end = jump(cc);
+  gen(node->body);
+  patch(jump(0), cond);
+  patch(to_end, code.len);
+}
+
+static void gen(Node *node) {
+  if (failed) {
+    return;
+  }
+  if (node->type && !is_num(node->type)) {
+    fail();
+    return;
+  }
+  switch (node->kind) {
+  case ND_NUM:
+    mov_imm(node->val);
+    return;
+  case ND_CHAR:
+    mov_imm(node->cha);
+    return;
+  case ND_IDENT:
+    if (!is_var(node->meta)) {
+      fail();
+      return;
+    }
+    mov_slot(0, slot_of(node->meta), true);
+    return;
+  case ND_ASN:
+    if (node->lhs->kind != ND_IDENT || !is_var(node->lhs->meta) || node->rhs == NULL) {
+      fail();
+      return;
+    }
+    gen(node->rhs);
+    mov_slot(0, slot_of(node->lhs->meta), false);
+    return;
+  case ND_PLUS:
+  case ND_MINUS:
+  case ND_MUL:
+  case ND_DIV:
+  case ND_MOD:
+  case ND_EQ:
+  case ND_NE:
+  case ND_LT:
+  case ND_LE:
+    gen_binary(node);
+    return;
+  case ND_NEG:
+    gen(node->rhs);
+    bytes(3, 0x48, 0xf7, 0xd8);
+    return;
+  case ND_NOT:
+    gen(node->lhs);
+    test_rax();
+    set_rax(0x94);
+    return;
+  case ND_BLOCK:
+    if (node->body == NULL) {
+      mov_imm(0);
+    }
+    for (Node *n = node->body; n; n = n->next) {
+      gen(n);
+    }
+    return;
+  case ND_IF: {
+    size_t to_else = jump(gen_test(node->cond));
+    gen(node->then);
+    size_t to_end = jump(0);
+    patch(to_else, code.len);
+    if (node->els) {
+      gen(node->els);
+    } else {
+      mov_imm(0);
+    }
+    patch(to_end, code.len);
+    return;
+  }
+  case ND_FOR:
+    // 一次都没有执行循环体时，循环的值是0
+    mov_imm(0);
+    gen_loop(node);
+    return;
+  case ND_CALL:
+  case ND_CTCALL: {
+    Meta *fn = node->meta->kind == META_REF ? node->meta->ref : node->meta;
+    if (fn->kind != META_FN || fn->is_decl) {
+      fail();
+      return;
+    }
+    gen_call(node);
+    return;
+  }
+  default:
+    fail();
+    return;
+  }
+}
+
+// =============================
+// 函数与循环
+// =============================
+
+// 开始编译一段机器码。被调用的函数会在编译中途编译，要保存当前的状态
+typedef struct {
+  Code code;
+  Meta *fn;
+  bool optimize;
+  Meta **slots;
+  int nslots;
+  int depth;
+  size_t body_start;
+  bool failed;
+} CompileState;
+
+static CompileState begin(Meta *fn, bool opt) {
+  CompileState saved = {code, cur_fn, optimize, slots, nslots, depth, body_start, failed};
+  code = (Code){0};
+  cur_fn = fn;
+  optimize = opt;
+  slots = NULL;
+  nslots = 0;
+  depth = 0;
+  failed = false;
+  return saved;
+}
+
+// 把机器码复制到可执行内存，恢复之前的状态
+static void *end(CompileState saved) {
+  void *p = NULL;
+  if (!failed) {
+    p = mmap(NULL, code.len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+      p = NULL;
+    } else {
+      memcpy(p, code.buf, code.len);
+      if (mprotect(p, code.len, PROT_READ | PROT_EXEC) != 0) {
+        munmap(p, code.len);
+        p = NULL;
+      }
+    }
+  }
+  free(code.buf);
+  free(slots);
+  code = saved.code;
+  cur_fn = saved.fn;
+  optimize = saved.optimize;
+  slots = saved.slots;
+  nslots = saved.nslots;
+  depth = saved.depth;
+  body_start = saved.body_start;
+  failed = saved.failed;
+  return p;
+}
+
+// push rbp; mov rbp, rsp; sub rsp, N
+static void prologue(int nwords) {
+  bytes(4, 0x55, 0x48, 0x89, 0xe5);
+  bytes(3, 0x48, 0x81, 0xec);
+  imm32((nwords * 8 + 15) / 16 * 16);
+}
+
+// 基线JIT里调用次数达到jit_opt_threshold时，由机器码调用这个函数升级成优化JIT
+static void tier_up(Meta *fn) {
+  if (compile_fn(fn, TIER_OPT)) {
+    trace("%s：%s -> %s（调用%ld次）", fn->name, TIER_NAMES[TIER_BASELINE], TIER_NAMES[TIER_OPT], fn->calls);
+  }
+}
+
+// 基线JIT的入口统计调用次数：
+//   mov rax, &fn->calls; inc qword [rax]; cmp qword [rax], jit_opt_threshold; jne 1f
+//   保存参数寄存器; mov rdi, fn; call tier_up; 恢复参数寄存器
+// 1:
+static void gen_counter(Meta *fn) {
+  if (jit_opt_threshold > INT32_MAX) {
+    return;
+  }
+  mov_addr(0, &fn->calls);
+  bytes(3, 0x48, 0xff, 0x00);
+  bytes(3, 0x48, 0x81, 0x38);
+  imm32(jit_opt_threshold);
+  size_t skip = jump(0x85);
+  // 6个参数寄存器一共48字节，rsp仍然对齐到16字节
+  for (int i = 0; i < 6; i++) {
+    if (arg_regs[i] >= 8) {
+      byte(0x41);
+    }
+    byte(0x50 | (arg_regs[i] & 7));
+  }
+  mov_addr(7, fn);
+  void (*helper)(Meta *) = tier_up;
+  void *target;
+  memcpy(&target, &helper, sizeof(target));
+  mov_addr(0, target);
+  bytes(2, 0xff, 0xd0);
+  for (int i = 5; i >= 0; i--) {
+    if (arg_regs[i] >= 8) {
+      byte(0x41);
+    }
+    byte(0x58 | (arg_regs[i] & 7));
+  }
+  patch(skip, code.len);
+}
+
+// 把函数编译成指定层级的机器码，成功后更新fn->jit_code
+static void *compile_fn(Meta *fn, Tier tier) {
+  // 正在编译（相互递归）或者已经失败过
+  if (fn->jit_busy || fn->jit_failed) {
+    return NULL;
+  }
+  fn->jit_busy = true;
+  CompileState saved = begin(fn, tier == TIER_OPT);
+
+  int nparams = 0;
+  for (Meta *p = fn->params; p; p = p->next) {
+    if (!is_num(p->type)) {
+      fail();
+    }
+    add_slot(p);
+    nparams++;
+  }
+  if (nparams > 6 || fn->body == NULL) {
+    fail();
+  }
+  scan(fn->body);
+
+  prologue(nslots);
+  if (tier == TIER_BASELINE) {
+    gen_counter(fn);
+  }
+  int i = 0;
+  for (Meta *p = fn->params; p && i < 6; p = p->next, i++) {
+    mov_slot(arg_regs[i], slot_of(p), false);
+  }
+  // 局部值量清零：mov qword [rbp+disp], 0。尾递归也从这里开始，相当于一次新的调用
+  body_start = code.len;
+  for (int k = nparams; k < nslots; k++) {
+    bytes(3, 0x48, 0xc7, 0x85);
+    imm32(-8 * (k + 1));
+    imm32(0);
+  }
+  if (!failed) {
+    gen(fn->body);
+  }
+  bytes(2, 0xc9, 0xc3); // leave; ret
+
+  void *p = end(saved);
+  fn->jit_busy = false;
+  if (p) {
+    fn->jit_code = p;
+    fn->tier = tier;
+  } else if (tier == TIER_BASELINE) {
+    fn->jit_failed = true;
+    trace("%s：不能编译，继续%s", fn->name, TIER_NAMES[TIER_INTERP]);
+  }
+  return p;
+}
+
+void *jit_entry(Meta *fn) {
+  fn->calls++;
+  if (fn->tier == TIER_INTERP && fn->calls >= jit_threshold && compile_fn(fn, TIER_BASELINE)) {
+    trace("%s：%s -> %s（调用%ld次）", fn->name, TIER_NAMES[TIER_INTERP], TIER_NAMES[TIER_BASELINE], fn->calls);
+  }
+  if (fn->tier == TIER_BASELINE && fn->calls >= jit_opt_threshold) {
+    tier_up(fn);
+  }
+  return fn->jit_code;
+}
+
+// 编译循环：long f(long *vars, long ret)。
+// 入口从vars读入循环用到的值量，rax设为循环当前的值ret；循环结束后把值量写回vars，返回循环的值
+static JitLoop *compile_loop(Node *loop) {
+  CompileState saved = begin(NULL, true);
+  scan(loop);
+  Meta **vars = malloc(sizeof(Meta *) * (nslots + 1));
+  memcpy(vars, slots, sizeof(Meta *) * nslots);
+  int nvars = nslots;
+  int vars_slot = -8 * (nvars + 1); // 保存vars，调用函数会改变rdi
+
+  prologue(nvars + 1);
+  mov_slot(7, vars_slot, false);
+  for (int k = 0; k < nvars; k++) {
+    mov_rdi(8 * k, true);
+    mov_slot(0, -8 * (k + 1), false);
+  }
+  bytes(3, 0x48, 0x89, 0xf0); // mov rax, rsi
+  gen_loop(loop);
+  push_rax();
+  mov_slot(7, vars_slot, true);
+  for (int k = 0; k < nvars; k++) {
+    mov_slot(0, -8 * (k + 1), true);
+    mov_rdi(8 * k, false);
+  }
+  pop_reg(0);
+  bytes(2, 0xc9, 0xc3); // leave; ret
+
+  void *p = end(saved);
+  if (p == NULL) {
+    free(vars);
+    return NULL;
+  }
+  JitLoop *l = calloc(1, sizeof(JitLoop));
+  l->code = p;
+  l->vars = vars;
+  l->nvars = nvars;
+  return l;
+}
+
+JitLoop *jit_loop(Node *loop) {
+  if (loop->osr || loop->osr_failed) {
+    return loop->osr;
+  }
+  if (++loop->count < osr_threshold) {
+    return NULL;
+  }
+  loop->osr = compile_loop(loop);
+  if (loop->osr) {
+    trace("第%d行的循环：%s -> %s（栈上替换，执行%ld次）", tok_line(loop->token), TIER_NAMES[TIER_INTERP],
+          TIER_NAMES[TIER_OPT], loop->count);
+  } else {
+    loop->osr_failed = true;
+    trace("第%d行的循环：不能编译，继续%s", tok_line(loop->token), TIER_NAMES[TIER_INTERP]);
+  }
+  return loop->osr;
+}
+
+#else
+
+// 其他架构还不支持即时编译，所有的函数都由解释器执行
+void *jit_entry(Meta *fn) {
+  (void)fn;
+  return NULL;
+}
+
+JitLoop *jit_loop(Node *loop) {
+  (void)loop;
+  return NULL;
+}
+
+#endif
@@ -6,6 +6,15 @@
 
 #include "zc.h"
 
+jmp_buf *error_jmp = NULL;
+
+_Noreturn void quit(int code) {
+  if (error_jmp) {
+    longjmp(*error_jmp, code ? code : 1);
+  }
+  exit(code);
+}
+
 static void verror(Lexer* lexer, const char* loc, char *fmt, va_list ap) {
   int n = loc - lexer->line;
   fprintf(stderr, "%s \n", lexer->line);
@@ -13,7 +22,7 @@ static void verror(Lexer* lexer, const char* loc, char *fmt, va_list ap) {
   fprintf(stderr, "^ ");
   vfprintf(stderr, fmt, ap);
   fprintf(stderr, "\n");
-  exit(1);
+  quit(1);
 }
 
 static void error(Lexer* lexer, char *fmt, ...) {
@@ -28,6 +37,14 @@ void error_tok(Token *tok, char *fmt, ...) {
   verror(tok->lexer, tok->pos, fmt, ap);
 }
 
+int tok_line(Token *tok) {
+  int line = 1;
+  for (const char *p = tok->lexer->line; p < tok->pos; p++) {
+    line += *p == '\n';
+  }
+  return line;
+}
+
 static const char* const TOKEN_NAMES[] = {
   [TK_IDENT] = "TK_IDENT",
   [TK_NUM] = "TK_NUM",
@@ -37,6 +54,7 @@ static const char* const TOKEN_NAMES[] = {
   [TK_MINUS] = "TK_MINUS",
   [TK_STAR] = "TK_STAR",
   [TK_SLASH] = "TK_SLASH",
+  [TK_PERCENT] = "TK_PERCENT",
   [TK_ASN] = "TK_ASN",
   [TK_GT] = "TK_GT",
   [TK_LT] = "TK_LT",
@@ -78,7 +96,8 @@ static Lexer* new_lexer(const char *src) {
   return lexer;
 }
 
-static Lexer* new_file_lexer(const char *file) {
+// 读取整个文件的内容，末尾保证有一个'\n'。文件名为"-"时从标准输入读取
+char *read_file(const char *file) {
   FILE *fp;
 
   // 如果文件名是"-"，则从标准输入读取
@@ -88,6 +107,7 @@ static Lexer* new_file_lexer(const char *file) {
     fp = fopen(file, "r");
     if (!fp) {
       fprintf(stderr, "【Lexer错误】：无法打开文件：%s\n", file);
+      quit(1);
     }
   }
 
@@ -114,25 +134,27 @@ static Lexer* new_file_lexer(const char *file) {
   }
   fputc('\0', out);
   fclose(out);
+  return buf;
+}
 
-  Lexer *lexer = new_lexer(buf);
-  lexer->file = file;
+static Lexer* new_file_lexer(const char *file) {
+  return init_src_lexer(file, read_file(file));
+}
 
-  // 读取整个文件
-  // fseek(fp, 0, SEEK_END);
-  // long size = ftell(fp);
-  // fseek(fp, 0, SEEK_SET);
-  // char *src = malloc(size + 1);
-  // fread(src, 1, size, fp);
-  // src[size] = '\0';
-  // fclose(fp);
-  // new_lexer(src);
-  // lexer.file = file;
+// 用已经读入内存的源码新建词法分析器，file只用来记录文件名
+Lexer *init_src_lexer(const char *file, const char *src) {
+  Lexer *lexer = new_lexer(src);
+  lexer->file = file;
   return lexer;
 }
 
+// 判断src是源码文件名（"-"代表标准输入），还是源码本身
+bool is_src_file(const char *src) {
+  return strcmp(src, "-") == 0 ||ends_with(src, ".z") || ends_with(src, ".zs");
+}
+
 Lexer *init_lexer(const char *src) {
-  if (strcmp(src, "-") == 0 ||ends_with(src, ".z") || ends_with(src, ".zs")) {
+  if (is_src_file(src)) {
     return new_file_lexer(src);
   } else {
     return new_lexer(src);
@@ -299,6 +321,8 @@ Token next_token(Lexer *lexer) {
       return make_token(lexer, TK_STAR);
     case '/':
       return make_token(lexer, TK_SLASH);
+    case '%':
+      return make_token(lexer, TK_PERCENT);
     case '(':
       return make_token(lexer, TK_LPAREN);
     case ')':
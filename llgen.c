@@ -0,0 +1,907 @@
+#define _POSIX_C_SOURCE 200809L
+#include "zc.h"
+#include <ctype.h>
+#include <stdarg.h>
+
+// LLVM IR生成（--emit=llvm）：把标注好类型的语法树翻译成文本形式的LLVM IR（.ll），再交给clang编译，
+// 由LLVM完成寄存器分配、指令选择、循环向量化等优化，开启-flto时还能跨模块内联。
+// 流程与生成汇编（codegen_box）一样：先内联、折叠常量、做可达性分析，每个模块生成一个.ll文件，模块没有变化时直接复用编译缓存。
+//
+// 值量都是入口块里的alloca，读写都经过内存，交给mem2reg提升成SSA值；函数里有取地址操作时，值量按声明的顺序放进一个结构体，
+// 与汇编的栈帧布局一致（见cgen.c）。数组下标和指针运算用带类型的getelementptr。
+// 整数和字符计算时都是i64，读写字符时再截断或符号扩展；运算不带nsw，溢出时按补码回绕，与汇编的行为一致。
+// 代码块、if和for的值都是i64，if的值用phi合并两个分支的结果。
+// 指针使用LLVM 15起默认的不透明指针（ptr）。函数的命名与cgen.c一致：主模块的函数是internal的z_xxx，
+// 其他模块是模块名_函数名，只声明的函数（例如puts）按可变参数的外部函数声明。
+
+static FILE *fp; // 整个模块
+static FILE *afp; // 当前函数入口块里的alloca
+static FILE *bfp; // 当前函数的函数体
+static char *abuf;
+static char *bbuf;
+static size_t alen;
+static size_t blen;
+static Box *main_box;
+
+static int ntmp;
+static int nlabel;
+static int nstr;
+static char *cur_block; // 当前基本块的标签，生成phi时要用到
+
+// 模块里用到的字符串常量和外部函数的声明，放在模块的末尾
+static char *globals;
+static Spot *decls;
+
+// 当前函数的局部值量，name是指向它的指针（alloca或者frame里的字段）
+typedef struct LLocal LLocal;
+struct LLocal {
+  LLocal *next;
+  Meta *meta;
+  char *name;
+};
+
+static LLocal *locals;
+static bool use_frame;
+
+static char *gen_expr(Node *node);
+
+// 函数体里的一条指令
+static void ins(char *fmt, ...) {
+  va_list ap;
+  fprintf(bfp, "  ");
+  va_start(ap, fmt);
+  vfprintf(bfp, fmt, ap);
+  va_end(ap);
+  fprintf(bfp, "\n");
+}
+
+// 新的SSA值。Z的名称不能以'.'开头，因此不会与值量重名
+static char *new_val(void) {
+  return format("%%.t%d", ++ntmp);
+}
+
+static char *new_label(void) {
+  return format(".L%d", ++nlabel);
+}
+
+static void start_block(char *label) {
+  fprintf(bfp, "%s:\n", label);
+  cur_block = label;
+}
+
+// =============================
+// 类型
+// =============================
+
+static char *lane_type(Type *ty) {
+  return ty->len == 2 ? "i64" : ty->len == 4 ? "i32" : "i8";
+}
+
+static char *vec_type(Type *ty) {
+  return format("<%zu x %s>", ty->len, lane_type(ty));
+}
+
+// 值在内存里的类型
+static char *mem_type(Type *ty) {
+  if (ty == NULL) {
+    fprintf(stderr, "【LLVM IR生成错误】：值量的类型未知\n");
+    quit(1);
+  }
+  switch (ty->kind) {
+  case TY_INT:
+  case TY_FN:
+    return "i64";
+  case TY_CHAR:
+    return "i8";
+  case TY_PTR:
+  case TY_STR:
+    return "ptr";
+  case TY_ARRAY:
+    return format("[%zu x %s]", ty->len, mem_type(ty->target));
+  case TY_VEC:
+    return vec_type(ty);
+  case TY_TYPE:
+    return format("%%struct.%s", ty->name);
+  }
+  return NULL;
+}
+
+// 计算时的类型：整数和字符都是i64，数组是它的地址
+static char *val_type(Type *ty) {
+  if (ty == NULL || is_num(ty) || ty->kind == TY_FN) {
+    return "i64";
+  }
+  if (ty->kind == TY_ARRAY || ty->kind == TY_STR || ty->kind == TY_PTR) {
+    return "ptr";
+  }
+  return mem_type(ty);
+}
+
+// 在整数和指针之间转换
+static char *convert(char *v, Type *from, Type *to) {
+  char *f = val_type(from);
+  char *t = val_type(to);
+  if (strcmp(f, t) == 0) {
+    return v;
+  }
+  char *r = new_val();
+  if (strcmp(f, "i64") == 0 && strcmp(t, "ptr") == 0) {
+    ins("%s = inttoptr i64 %s to ptr", r, v);
+  } else if (strcmp(f, "ptr") == 0 && strcmp(t, "i64") == 0) {
+    ins("%s = ptrtoint ptr %s to i64", r, v);
+  } else {
+    fprintf(stderr, "【LLVM IR生成错误】：无法把%s转换成%s\n", type_name(from), type_name(to));
+    quit(1);
+  }
+  return r;
+}
+
+// 代码块、if和for的值都是i64。向量之类不能转换成整数的值，就当作0
+static char *to_i64(char *v, Type *ty) {
+  if (ty && (is_vec(ty) || ty->kind == TY_TYPE)) {
+    return "0";
+  }
+  return convert(v, ty, TYPE_INT);
+}
+
+static char *load(char *addr, Type *ty) {
+  // 数组的值就是它的地址
+  if (ty->kind == TY_ARRAY) {
+    return addr;
+  }
+  char *r = new_val();
+  ins("%s = load %s, ptr %s", r, mem_type(ty), addr);
+  if (ty->kind == TY_CHAR) {
+    char *w = new_val();
+    ins("%s = sext i8 %s to i64", w, r);
+    return w;
+  }
+  return r;
+}
+
+static void store(char *addr, char *v, Type *ty) {
+  if (ty->kind == TY_CHAR) {
+    char *b = new_val();
+    ins("%s = trunc i64 %s to i8", b, v);
+    v = b;
+  }
+  ins("store %s %s, ptr %s", mem_type(ty), v, addr);
+}
+
+// =============================
+// 名称与局部值量
+// =============================
+
+static char *fn_name(Meta *m) {
+  if (m->kind == META_REF) {
+    m = m->ref;
+  }
+  if (m->is_decl) {
+    return m->name;
+  }
+  if (m->owner == NULL || m->owner == main_box) {
+    return format("z_%s", m->name);
+  }
+  return format("%s_%s", m->owner->name, m->name);
+}
+
+// LLVM的名称里可以有'.'、'_'和'$'，其他字符换成'_'
+static char *ll_ident(const char *name) {
+  char *s = strdup(name);
+  for (char *c = s; *c; c++) {
+    if (!isalnum((unsigned char)*c) && *c != '_' && *c != '.' && *c != '$') {
+      *c = '_';
+    }
+  }
+  return s;
+}
+
+static LLocal *find_llocal(Meta *meta) {
+  for (LLocal *l = locals; l; l = l->next) {
+    if (l->meta == meta) {
+      return l;
+    }
+  }
+  return NULL;
+}
+
+static bool name_taken(const char *name) {
+  for (LLocal *l = locals; l; l = l->next) {
+    if (strcmp(l->name, name) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// 登记一个局部值量，重名的值量加上序号区分
+static void add_local(Meta *meta) {
+  if (meta == NULL || meta->kind != META_LET || find_llocal(meta)) {
+    return;
+  }
+  char *name = format("%%%s", ll_ident(meta->name));
+  if (name_taken(name)) {
+    int i = 1;
+    while (name_taken(format("%s.%d", name, i))) {
+      i++;
+    }
+    name = format("%s.%d", name, i);
+  }
+  LLocal *l = calloc(1, sizeof(LLocal));
+  l->meta = meta;
+  l->name = name;
+  LLocal **p = &locals;
+  while (*p) {
+    p = &(*p)->next;
+  }
+  *p = l;
+}
+
+static char *local_addr(Node *node) {
+  if (node->meta->kind != META_LET) {
+    error_tok(node->token, "【LLVM IR生成错误】：不支持的值量：%s\n", node->meta->name);
+  }
+  LLocal *l = find_llocal(node->meta);
+  if (l == NULL) {
+    error_tok(node->token, "【LLVM IR生成错误】：找不到值量：%s\n", node->meta->name);
+  }
+  return l->name;
+}
+
+// 按源码顺序找出函数体里的值量，以及有没有取地址操作
+static void collect(Node *node) {
+  if (node == NULL || node->kind == ND_FN || node->kind == ND_CTCALL) {
+    return;
+  }
+  if (node->kind == ND_IDENT) {
+    add_local(node->meta);
+  }
+  if (node->kind == ND_ADDR) {
+    use_frame = true;
+  }
+  collect(node->lhs);
+  collect(node->rhs);
+  collect(node->cond);
+  collect(node->then);
+  collect(node->els);
+  for (Node *n = node->body; n; n = n->next) {
+    collect(n);
+  }
+  for (Node *n = node->args; n; n = n->next) {
+    collect(n);
+  }
+  for (Node *n = node->elems; n; n = n->next) {
+    collect(n);
+  }
+}
+
+static void collect_list(Node *list) {
+  for (Node *n = list; n; n = n->next) {
+    collect(n);
+  }
+}
+
+// 在入口块里为值量分配空间并清零
+static void alloc_locals(void) {
+  if (use_frame) {
+    char *fields = "";
+    for (LLocal *l = locals; l; l = l->next) {
+      fields = format("%s%s%s", fields, l == locals ? "" : ", ", mem_type(l->meta->type));
+    }
+    char *ty = format("{ %s }", fields);
+    fprintf(afp, "  %%.frame = alloca %s\n", ty);
+    fprintf(afp, "  store %s zeroinitializer, ptr %%.frame\n", ty);
+    int i = 0;
+    for (LLocal *l = locals; l; l = l->next, i++) {
+      fprintf(afp, "  %s = getelementptr inbounds %s, ptr %%.frame, i32 0, i32 %d\n", l->name, ty, i);
+    }
+    return;
+  }
+  for (LLocal *l = locals; l; l = l->next) {
+    fprintf(afp, "  %s = alloca %s\n", l->name, mem_type(l->meta->type));
+    fprintf(afp, "  store %s zeroinitializer, ptr %s\n", mem_type(l->meta->type), l->name);
+  }
+}
+
+// =============================
+// 表达式
+// =============================
+
+// 字符串常量。汇编里的字符串没有结尾的'\0'，这里补上，方便传给C的函数
+static char *gen_str(Node *node) {
+  char *name = format("@.str.%d", ++nstr);
+  char *bytes = "";
+  for (size_t i = 0; i < node->len; i++) {
+    unsigned char c = node->str[i];
+    if (isprint(c) && c != '"' && c != '\\') {
+      bytes = format("%s%c", bytes, c);
+    } else {
+      bytes = format("%s\\%02X", bytes, c);
+    }
+  }
+  globals = format("%s%s = private unnamed_addr constant [%zu x i8] c\"%s\\00\"\n", globals, name,
+                   node->len + 1, bytes);
+  return name;
+}
+
+// 数组元素arr[idx]的地址
+static char *gen_elem_addr(Node *node) {
+  char *base = gen_expr(node->lhs);
+  char *idx = convert(gen_expr(node->rhs), node->rhs->type, TYPE_INT);
+  char *r = new_val();
+  ins("%s = getelementptr inbounds %s, ptr %s, i64 %s", r, mem_type(node->lhs->type->target), base, idx);
+  return r;
+}
+
+static char *gen_addr(Node *node) {
+  switch (node->kind) {
+  case ND_IDENT:
+    return local_addr(node);
+  case ND_DEREF:
+    return convert(gen_expr(node->rhs), node->rhs->type, node->rhs->type->kind == TY_INT ? pointer_to(TYPE_INT) : node->rhs->type);
+  case ND_INDEX:
+    return gen_elem_addr(node);
+  case ND_STR:
+    return gen_str(node);
+  default:
+    error_tok(node->token, "【LLVM IR生成错误】：不支持的地址类型：%d\n", node->kind);
+  }
+  return NULL;
+}
+
+// 数组字面量逐个元素存入addr开始的数组
+static void gen_array_store(char *addr, Type *ty, Node *array) {
+  int i = 0;
+  for (Node *n = array->elems; n; n = n->next, i++) {
+    char *elem = new_val();
+    ins("%s = getelementptr inbounds %s, ptr %s, i64 0, i64 %d", elem, mem_type(ty), addr, i);
+    if (n->kind == ND_ARRAY) {
+      gen_array_store(elem, ty->target, n);
+    } else {
+      store(elem, convert(gen_expr(n), n->type, ty->target), ty->target);
+    }
+  }
+}
+
+// 条件的值，类型是i1
+static char *gen_cond(Node *node) {
+  char *r = new_val();
+  if (node->kind >= ND_EQ && node->kind <= ND_LE) {
+    char *v = gen_expr(node);
+    // 比较的结果已经是zext过的i1，让instcombine去掉多余的转换
+    ins("%s = icmp ne i64 %s, 0", r, v);
+    return r;
+  }
+  char *v = gen_expr(node);
+  if (strcmp(val_type(node->type), "ptr") == 0) {
+    ins("%s = icmp ne ptr %s, null", r, v);
+  } else {
+    ins("%s = icmp ne i64 %s, 0", r, to_i64(v, node->type));
+  }
+  return r;
+}
+
+static char *binary_ins(NodeKind kind) {
+  switch (kind) {
+  case ND_PLUS:
+    return "add";
+  case ND_MINUS:
+    return "sub";
+  case ND_MUL:
+    return "mul";
+  case ND_DIV:
+    return "sdiv";
+  case ND_MOD:
+    return "srem";
+  case ND_EQ:
+    return "icmp eq";
+  case ND_NE:
+    return "icmp ne";
+  case ND_LT:
+    return "icmp slt";
+  case ND_LE:
+    return "icmp sle";
+  default:
+    return NULL;
+  }
+}
+
+static char *gen_binary(Node *node) {
+  Type *lt = node->lhs->type;
+  Type *rt = node->rhs->type;
+  char *l = gen_expr(node->lhs);
+  char *r = gen_expr(node->rhs);
+  char *res = new_val();
+  if (is_vec(node->type)) {
+    ins("%s = %s %s %s, %s", res, binary_ins(node->kind), vec_type(node->type), l, r);
+    return res;
+  }
+  // ptr + num、ptr - num：按指向的类型移动
+  if ((node->kind == ND_PLUS || node->kind == ND_MINUS) && is_ptr(lt) && is_num(rt)) {
+    if (node->kind == ND_MINUS) {
+      char *neg = new_val();
+      ins("%s = sub i64 0, %s", neg, r);
+      r = neg;
+    }
+    ins("%s = getelementptr %s, ptr %s, i64 %s", res, mem_type(lt->target), l, r);
+    return res;
+  }
+  // ptr - ptr：地址的差除以类型的尺寸
+  if (node->kind == ND_MINUS && is_ptr(lt) && is_ptr(rt)) {
+    char *d = new_val();
+    ins("%s = sub i64 %s, %s", d, convert(l, lt, TYPE_INT), convert(r, rt, TYPE_INT));
+    ins("%s = sdiv exact i64 %s, %zu", res, d, lt->target->size);
+    return convert(res, TYPE_INT, node->type);
+  }
+  if (node->kind >= ND_EQ && node->kind <= ND_LE) {
+    char *c = new_val();
+    if (strcmp(val_type(lt), "ptr") == 0 && strcmp(val_type(rt), "ptr") == 0) {
+      ins("%s = %s ptr %s, %s", c, binary_ins(node->kind), l, r);
+    } else {
+      ins("%s = %s i64 %s, %s", c, binary_ins(node->kind), convert(l, lt, TYPE_INT), convert(r, rt, TYPE_INT));
+    }
+    ins("%s = zext i1 %s to i64", res, c);
+    return res;
+  }
+  ins("%s = %s i64 %s, %s", res, binary_ins(node->kind), convert(l, lt, TYPE_INT), convert(r, rt, TYPE_INT));
+  return convert(res, TYPE_INT, node->type);
+}
+
+static char *gen_call(Node *node) {
+  Meta *m = node->meta->kind == META_REF ? node->meta->ref : node->meta;
+  char *name = fn_name(m);
+  char *args = "";
+  char *params = "";
+  Meta *p = m->params;
+  for (Node *a = node->args; a; a = a->next) {
+    char *v = gen_expr(a);
+    Type *ty = a->type;
+    if (p && !m->is_decl) {
+      v = convert(v, a->type, p->type);
+      ty = p->type;
+      p = p->next;
+    }
+    args = format("%s%s%s %s", args, a == node->args ? "" : ", ", val_type(ty), v);
+    params = format("%s%s%s", params, a == node->args ? "" : ", ", val_type(ty));
+  }
+  // 只声明的函数是外部的C函数，按可变参数的函数调用；其他模块的函数要声明它的参数类型
+  bool found = false;
+  for (Spot *s = decls; s; s = s->next) {
+    found |= strcmp(s->name, name) == 0;
+  }
+  if (!found && (m->is_decl || m->owner != main_box || m->owner == NULL)) {
+    Spot *s = calloc(1, sizeof(Spot));
+    s->name = name;
+    s->meta = m;
+    s->next = decls;
+    decls = s;
+  }
+  char *r = new_val();
+  if (m->is_decl) {
+    ins("%s = call i64 (...) @%s(%s)", r, name, args);
+  } else {
+    ins("%s = call i64 @%s(%s)", r, name, args);
+  }
+  return r;
+}
+
+static char *gen_if(Node *node) {
+  char *then = new_label();
+  char *els = new_label();
+  char *end = new_label();
+  ins("br i1 %s, label %%%s, label %%%s", gen_cond(node->cond), then, els);
+  start_block(then);
+  char *v1 = to_i64(gen_expr(node->then), node->then->type);
+  char *from1 = cur_block;
+  ins("br label %%%s", end);
+  start_block(els);
+  char *v2 = node->els ? to_i64(gen_expr(node->els), node->els->type) : "0";
+  char *from2 = cur_block;
+  ins("br label %%%s", end);
+  start_block(end);
+  char *r = new_val();
+  ins("%s = phi i64 [ %s, %%%s ], [ %s, %%%s ]", r, v1, from1, v2, from2);
+  return r;
+}
+
+static char *gen_for(Node *node) {
+  char *cond = new_label();
+  char *body = new_label();
+  char *end = new_label();
+  ins("br label %%%s", cond);
+  start_block(cond);
+  ins("br i1 %s, label %%%s, label %%%s", gen_cond(node->cond), body, end);
+  start_block(body);
+  gen_expr(node->body);
+  ins("br label %%%s", cond);
+  start_block(end);
+  return "0";
+}
+
+// 依次计算，返回最后一个表达式的值（转换成i64）
+static char *gen_list(Node *list) {
+  char *v = "0";
+  for (Node *n = list; n; n = n->next) {
+    v = gen_expr(n);
+    if (n->next == NULL) {
+      v = to_i64(v, n->type);
+    }
+  }
+  return v;
+}
+
+// =============================
+// 向量类型
+// =============================
+
+// 向量的元素从i64截断成元素的宽度
+static char *to_lane(char *v, Type *ty) {
+  if (ty->len == 2) {
+    return v;
+  }
+  char *r = new_val();
+  ins("%s = trunc i64 %s to %s", r, v, lane_type(ty));
+  return r;
+}
+
+static char *from_lane(char *v, Type *ty) {
+  if (ty->len == 2) {
+    return v;
+  }
+  char *r = new_val();
+  ins("%s = sext %s %s to i64", r, lane_type(ty), v);
+  return r;
+}
+
+// 读写向量的数组元素arr[i]的地址
+static char *vec_addr(Node *arr, Node *idx) {
+  char *base = gen_expr(arr);
+  char *i = gen_expr(idx);
+  char *r = new_val();
+  ins("%s = getelementptr inbounds %s, ptr %s, i64 %s", r, mem_type(arr->type->target), base, i);
+  return r;
+}
+
+static char *gen_intrin(Node *node) {
+  Node *a0 = node->args;
+  Node *a1 = a0 ? a0->next : NULL;
+  // 向量的类型与codegen.c一致
+  Type *ty = node->intrin == IN_STORE ? a1->next->type : is_vec(a0->type) ? a0->type : node->type;
+  char *vt = vec_type(ty);
+  char *r = new_val();
+  switch (node->intrin) {
+  case IN_MAKE: {
+    if (a1 == NULL) {
+      char *x = new_val();
+      ins("%s = insertelement %s undef, %s %s, i32 0", x, vt, lane_type(ty), to_lane(gen_expr(a0), ty));
+      ins("%s = shufflevector %s %s, %s undef, <%zu x i32> zeroinitializer", r, vt, x, vt, ty->len);
+      return r;
+    }
+    char *v = "undef";
+    int k = 0;
+    for (Node *arg = a0; arg; arg = arg->next, k++) {
+      char *x = to_lane(gen_expr(arg), ty);
+      char *w = new_val();
+      ins("%s = insertelement %s %s, %s %s, i32 %d", w, vt, v, lane_type(ty), x, k);
+      v = w;
+    }
+    return v;
+  }
+  case IN_LOAD: {
+    char *addr = vec_addr(a0, a1);
+    // v4i32从int数组读取时，要把8个字节的元素截断成4个字节
+    if (ty->len == 4) {
+      char *w = new_val();
+      ins("%s = load <4 x i64>, ptr %s, align 8", w, addr);
+      ins("%s = trunc <4 x i64> %s to %s", r, w, vt);
+      return r;
+    }
+    ins("%s = load %s, ptr %s, align %d", r, vt, addr, ty->len == 2 ? 8 : 1);
+    return r;
+  }
+  case IN_STORE: {
+    char *addr = vec_addr(a0, a1);
+    char *v = gen_expr(a1->next);
+    if (ty->len == 4) {
+      char *w = new_val();
+      ins("%s = sext %s %s to <4 x i64>", w, vt, v);
+      ins("store <4 x i64> %s, ptr %s, align 8", w, addr);
+    } else {
+      ins("store %s %s, ptr %s, align %d", vt, v, addr, ty->len == 2 ? 8 : 1);
+    }
+    return "0";
+  }
+  case IN_LANE:
+    ins("%s = extractelement %s %s, i32 %ld", r, vt, gen_expr(a0), a1->val);
+    return from_lane(r, ty);
+  case IN_SET_LANE: {
+    char *v = gen_expr(a0);
+    char *x = to_lane(gen_expr(a1->next), ty);
+    ins("%s = insertelement %s %s, %s %s, i32 %ld", r, vt, v, lane_type(ty), x, a1->val);
+    return r;
+  }
+  case IN_SHUFFLE: {
+    char *mask = "";
+    for (Node *k = a1; k; k = k->next) {
+      mask = format("%s%si32 %ld", mask, k == a1 ? "" : ", ", k->val);
+    }
+    ins("%s = shufflevector %s %s, %s undef, <%zu x i32> <%s>", r, vt, gen_expr(a0), vt, ty->len, mask);
+    return r;
+  }
+  case IN_CMPEQ: {
+    char *l = gen_expr(a0);
+    char *c = new_val();
+    ins("%s = icmp eq %s %s, %s", c, vt, l, gen_expr(a1));
+    ins("%s = sext <%zu x i1> %s to %s", r, ty->len, c, vt);
+    return r;
+  }
+  case IN_MASK: {
+    char *c = new_val();
+    char *bits = new_val();
+    ins("%s = icmp slt %s %s, zeroinitializer", c, vt, gen_expr(a0));
+    ins("%s = bitcast <%zu x i1> %s to i%zu", bits, ty->len, c, ty->len);
+    ins("%s = zext i%zu %s to i64", r, ty->len, bits);
+    return r;
+  }
+  case IN_HSUM: {
+    char *v = gen_expr(a0);
+    char *sum = "0";
+    for (int k = 0; k < (int)ty->len; k++) {
+      char *x = new_val();
+      ins("%s = extractelement %s %s, i32 %d", x, vt, v, k);
+      char *s = new_val();
+      ins("%s = add i64 %s, %s", s, sum, from_lane(x, ty));
+      sum = s;
+    }
+    return sum;
+  }
+  }
+  return NULL;
+}
+
+// 计算表达式，返回值的写法（SSA值或常量），类型是val_type(node->type)
+static char *gen_expr(Node *node) {
+  if (binary_ins(node->kind)) {
+    return gen_binary(node);
+  }
+  switch (node->kind) {
+  case ND_NUM:
+    return format("%ld", node->val);
+  case ND_CHAR:
+    return format("%d", node->cha);
+  case ND_STR:
+    return gen_str(node);
+  case ND_IDENT:
+    return load(local_addr(node), node->meta->type);
+  case ND_NOT: {
+    char *c = new_val();
+    char *r = new_val();
+    ins("%s = icmp eq i64 %s, 0", c, to_i64(gen_expr(node->lhs), node->lhs->type));
+    ins("%s = zext i1 %s to i64", r, c);
+    return r;
+  }
+  case ND_NEG: {
+    char *v = gen_expr(node->rhs);
+    char *r = new_val();
+    if (is_vec(node->type)) {
+      ins("%s = sub %s zeroinitializer, %s", r, vec_type(node->type), v);
+    } else {
+      ins("%s = sub i64 0, %s", r, v);
+    }
+    return r;
+  }
+  case ND_ADDR:
+    return gen_addr(node->rhs);
+  case ND_DEREF:
+    return load(gen_addr(node), node->type);
+  case ND_INDEX:
+    return load(gen_elem_addr(node), node->type);
+  case ND_ASN: {
+    // 与汇编一样，先算左侧的地址，再算右侧的值
+    char *addr = gen_addr(node->lhs);
+    if (node->rhs->kind == ND_ARRAY) {
+      gen_array_store(addr, node->lhs->type, node->rhs);
+      return "0";
+    }
+    char *v = convert(gen_expr(node->rhs), node->rhs->type, node->lhs->type);
+    store(addr, v, node->lhs->type);
+    return v;
+  }
+  case ND_CALL:
+    return gen_call(node);
+  case ND_CTCALL: {
+    // 编译期调用：用解释器求出结果
+    Value *val = interpret(new_ctcall_node(node->meta->def, node));
+    return format("%ld", val->as.num);
+  }
+  case ND_INTRIN:
+    return gen_intrin(node);
+  case ND_ARRAY: {
+    // 长度为1的数组与普通值量一样，见codegen.c
+    if (node->len == 1) {
+      return gen_expr(node->elems);
+    }
+    char *addr = format("%%.arr%d", ++ntmp);
+    fprintf(afp, "  %s = alloca %s\n", addr, mem_type(node->type));
+    gen_array_store(addr, node->type, node);
+    return addr;
+  }
+  case ND_BLOCK:
+    return gen_list(node->body);
+  case ND_IF:
+    return gen_if(node);
+  case ND_FOR:
+    return gen_for(node);
+  case ND_FN:
+  case ND_USE:
+  case ND_TYPE:
+    return "0";
+  default:
+    error_tok(node->token, "【LLVM IR生成错误】：不支持的节点：%d\n", node->kind);
+  }
+  return NULL;
+}
+
+// =============================
+// 函数与模块
+// =============================
+
+static void begin_fn(void) {
+  locals = NULL;
+  use_frame = false;
+  ntmp = 0;
+  nlabel = 0;
+  cur_block = "entry";
+  afp = open_memstream(&abuf, &alen);
+  bfp = open_memstream(&bbuf, &blen);
+}
+
+// 入口块是alloca，后面接着函数体
+static void end_fn(void) {
+  fclose(afp);
+  fclose(bfp);
+  fprintf(fp, "entry:\n%s%s}\n", abuf, bbuf);
+  free(abuf);
+  free(bbuf);
+}
+
+static void gen_fn(Meta *m) {
+  begin_fn();
+  for (Meta *p = m->params; p; p = p->next) {
+    add_local(p);
+  }
+  collect_list(m->body);
+  alloc_locals();
+  char *params = "";
+  int i = 0;
+  for (Meta *p = m->params; p; p = p->next, i++) {
+    params = format("%s%s%s %%.a%d", params, i == 0 ? "" : ", ", val_type(p->type), i);
+    store(find_llocal(p)->name, format("%%.a%d", i), p->type);
+  }
+  char *v = gen_list(m->body);
+  ins("ret i64 %s", v);
+  fprintf(fp, "\ndefine %si64 @%s(%s) {\n", m->owner == main_box ? "internal " : "", fn_name(m), params);
+  end_fn();
+}
+
+// 模块开头：自定义类型
+static void gen_header(Box *b) {
+  fprintf(fp, "; 由zc从%s生成\n", b->path);
+  for (Node *n = b->prog->body; n; n = n->next) {
+    if (n->kind != ND_TYPE) {
+      continue;
+    }
+    char *fields = "";
+    for (Field *f = n->type->fields; f; f = f->next) {
+      fields = format("%s%s%s", fields, f == n->type->fields ? "" : ", ", mem_type(f->ty));
+    }
+    fprintf(fp, "%%struct.%s = type { %s }\n", n->type->name, fields);
+  }
+}
+
+// 模块末尾：字符串常量和外部函数的声明
+static void gen_footer(Box *b) {
+  fprintf(fp, "\n%s", globals);
+  for (Spot *s = decls; s; s = s->next) {
+    Meta *m = s->meta;
+    if (m->is_decl) {
+      fprintf(fp, "declare i64 @%s(...)\n", s->name);
+      continue;
+    }
+    if (m->owner == b) {
+      continue;
+    }
+    char *params = "";
+    for (Meta *p = m->params; p; p = p->next) {
+      params = format("%s%s%s", params, p == m->params ? "" : ", ", val_type(p->type));
+    }
+    fprintf(fp, "declare i64 @%s(%s)\n", s->name, params);
+  }
+}
+
+static void begin_module(Box *b, const char *path) {
+  fp = fopen(path, "w");
+  globals = "";
+  decls = NULL;
+  nstr = 0;
+  gen_header(b);
+}
+
+static void gen_functions(Box *b) {
+  for (Meta *m = b->prog->meta->region->locals; m; m = m->next) {
+    if (m->kind == META_FN && !m->is_decl && is_used(m) && strcmp(m->name, "main") != 0) {
+      gen_fn(m);
+    }
+  }
+}
+
+// 主模块：顶层代码和main函数的函数体合在一起，成为main函数。最后一个表达式的值就是退出码
+static void llgen_main(Box *b, const char *path) {
+  begin_module(b, path);
+  gen_functions(b);
+
+  Meta *main_fn = NULL;
+  for (Meta *m = b->prog->meta->region->locals; m; m = m->next) {
+    if (m->kind == META_FN && strcmp(m->name, "main") == 0) {
+      main_fn = m;
+    }
+  }
+  begin_fn();
+  collect_list(b->prog->body);
+  if (main_fn) {
+    collect_list(main_fn->body);
+  }
+  alloc_locals();
+  char *v = gen_list(b->prog->body);
+  if (main_fn) {
+    v = gen_list(main_fn->body);
+  }
+  char *code = new_val();
+  ins("%s = trunc i64 %s to i32", code, v);
+  ins("ret i32 %s", code);
+  fprintf(fp, "\ndefine i32 @main() {\n");
+  end_fn();
+
+  gen_footer(b);
+  fclose(fp);
+}
+
+static void llgen_lib(Box *b, const char *path) {
+  begin_module(b, path);
+  gen_functions(b);
+  gen_footer(b);
+  fclose(fp);
+}
+
+char *llgen_box(Box *b) {
+  main_box = b;
+  inline_box(b, true);
+  fold_consts(b->prog);
+  mark_reachable(b);
+  char *files = "app.ll";
+
+  for (Box *bo = all_boxes(); bo; bo = bo->next) {
+    if (strcmp(bo->name, b->name) == 0 || bo->used == NULL) {
+      continue;
+    }
+    char *path = format("%s.ll", bo->name);
+    files = format("%s %s", files, path);
+    if (cache_restore(bo, path)) {
+      continue;
+    }
+    if (bo->prog == NULL) {
+      parse_file(bo);
+    }
+    inline_box(bo, false);
+    fold_consts(bo->prog);
+    llgen_lib(bo, path);
+    cache_save(bo, path);
+  }
+
+  if (!cache_restore(b, "app.ll")) {
+    llgen_main(b, "app.ll");
+    cache_save(b, "app.ll");
+  }
+  print_cache_stats();
+  return files;
+}
@@ -0,0 +1,13 @@
+; 由zc从lib/math.z生成
+
+define i64 @math_square(i64 %.a0) {
+entry:
+  %n = alloca i64
+  store i64 zeroinitializer, ptr %n
+  store i64 %.a0, ptr %n
+  %.t1 = load i64, ptr %n
+  %.t2 = load i64, ptr %n
+  %.t3 = mul i64 %.t1, %.t2
+  ret i64 %.t3
+}
+
@@ -0,0 +1,1678 @@
+#include <ctype.h>
+#include <limits.h>
+
+#include "zc.h"
+
+// =============================
+// 可达性分析
+// =============================
+
+// 从主模块的顶层代码和main函数出发，沿着函数调用和模块引用（META_REF），找出所有用到的函数和常量。
+// 代码生成时只生成用到的函数和常量，一个值量都没用到的模块就不再生成汇编，也不参与链接。
+//
+// 结果按名称记录在值量所属模块的used链表里：只从接口文件加载的模块，生成代码前要重新解析源码，
+// 值量会换成新解析出来的，但名称不会变。
+
+// 待处理的函数，它们的函数体里可能还会调用其他函数
+static Spot *pending;
+
+static Spot *find_spot(Spot *spots, const char *name) {
+  for (Spot *s = spots; s; s = s->next) {
+    if (strcmp(s->name, name) == 0) {
+      return s;
+    }
+  }
+  return NULL;
+}
+
+static Spot *new_spot(Spot *next, Meta *meta) {
+  Spot *s = calloc(1, sizeof(Spot));
+  s->name = meta->name;
+  s->meta = meta;
+  s->next = next;
+  return s;
+}
+
+static void use_meta(Meta *m) {
+  if (m->kind == META_REF) {
+    m = m->ref;
+  }
+  if ((m->kind != META_FN && m->kind != META_CONST) || m->owner == NULL) {
+    return;
+  }
+  Box *b = m->owner;
+  if (find_spot(b->used, m->name)) {
+    return;
+  }
+  b->used = new_spot(b->used, m);
+  if (m->kind == META_FN) {
+    pending = new_spot(pending, m);
+  }
+}
+
+static void walk(Node *node);
+
+static void walk_list(Node *list) {
+  for (Node *n = list; n; n = n->next) {
+    walk(n);
+  }
+}
+
+static void walk(Node *node) {
+  if (node == NULL) {
+    return;
+  }
+  switch (node->kind) {
+  case ND_FN:
+    // 函数定义本身不算用到，只有调用或引用了才算
+    return;
+  case ND_CTCALL:
+    // 编译期调用在编译时就求出了结果，被调用的函数不需要生成代码。解释器执行时自己给它们分配值量的槽位（见interp.c）
+    return;
+  case ND_CALL:
+  case ND_IDENT:
+  case ND_STR:
+    if (node->meta) {
+      use_meta(node->meta);
+    }
+    break;
+  default:
+    break;
+  }
+  walk(node->lhs);
+  walk(node->rhs);
+  walk(node->cond);
+  walk(node->then);
+  walk(node->els);
+  walk_list(node->body);
+  walk_list(node->args);
+  walk_list(node->elems);
+}
+
+void mark_reachable(Box *b) {
+  // 用到的值量是缓存键的一部分，编译服务器里常驻的模块要重新计算
+  for (Box *bo = all_boxes(); bo; bo = bo->next) {
+    bo->used = NULL;
+    bo->cache_key = 0;
+  }
+  walk_list(b->prog->body);
+  for (Meta *m = b->prog->meta->region->locals; m; m = m->next) {
+    if (m->kind == META_FN && strcmp(m->name, "main") == 0) {
+      use_meta(m);
+    }
+  }
+  while (pending) {
+    Meta *fn = pending->meta;
+    pending = pending->next;
+    // 延迟解析或只从接口加载的函数，要先得到函数体
+    load_fn_body(fn);
+    walk_list(fn->body);
+  }
+}
+
+bool is_used(Meta *m) {
+  return m->owner && find_spot(m->owner->used, m->name) != NULL;
+}
+
+// =============================
+// 函数内联
+// =============================
+
+// 把小函数的调用替换成函数体的副本：先把实参赋给参数的副本，再依次执行函数体，最后一个表达式的值就是调用的结果。
+// 这样省掉了参数的压栈和出栈、call/ret以及函数的开头和结尾，对math.square这样的小函数尤其划算。
+//
+// 代价模型：函数体的节点数不超过inline_limit才内联；每个函数因为内联增加的节点数不超过INLINE_GROWTH，避免代码膨胀。
+// 正在内联的函数会记录在栈上，递归调用不会被内联。
+
+bool opt_inline = true;
+int inline_limit = 24;
+
+#define INLINE_GROWTH 512
+
+// 原函数的局部值量到副本的映射
+typedef struct MetaMap MetaMap;
+struct MetaMap {
+  MetaMap *next;
+  Meta *from;
+  Meta *to;
+};
+
+typedef struct {
+  Box *box; // 调用者所在的模块
+  Region *region; // 副本值量存放的存储域，即调用者的存储域
+  int growth; // 已经因为内联增加的节点数
+  Spot *stack; // 正在内联的函数
+} Inliner;
+
+static bool is_local_of(Meta *f, Meta *m) {
+  for (Meta *l = f->region->locals; l; l = l->next) {
+    if (l == m) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// 计算函数体的节点数。遇到不能内联的节点返回-1：
+// 字符串常量、数组字面值、嵌套的函数定义等需要额外的存储，访问外层值量的函数体换了位置后也没法正确访问
+static int inline_cost(Meta *f, Node *node) {
+  if (node == NULL) {
+    return 0;
+  }
+  switch (node->kind) {
+  case ND_NUM:
+  case ND_CHAR:
+  case ND_PLUS:
+  case ND_MINUS:
+  case ND_MUL:
+  case ND_DIV:
+  case ND_MOD:
+  case ND_NOT:
+  case ND_EQ:
+  case ND_NE:
+  case ND_LT:
+  case ND_LE:
+  case ND_NEG:
+  case ND_ASN:
+  case ND_BLOCK:
+  case ND_IF:
+  case ND_FOR:
+  case ND_CALL:
+  case ND_ADDR:
+  case ND_DEREF:
+  case ND_INDEX:
+  case ND_INTRIN:
+    break;
+  case ND_IDENT:
+    if (node->meta->kind != META_LET || !is_local_of(f, node->meta)) {
+      return -1;
+    }
+    break;
+  default:
+    return -1;
+  }
+  int cost = 1;
+  Node *kids[] = {node->lhs, node->rhs, node->cond, node->then, node->els};
+  for (size_t i = 0; i < sizeof(kids) / sizeof(kids[0]); i++) {
+    int c = inline_cost(f, kids[i]);
+    if (c < 0) {
+      return -1;
+    }
+    cost += c;
+  }
+  Node *lists[] = {node->body, node->args};
+  for (size_t i = 0; i < sizeof(lists) / sizeof(lists[0]); i++) {
+    for (Node *n = lists[i]; n; n = n->next) {
+      int c = inline_cost(f, n);
+      if (c < 0) {
+        return -1;
+      }
+      cost += c;
+    }
+  }
+  return cost;
+}
+
+// 判断调用能否内联，能的话返回被调用的函数和函数体的节点数
+static Meta *inline_target(Inliner *in, Node *call, int *cost) {
+  Meta *f = call->meta;
+  if (f->kind == META_REF) {
+    f = f->ref;
+  }
+  if (f->kind != META_FN || f->is_decl || strcmp(f->name, "main") == 0) {
+    return NULL;
+  }
+  for (Spot *s = in->stack; s; s = s->next) {
+    if (s->meta == f) {
+      return NULL;
+    }
+  }
+  load_fn_body(f);
+  if (f->body == NULL) {
+    return NULL;
+  }
+  // 参数只支持整数和指针，它们的副本可以直接用8字节的赋值初始化
+  for (Meta *p = f->params; p; p = p->next) {
+    if (p->type->kind != TY_INT && p->type->kind != TY_PTR) {
+      return NULL;
+    }
+  }
+  int c = 0;
+  for (Node *n = f->body; n; n = n->next) {
+    int k = inline_cost(f, n);
+    if (k < 0) {
+      return NULL;
+    }
+    c += k;
+  }
+  if (c > inline_limit || in->growth + c > INLINE_GROWTH) {
+    return NULL;
+  }
+  *cost = c;
+  return f;
+}
+
+static Node *clone(Node *node, MetaMap *map);
+
+static Node *clone_list(Node *list, MetaMap *map) {
+  Node head = {0};
+  Node *cur = &head;
+  for (Node *n = list; n; n = n->next) {
+    cur = cur->next = clone(n, map);
+  }
+  return head.next;
+}
+
+static Node *clone(Node *node, MetaMap *map) {
+  if (node == NULL) {
+    return NULL;
+  }
+  Node *n = calloc(1, sizeof(Node));
+  *n = *node;
+  n->next = NULL;
+  // 展开后的函数体不一定还在尾部，由调用者重新标记
+  n->is_tail = false;
+  n->lhs = clone(node->lhs, map);
+  n->rhs = clone(node->rhs, map);
+  n->cond = clone(node->cond, map);
+  n->then = clone(node->then, map);
+  n->els = clone(node->els, map);
+  n->body = clone_list(node->body, map);
+  n->args = clone_list(node->args, map);
+  for (MetaMap *m = map; m; m = m->next) {
+    if (m->from == node->meta) {
+      n->meta = m->to;
+      n->name = m->to->name;
+      break;
+    }
+  }
+  return n;
+}
+
+static Node *ident_of(Meta *m, Node *at) {
+  Node *n = calloc(1, sizeof(Node));
+  n->kind = ND_IDENT;
+  n->token = at->token;
+  n->name = m->name;
+  n->meta = m;
+  n->type = m->type;
+  return n;
+}
+
+static void inline_node(Inliner *in, Node *node);
+
+static void inline_list(Inliner *in, Node *list) {
+  for (Node *n = list; n; n = n->next) {
+    inline_node(in, n);
+  }
+}
+
+// 把调用节点原地替换成代码块
+static void inline_call(Inliner *in, Node *call, Meta *f, int cost) {
+  in->growth += cost;
+
+  // 为被调用函数的每个局部值量（包括参数）在调用者的存储域里建一个副本
+  MetaMap *map = NULL;
+  for (Meta *l = f->region->locals; l; l = l->next) {
+    if (l->kind != META_LET) {
+      continue;
+    }
+    Meta *copy = calloc(1, sizeof(Meta));
+    *copy = *l;
+    copy->name = format("%s.%s", f->name, l->name);
+    copy->owner = in->box;
+    copy->next = in->region->locals;
+    in->region->locals = copy;
+    MetaMap *m = calloc(1, sizeof(MetaMap));
+    m->from = l;
+    m->to = copy;
+    m->next = map;
+    map = m;
+  }
+
+  // 函数体的副本里可能还有能内联的调用，当前函数要压栈，防止递归展开
+  Node *body = clone_list(f->body, map);
+  Spot *frame = calloc(1, sizeof(Spot));
+  frame->name = f->name;
+  frame->meta = f;
+  frame->next = in->stack;
+  in->stack = frame;
+  inline_list(in, body);
+  in->stack = frame->next;
+
+  // 先把实参赋给参数的副本，再执行函数体
+  Node head = {0};
+  Node *cur = &head;
+  Node *arg = call->args;
+  for (Meta *p = f->params; p && arg; p = p->next, arg = arg->next) {
+    Node *asn = calloc(1, sizeof(Node));
+    asn->kind = ND_ASN;
+    asn->token = call->token;
+    asn->type = p->type;
+    for (MetaMap *m = map; m; m = m->next) {
+      if (m->from == p) {
+        asn->lhs = ident_of(m->to, call);
+      }
+    }
+    asn->rhs = arg;
+    cur = cur->next = asn;
+  }
+  cur->next = body;
+
+  Node *next = call->next;
+  Type *type = call->type;
+  Token *token = call->token;
+  memset(call, 0, sizeof(Node));
+  call->kind = ND_BLOCK;
+  call->type = type;
+  call->token = token;
+  call->body = head.next;
+  call->next = next;
+}
+
+static void inline_node(Inliner *in, Node *node) {
+  if (node == NULL) {
+    return;
+  }
+  switch (node->kind) {
+  case ND_FN:
+  case ND_CTCALL:
+    return;
+  default:
+    break;
+  }
+  inline_node(in, node->lhs);
+  inline_node(in, node->rhs);
+  inline_node(in, node->cond);
+  inline_node(in, node->then);
+  inline_node(in, node->els);
+  inline_list(in, node->body);
+  inline_list(in, node->args);
+  inline_list(in, node->elems);
+
+  if (node->kind == ND_CALL) {
+    int cost;
+    Meta *f = inline_target(in, node, &cost);
+    if (f) {
+      inline_call(in, node, f, cost);
+    }
+  }
+}
+
+static void inline_body(Box *b, Node *body, Region *region, Meta *self) {
+  Inliner in = {.box = b, .region = region};
+  if (self) {
+    Spot *frame = calloc(1, sizeof(Spot));
+    frame->name = self->name;
+    frame->meta = self;
+    in.stack = frame;
+  }
+  inline_list(&in, body);
+}
+
+// 对模块里的函数做内联。主模块还包括顶层代码和main函数，它们都生成在汇编的main里，副本值量要放在顶层的存储域
+void inline_box(Box *b, bool is_main) {
+  if (!opt_inline) {
+    return;
+  }
+  Region *top = b->prog->meta->region;
+  if (is_main) {
+    inline_body(b, b->prog->body, top, NULL);
+  }
+  for (Meta *m = top->locals; m; m = m->next) {
+    if (m->kind != META_FN || m->is_decl) {
+      continue;
+    }
+    // 延迟解析的模块只处理用到的函数，不要因为内联去解析没用到的函数体
+    if (m->body == NULL && !is_used(m)) {
+      continue;
+    }
+    load_fn_body(m);
+    if (strcmp(m->name, "main") == 0) {
+      if (is_main) {
+        inline_body(b, m->body, top, m);
+      }
+    } else {
+      inline_body(b, m->body, m->region, m);
+    }
+  }
+}
+
+// =============================
+// 常量折叠与常量传播
+// =============================
+
+// 把运算数都是常量的表达式替换成运算的结果，例如`1+2*3`直接变成`7`；条件是常量的if只保留对应的分支。
+// 同时做常量传播：值量如果只被赋值一次、没有取过地址，而且这唯一的一次赋值一定在所有使用之前执行，
+// 赋的值又是常量，那么使用它的地方可以直接换成这个常量。
+// 指针加减之后可能指向相邻的值量（例如p = &b; p = p - 1指向a），所以程序里有指针加减法时，
+// 取过地址的函数（或顶层代码）里的所有值量都当作取过地址。
+// “一定在之前执行”用一个保守的办法判断：赋值不在if的分支或for循环里，并且按求值顺序遍历时先遇到赋值。
+
+// 值量的赋值信息
+typedef struct ConstInfo ConstInfo;
+struct ConstInfo {
+  ConstInfo *next;
+  Meta *meta;
+  int stores; // 赋值次数
+  bool addr_taken; // 是否取过地址
+  Node *value; // 已知的常量值
+};
+
+#define CONST_BUCKETS 4096
+
+static ConstInfo *const_table[CONST_BUCKETS];
+static int eliminated;
+
+// 取过地址的函数体（或顶层代码）
+typedef struct AddrScope AddrScope;
+struct AddrScope {
+  AddrScope *next;
+  Node *body;
+};
+
+static AddrScope *addr_scopes;
+static bool scope_has_addr; // 当前函数里是否取过地址
+static bool has_ptr_arith; // 程序里是否有指针加减法
+
+static ConstInfo *const_info(Meta *m) {
+  size_t h = ((uintptr_t)m >> 4) % CONST_BUCKETS;
+  for (ConstInfo *c = const_table[h]; c; c = c->next) {
+    if (c->meta == m) {
+      return c;
+    }
+  }
+  ConstInfo *c = calloc(1, sizeof(ConstInfo));
+  c->meta = m;
+  c->next = const_table[h];
+  const_table[h] = c;
+  return c;
+}
+
+static void count_stores(Node *node);
+
+static void count_store_list(Node *list) {
+  for (Node *n = list; n; n = n->next) {
+    count_stores(n);
+  }
+}
+
+// 统计一个函数体（或顶层代码），记下取过地址的
+static void count_scope(Node *body) {
+  bool outer = scope_has_addr;
+  scope_has_addr = false;
+  count_store_list(body);
+  if (scope_has_addr) {
+    AddrScope *s = calloc(1, sizeof(AddrScope));
+    s->body = body;
+    s->next = addr_scopes;
+    addr_scopes = s;
+  }
+  scope_has_addr = outer;
+}
+
+// 把函数体里用到的值量都当作取过地址，不进入里面的函数定义
+static void mark_aliased(Node *node) {
+  if (node == NULL || node->kind == ND_FN) {
+    return;
+  }
+  if (node->kind == ND_IDENT && node->meta) {
+    const_info(node->meta)->addr_taken = true;
+  }
+  mark_aliased(node->lhs);
+  mark_aliased(node->rhs);
+  mark_aliased(node->cond);
+  mark_aliased(node->then);
+  mark_aliased(node->els);
+  Node *lists[] = {node->body, node->args, node->elems};
+  for (size_t i = 0; i < sizeof(lists) / sizeof(lists[0]); i++) {
+    for (Node *k = lists[i]; k; k = k->next) {
+      mark_aliased(k);
+    }
+  }
+}
+
+// 统计每个值量的赋值次数和取地址的情况，函数定义里的函数体也要统计
+static void count_stores(Node *node) {
+  if (node == NULL) {
+    return;
+  }
+  if (node->kind == ND_ASN && node->lhs->kind == ND_IDENT) {
+    const_info(node->lhs->meta)->stores++;
+  }
+  if (node->kind == ND_ADDR) {
+    scope_has_addr = true;
+    if (node->rhs->kind == ND_IDENT) {
+      const_info(node->rhs->meta)->addr_taken = true;
+    }
+  }
+  if ((node->kind == ND_PLUS || node->kind == ND_MINUS) && node->lhs->type && node->lhs->type->kind == TY_PTR) {
+    has_ptr_arith = true;
+  }
+  if (node->kind == ND_FN) {
+    count_scope(node->meta->body);
+    return;
+  }
+  count_stores(node->lhs);
+  count_stores(node->rhs);
+  count_stores(node->cond);
+  count_stores(node->then);
+  count_stores(node->els);
+  count_store_list(node->body);
+  count_store_list(node->args);
+  count_store_list(node->elems);
+}
+
+static int node_count(Node *node) {
+  if (node == NULL) {
+    return 0;
+  }
+  int n = 1 + node_count(node->lhs) + node_count(node->rhs) + node_count(node->cond) +
+          node_count(node->then) + node_count(node->els);
+  Node *lists[] = {node->body, node->args, node->elems};
+  for (size_t i = 0; i < sizeof(lists) / sizeof(lists[0]); i++) {
+    for (Node *k = lists[i]; k; k = k->next) {
+      n += node_count(k);
+    }
+  }
+  return n;
+}
+
+static bool is_const(Node *node) {
+  return node && (node->kind == ND_NUM || node->kind == ND_CHAR);
+}
+
+static long const_val(Node *node) {
+  return node->kind == ND_NUM ? node->val : node->cha;
+}
+
+// 用with原地替换node，保留node在链表中的位置
+static void replace(Node *node, Node *with) {
+  eliminated += node_count(node) - node_count(with);
+  Node *next = node->next;
+  Token *token = node->token;
+  *node = *with;
+  node->next = next;
+  if (node->token == NULL) {
+    node->token = token;
+  }
+}
+
+static void replace_num(Node *node, long val) {
+  Node num = {.kind = ND_NUM, .type = TYPE_INT, .val = val};
+  // 字符类型的结果仍然是字符。汇编里字符常量写成'c'的形式，因此只有普通的可打印字符才能用ND_CHAR。
+  // 折叠的结果可能超出字符的范围，isprint()只接受unsigned char范围内的值
+  if (node->type && node->type->kind == TY_CHAR) {
+    num.type = TYPE_CHAR;
+    if (val >= 0 && val < 128 && isprint((int)val) && val != '\'' && val != '\\') {
+      num.kind = ND_CHAR;
+      num.cha = (char)val;
+    }
+  }
+  replace(node, &num);
+}
+
+static void fold(Node *node, bool straight);
+
+static void fold_list(Node *list, bool straight) {
+  for (Node *n = list; n; n = n->next) {
+    fold(n, straight);
+  }
+}
+
+static bool is_scalar(Type *ty) {
+  return ty && (ty->kind == TY_INT || ty->kind == TY_CHAR);
+}
+
+// 按求值顺序遍历并折叠。straight表示当前节点一定会按顺序执行，即不在if的分支或循环里
+static void fold(Node *node, bool straight) {
+  if (node == NULL) {
+    return;
+  }
+  switch (node->kind) {
+  case ND_FN:
+    // 函数体单独处理，函数体的顶层总是按顺序执行的
+    fold_list(node->meta->body, true);
+    return;
+  case ND_CTCALL:
+    return;
+  case ND_IDENT: {
+    if (!is_scalar(node->type)) {
+      return;
+    }
+    ConstInfo *c = const_info(node->meta);
+    if (c->value && c->stores == 1 && !c->addr_taken) {
+      replace_num(node, const_val(c->value));
+    }
+    return;
+  }
+  case ND_ASN:
+    fold(node->rhs, straight);
+    if (straight && node->lhs->kind == ND_IDENT && is_scalar(node->lhs->type) && is_const(node->rhs)) {
+      const_info(node->lhs->meta)->value = node->rhs;
+    }
+    return;
+  case ND_IF:
+    fold(node->cond, straight);
+    fold(node->then, false);
+    fold(node->els, false);
+    if (is_const(node->cond)) {
+      if (const_val(node->cond)) {
+        replace(node, node->then);
+      } else if (node->els) {
+        replace(node, node->els);
+      } else {
+        replace_num(node, 0);
+      }
+    }
+    return;
+  case ND_FOR:
+    fold(node->cond, false);
+    fold(node->body, false);
+    return;
+  default:
+    break;
+  }
+
+  fold(node->lhs, straight);
+  fold(node->rhs, straight);
+  fold(node->cond, straight);
+  fold(node->then, straight);
+  fold(node->els, straight);
+  fold_list(node->body, straight);
+  fold_list(node->args, straight);
+  fold_list(node->elems, straight);
+
+  Node *l = node->lhs;
+  Node *r = node->rhs;
+  switch (node->kind) {
+  case ND_PLUS:
+  case ND_MINUS:
+  case ND_MUL:
+  case ND_DIV:
+  case ND_MOD:
+  case ND_EQ:
+  case ND_NE:
+  case ND_LT:
+  case ND_LE: {
+    if (!is_const(l) || !is_const(r) || !is_scalar(node->type)) {
+      return;
+    }
+    long a = const_val(l);
+    long b = const_val(r);
+    // Z的整数运算按补码回绕，折叠时要用无符号数计算，C里有符号数溢出是未定义行为
+    switch (node->kind) {
+    case ND_PLUS: replace_num(node, (long)((unsigned long)a + (unsigned long)b)); return;
+    case ND_MINUS: replace_num(node, (long)((unsigned long)a - (unsigned long)b)); return;
+    case ND_MUL: replace_num(node, (long)((unsigned long)a * (unsigned long)b)); return;
+    case ND_DIV:
+      // 除以0留到运行时再报错；最小的负数除以-1会溢出，编译器自己算会崩溃，也留到运行时
+      if (b != 0 && !(a == LONG_MIN && b == -1)) {
+        replace_num(node, a / b);
+      }
+      return;
+    case ND_MOD:
+      // 除以-1的余数总是0，直接算a % -1在a是最小的负数时会溢出
+      if (b != 0) {
+        replace_num(node, b == -1 ? 0 : a % b);
+      }
+      return;
+    case ND_EQ: replace_num(node, a == b); return;
+    case ND_NE: replace_num(node, a != b); return;
+    case ND_LT: replace_num(node, a < b); return;
+    case ND_LE: replace_num(node, a <= b); return;
+    default: return;
+    }
+  }
+  case ND_NEG:
+    if (is_const(r)) {
+      replace_num(node, (long)-(unsigned long)const_val(r));
+    }
+    return;
+  case ND_NOT:
+    if (is_const(l)) {
+      replace_num(node, !const_val(l));
+    }
+    return;
+  case ND_INDEX:
+    // 字符串字面值的下标
+    if (l->kind == ND_STR && is_const(r) && const_val(r) >= 0 && (size_t)const_val(r) < l->len) {
+      replace_num(node, l->str[const_val(r)]);
+    }
+    return;
+  default:
+    return;
+  }
+}
+
+int fold_consts(Node *prog) {
+  memset(const_table, 0, sizeof(const_table));
+  eliminated = 0;
+  addr_scopes = NULL;
+  scope_has_addr = false;
+  has_ptr_arith = false;
+  count_scope(prog->body);
+  if (has_ptr_arith) {
+    for (AddrScope *s = addr_scopes; s; s = s->next) {
+      for (Node *n = s->body; n; n = n->next) {
+        mark_aliased(n);
+      }
+    }
+  }
+  fold_list(prog->body, true);
+  return eliminated;
+}
+
+// =============================
+// 尾调用
+// =============================
+
+// 函数体的最后一个表达式如果是调用，调用的结果就是函数的结果，当前函数的栈帧在调用之后不再需要：
+// 生成代码时可以直接跳转到被调用的函数，解释器也可以不再递归，而是回到最外层的调用处继续执行（见codegen.c和interp.c）。
+// 最后一个表达式是代码块或if时，尾部位置继续向里传递到代码块的最后一个表达式和if的两个分支。
+
+static void mark_tail(Node *node) {
+  if (node == NULL) {
+    return;
+  }
+  switch (node->kind) {
+  case ND_CALL:
+    node->is_tail = true;
+    return;
+  case ND_BLOCK:
+    mark_tail_calls(node->body);
+    return;
+  case ND_IF:
+    mark_tail(node->then);
+    mark_tail(node->els);
+    return;
+  default:
+    return;
+  }
+}
+
+void mark_tail_calls(Node *body) {
+  Node *last = body;
+  while (last && last->next) {
+    last = last->next;
+  }
+  mark_tail(last);
+}
+
+// =============================
+// 归纳变量的强度削减
+// =============================
+
+// for循环里形如arr[i]的下标访问，如果i是循环的基本归纳变量，即整个循环里对i只有一处赋值，
+// 而且是循环体里直接的一条语句`i = i + c`，那么在循环前引入一个指针`p = arr + i`，把arr[i]换成*p，
+// 并在`i = i + c`之后紧接着执行`p = p + c`。这样循环里p始终等于arr + i，每次访问元素只需要读一次指针，
+// 不用再计算基址加上下标乘以元素的尺寸。arr要么是局部数组，要么是在循环里没有被赋值的指针或字符串。
+//
+// 变换后的函数体只用于生成代码：解释器（包括编译期调用）的指针模型不同，仍然执行原来的函数体，因此变换在副本上进行。
+
+// 循环里用到的数组和对应的指针
+typedef struct Bump Bump;
+struct Bump {
+  Bump *next;
+  Meta *array;
+  Meta *ptr;
+};
+
+static Node *sr_body; // 正在处理的函数体
+static int sr_count; // 新建的指针的编号
+
+// 统计子树里对值量m的赋值（ND_ASN）或取地址（ND_ADDR）的次数
+static int count_ops(Node *node, NodeKind kind, Meta *m) {
+  if (node == NULL || node->kind == ND_FN) {
+    return 0;
+  }
+  int n = 0;
+  Node *target = node->kind == ND_ASN ? node->lhs : node->rhs;
+  if (node->kind == kind && target && target->kind == ND_IDENT && target->meta == m) {
+    n++;
+  }
+  n += count_ops(node->lhs, kind, m) + count_ops(node->rhs, kind, m) + count_ops(node->cond, kind, m) +
+       count_ops(node->then, kind, m) + count_ops(node->els, kind, m);
+  Node *lists[] = {node->body, node->args, node->elems};
+  for (size_t i = 0; i < sizeof(lists) / sizeof(lists[0]); i++) {
+    for (Node *k = lists[i]; k; k = k->next) {
+      n += count_ops(k, kind, m);
+    }
+  }
+  return n;
+}
+
+// 语句是`i = i + c`或`i = i - c`时，返回i，步长放在step里
+static Meta *induction_var(Node *stmt, long *step) {
+  if (stmt->kind != ND_ASN || stmt->lhs->kind != ND_IDENT) {
+    return NULL;
+  }
+  Meta *m = stmt->lhs->meta;
+  Node *rhs = stmt->rhs;
+  if (m->kind != META_LET || m->type->kind != TY_INT || (rhs->kind != ND_PLUS && rhs->kind != ND_MINUS) ||
+      rhs->lhs->kind != ND_IDENT || rhs->lhs->meta != m || rhs->rhs->kind != ND_NUM) {
+    return NULL;
+  }
+  *step = rhs->kind == ND_PLUS ? rhs->rhs->val : -rhs->rhs->val;
+  return m;
+}
+
+static Node *new_node(NodeKind kind, Type *type, Node *at) {
+  Node *n = calloc(1, sizeof(Node));
+  n->kind = kind;
+  n->type = type;
+  n->token = at->token;
+  return n;
+}
+
+// 指针的赋值：ptr = base + offset，offset是值量或整数
+static Node *ptr_asn(Meta *ptr, Meta *base, Meta *offset, long step, Node *at) {
+  Node *add = new_node(ND_PLUS, ptr->type, at);
+  add->lhs = ident_of(base, at);
+  if (offset) {
+    add->rhs = ident_of(offset, at);
+  } else {
+    add->rhs = new_node(ND_NUM, TYPE_INT, at);
+    add->rhs->val = step;
+  }
+  Node *asn = new_node(ND_ASN, ptr->type, at);
+  asn->lhs = ident_of(ptr, at);
+  asn->rhs = add;
+  return asn;
+}
+
+static Meta *bump_ptr(Bump **bumps, Meta *array, Region *region) {
+  for (Bump *b = *bumps; b; b = b->next) {
+    if (b->array == array) {
+      return b->ptr;
+    }
+  }
+  Meta *p = calloc(1, sizeof(Meta));
+  p->kind = META_LET;
+  p->name = format("%s.p%d", array->name, sr_count++);
+  p->type = pointer_to(array->type->target);
+  p->owner = array->owner;
+  p->next = region->locals;
+  region->locals = p;
+  Bump *b = calloc(1, sizeof(Bump));
+  b->array = array;
+  b->ptr = p;
+  b->next = *bumps;
+  *bumps = b;
+  return p;
+}
+
+// 把循环里的arr[i]换成*p
+static void reduce_index(Node *node, Meta *iv, Node *loop, Bump **bumps, Region *region) {
+  if (node == NULL || node->kind == ND_FN) {
+    return;
+  }
+  reduce_index(node->lhs, iv, loop, bumps, region);
+  reduce_index(node->rhs, iv, loop, bumps, region);
+  reduce_index(node->cond, iv, loop, bumps, region);
+  reduce_index(node->then, iv, loop, bumps, region);
+  reduce_index(node->els, iv, loop, bumps, region);
+  Node *lists[] = {node->body, node->args, node->elems};
+  for (size_t i = 0; i < sizeof(lists) / sizeof(lists[0]); i++) {
+    for (Node *k = lists[i]; k; k = k->next) {
+      reduce_index(k, iv, loop, bumps, region);
+    }
+  }
+
+  if (node->kind != ND_INDEX || node->rhs->kind != ND_IDENT || node->rhs->meta != iv ||
+      node->lhs->kind != ND_IDENT) {
+    return;
+  }
+  Meta *a = node->lhs->meta;
+  bool fixed = a->type->kind == TY_ARRAY ||
+               ((a->type->kind == TY_PTR || a->type->kind == TY_STR) && count_ops(loop, ND_ASN, a) == 0);
+  if (a->kind != META_LET || !fixed) {
+    return;
+  }
+  Meta *p = bump_ptr(bumps, a, region);
+  node->kind = ND_DEREF;
+  node->lhs = NULL;
+  node->rhs = ident_of(p, node);
+}
+
+// 在循环之前插入语句inits：原地把循环换成代码块{inits; 循环}，返回代码块里的循环
+static Node *preheader(Node *loop, Node *inits) {
+  Node *copy = calloc(1, sizeof(Node));
+  *copy = *loop;
+  copy->next = NULL;
+  Node *last = inits;
+  while (last->next) {
+    last = last->next;
+  }
+  last->next = copy;
+
+  Node *next = loop->next;
+  Type *type = loop->type;
+  Token *token = loop->token;
+  memset(loop, 0, sizeof(Node));
+  loop->kind = ND_BLOCK;
+  loop->type = type;
+  loop->token = token;
+  loop->body = inits;
+  loop->next = next;
+  return copy;
+}
+
+static void reduce_loop(Node *loop, Region *region) {
+  Node *body = loop->body;
+  if (body == NULL || body->kind != ND_BLOCK) {
+    return;
+  }
+  // 要向量化的循环保留原来的下标访问
+  VecLoop v;
+  char *reason;
+  if (opt_vectorize && can_vectorize(loop, &v, &reason)) {
+    return;
+  }
+  for (Node *s = body->body; s; s = s->next) {
+    long step;
+    Meta *iv = induction_var(s, &step);
+    if (!iv || count_ops(loop, ND_ASN, iv) != 1) {
+      continue;
+    }
+    int addr = 0;
+    for (Node *n = sr_body; n; n = n->next) {
+      addr += count_ops(n, ND_ADDR, iv);
+    }
+    if (addr > 0) {
+      continue;
+    }
+    Bump *bumps = NULL;
+    reduce_index(loop->cond, iv, loop, &bumps, region);
+    reduce_index(body, iv, loop, &bumps, region);
+    if (bumps == NULL) {
+      continue;
+    }
+
+    // 归纳变量更新之后，紧接着更新指针；循环之前先初始化指针
+    Node head = {0};
+    Node *cur = &head;
+    for (Bump *b = bumps; b; b = b->next) {
+      Node *asn = ptr_asn(b->ptr, b->ptr, NULL, step, s);
+      asn->next = s->next;
+      s->next = asn;
+      cur = cur->next = ptr_asn(b->ptr, b->array, iv, 0, loop);
+    }
+    Node *copy = preheader(loop, head.next);
+    // 同一个循环里可能还有其他的归纳变量
+    loop = copy;
+  }
+}
+
+static void reduce_node(Node *node, Region *region) {
+  if (node == NULL || node->kind == ND_FN) {
+    return;
+  }
+  // 先处理内层的循环
+  reduce_node(node->lhs, region);
+  reduce_node(node->rhs, region);
+  reduce_node(node->cond, region);
+  reduce_node(node->then, region);
+  reduce_node(node->els, region);
+  Node *lists[] = {node->body, node->args, node->elems};
+  for (size_t i = 0; i < sizeof(lists) / sizeof(lists[0]); i++) {
+    for (Node *k = lists[i]; k; k = k->next) {
+      reduce_node(k, region);
+    }
+  }
+  if (node->kind == ND_FOR) {
+    reduce_loop(node, region);
+  }
+}
+
+static bool has_loop(Node *node) {
+  if (node == NULL || node->kind == ND_FN) {
+    return false;
+  }
+  if (node->kind == ND_FOR) {
+    return true;
+  }
+  if (has_loop(node->lhs) || has_loop(node->rhs) || has_loop(node->cond) || has_loop(node->then) ||
+      has_loop(node->els)) {
+    return true;
+  }
+  Node *lists[] = {node->body, node->args, node->elems};
+  for (size_t i = 0; i < sizeof(lists) / sizeof(lists[0]); i++) {
+    for (Node *k = lists[i]; k; k = k->next) {
+      if (has_loop(k)) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+// =============================
+// 循环不变量外提
+// =============================
+
+// 循环里没有副作用的表达式，如果用到的值量在循环里都没有被赋值，那么每次循环的结果都一样，
+// 可以在循环之前只计算一次，存到一个新的局部值量里，循环里直接读取它，例如`for i < n*2 {…}`里的n*2。
+//
+// 读取内存的表达式（*p、a[k]）还要看循环里有没有写内存：调用函数和通过指针写入可能修改任何内存；
+// 写入局部数组只会修改这个数组，不影响对其他局部数组的读取，但读取指针仍然可能读到它。
+// 取过地址的局部值量和全局值量可能通过指针或函数调用修改，也按内存处理。
+//
+// 外提之后，即使循环一次都不执行，表达式也会计算一次，因此可能出错的表达式（读取内存、除数不是常量的除法）
+// 只从循环条件里外提，循环条件至少会计算一次。
+
+typedef struct {
+  Node *loop; // 正在处理的循环
+  bool clobber; // 循环里调用了函数或者通过指针写了内存
+  bool array_stores; // 循环里写了局部数组的元素
+  Node *inits; // 循环之前的赋值，即前置块
+  Node *last; // 前置块里的最后一条赋值
+  Region *region;
+} Hoist;
+
+bool opt_licm = true;
+static int hoist_count; // 新建的值量的编号
+
+static bool is_addressed(Meta *m) {
+  int n = 0;
+  for (Node *k = sr_body; k; k = k->next) {
+    n += count_ops(k, ND_ADDR, m);
+  }
+  return n > 0;
+}
+
+// 下标操作的对象是没有被取过地址的局部数组
+static bool is_local_array(Node *base) {
+  return base->kind == ND_IDENT && base->meta->kind == META_LET && !base->meta->is_global &&
+         base->meta->type->kind == TY_ARRAY && !is_addressed(base->meta);
+}
+
+// 找出循环里写内存的操作
+static void scan_stores(Hoist *h, Node *node) {
+  if (node == NULL || node->kind == ND_FN) {
+    return;
+  }
+  if (node->kind == ND_CALL || node->kind == ND_CTCALL) {
+    h->clobber = true;
+  } else if (node->kind == ND_ASN && node->lhs->kind == ND_DEREF) {
+    h->clobber = true;
+  } else if (node->kind == ND_ASN && node->lhs->kind == ND_INDEX) {
+    if (is_local_array(node->lhs->lhs)) {
+      h->array_stores = true;
+    } else {
+      h->clobber = true;
+    }
+  } else if (node->kind == ND_INTRIN && node->intrin == IN_STORE) {
+    if (is_local_array(node->args)) {
+      h->array_stores = true;
+    } else {
+      h->clobber = true;
+    }
+  }
+  scan_stores(h, node->lhs);
+  scan_stores(h, node->rhs);
+  scan_stores(h, node->cond);
+  scan_stores(h, node->then);
+  scan_stores(h, node->els);
+  Node *lists[] = {node->body, node->args, node->elems};
+  for (size_t i = 0; i < sizeof(lists) / sizeof(lists[0]); i++) {
+    for (Node *k = lists[i]; k; k = k->next) {
+      scan_stores(h, k);
+    }
+  }
+}
+
+// 子树里是否有对数组a的元素的赋值
+static bool stores_into(Node *node, Meta *a) {
+  if (node == NULL || node->kind == ND_FN) {
+    return false;
+  }
+  if (node->kind == ND_ASN && node->lhs->kind == ND_INDEX && node->lhs->lhs->kind == ND_IDENT &&
+      node->lhs->lhs->meta == a) {
+    return true;
+  }
+  if (node->kind == ND_INTRIN && node->intrin == IN_STORE && node->args->kind == ND_IDENT && node->args->meta == a) {
+    return true;
+  }
+  if (stores_into(node->lhs, a) || stores_into(node->rhs, a) || stores_into(node->cond, a) ||
+      stores_into(node->then, a) || stores_into(node->els, a)) {
+    return true;
+  }
+  for (Node *k = node->body; k; k = k->next) {
+    if (stores_into(k, a)) {
+      return true;
+    }
+  }
+  for (Node *k = node->args; k; k = k->next) {
+    if (stores_into(k, a)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool is_invariant(Hoist *h, Node *node) {
+  switch (node->kind) {
+    case ND_NUM:
+    case ND_CHAR:
+    case ND_STR:
+      return true;
+    case ND_IDENT: {
+      Meta *m = node->meta;
+      if (m->kind == META_CONST) {
+        return true;
+      }
+      if (m->kind != META_LET || count_ops(h->loop, ND_ASN, m) > 0) {
+        return false;
+      }
+      return !(m->is_global || is_addressed(m)) || !h->clobber;
+    }
+    case ND_ADDR:
+      return node->rhs->kind == ND_IDENT;
+    case ND_PLUS:
+    case ND_MINUS:
+    case ND_MUL:
+    case ND_DIV:
+    case ND_MOD:
+    case ND_EQ:
+    case ND_NE:
+    case ND_LT:
+    case ND_LE:
+      return is_invariant(h, node->lhs) && is_invariant(h, node->rhs);
+    case ND_NOT:
+    case ND_NEG:
+      return (node->lhs == NULL || is_invariant(h, node->lhs)) && (node->rhs == NULL || is_invariant(h, node->rhs));
+    case ND_DEREF:
+      return !h->clobber && !h->array_stores && is_invariant(h, node->rhs);
+    case ND_INDEX: {
+      if (h->clobber || !is_invariant(h, node->lhs) || !is_invariant(h, node->rhs)) {
+        return false;
+      }
+      if (is_local_array(node->lhs)) {
+        return !stores_into(h->loop, node->lhs->meta);
+      }
+      return !h->array_stores;
+    }
+    default:
+      return false;
+  }
+}
+
+// 可能出错的表达式：读取内存，或者除数不是常量
+static bool may_trap(Node *node) {
+  if (node == NULL) {
+    return false;
+  }
+  if (node->kind == ND_DEREF || node->kind == ND_INDEX) {
+    return true;
+  }
+  if ((node->kind == ND_DIV || node->kind == ND_MOD) && (node->rhs->kind != ND_NUM || node->rhs->val == 0)) {
+    return true;
+  }
+  return may_trap(node->lhs) || may_trap(node->rhs);
+}
+
+static bool worth_hoisting(Hoist *h, Node *node, bool in_cond) {
+  switch (node->kind) {
+    case ND_NUM:
+    case ND_CHAR:
+    case ND_STR:
+    case ND_IDENT:
+    case ND_ADDR:
+      return false;
+    default:
+      break;
+  }
+  Type *ty = node->type;
+  if (!ty || (ty->kind != TY_INT && ty->kind != TY_CHAR && ty->kind != TY_PTR)) {
+    return false;
+  }
+  return is_invariant(h, node) && (in_cond || !may_trap(node));
+}
+
+static bool same_expr(Node *a, Node *b) {
+  if (a == NULL || b == NULL) {
+    return a == b;
+  }
+  return a->kind == b->kind && a->val == b->val && a->cha == b->cha && a->meta == b->meta &&
+         (a->kind != ND_STR || a->str == b->str) && same_expr(a->lhs, b->lhs) && same_expr(a->rhs, b->rhs);
+}
+
+// 把node换成新值量，在前置块里给新值量赋值。同样的表达式只计算一次
+static void hoist(Hoist *h, Node *node) {
+  Meta *t = NULL;
+  for (Node *asn = h->inits; asn; asn = asn->next) {
+    if (same_expr(asn->rhs, node)) {
+      t = asn->lhs->meta;
+      break;
+    }
+  }
+  if (t == NULL) {
+    t = calloc(1, sizeof(Meta));
+    t->kind = META_LET;
+    t->name = format("inv.%d", hoist_count++);
+    // 字符运算的结果在寄存器里是完整的64位整数（例如-('x' - b)），用字符保存会被截断
+    t->type = node->type->kind == TY_CHAR ? TYPE_INT : node->type;
+    t->next = h->region->locals;
+    h->region->locals = t;
+    Node *expr = calloc(1, sizeof(Node));
+    *expr = *node;
+    expr->next = NULL;
+    Node *asn = new_node(ND_ASN, t->type, node);
+    asn->lhs = ident_of(t, node);
+    asn->rhs = expr;
+    if (h->last) {
+      h->last->next = asn;
+    } else {
+      h->inits = asn;
+    }
+    h->last = asn;
+  }
+  Node *next = node->next;
+  *node = *ident_of(t, node);
+  node->next = next;
+}
+
+static void hoist_expr(Hoist *h, Node *node, bool in_cond) {
+  if (node == NULL || node->kind == ND_FN || node->kind == ND_ADDR) {
+    return;
+  }
+  if (worth_hoisting(h, node, in_cond)) {
+    hoist(h, node);
+    return;
+  }
+  if (node->kind == ND_ASN) {
+    // 赋值的左边是存储的位置，不能换成新值量，只处理其中的下标和指针
+    Node *lhs = node->lhs;
+    if (lhs->kind == ND_INDEX) {
+      hoist_expr(h, lhs->lhs, in_cond);
+      hoist_expr(h, lhs->rhs, in_cond);
+    } else if (lhs->kind == ND_DEREF) {
+      hoist_expr(h, lhs->rhs, in_cond);
+    }
+    hoist_expr(h, node->rhs, in_cond);
+    return;
+  }
+  hoist_expr(h, node->lhs, in_cond);
+  hoist_expr(h, node->rhs, in_cond);
+  hoist_expr(h, node->cond, in_cond);
+  // 条件里的if分支不一定执行，例如(if n != 0 {100/n} else {10})，分支里可能出错的表达式不能外提
+  hoist_expr(h, node->then, false);
+  hoist_expr(h, node->els, false);
+  Node *lists[] = {node->body, node->args, node->elems};
+  for (size_t i = 0; i < sizeof(lists) / sizeof(lists[0]); i++) {
+    for (Node *k = lists[i]; k; k = k->next) {
+      hoist_expr(h, k, in_cond);
+    }
+  }
+}
+
+// 返回处理之后的循环：有表达式外提时，循环被换成了代码块{前置块; 循环}
+static Node *hoist_loop(Node *loop, Region *region) {
+  Hoist h = {.loop = loop, .region = region};
+  scan_stores(&h, loop);
+  hoist_expr(&h, loop->cond, true);
+  hoist_expr(&h, loop->body, false);
+  return h.inits ? preheader(loop, h.inits) : loop;
+}
+
+// 先处理外层的循环：外层循环里不变的表达式直接外提到最外面，不用每次外层循环都复制一遍
+static void hoist_node(Node *node, Region *region) {
+  if (node == NULL || node->kind == ND_FN) {
+    return;
+  }
+  if (node->kind == ND_FOR) {
+    node = hoist_loop(node, region);
+  }
+  hoist_node(node->lhs, region);
+  hoist_node(node->rhs, region);
+  hoist_node(node->cond, region);
+  hoist_node(node->then, region);
+  hoist_node(node->els, region);
+  Node *lists[] = {node->body, node->args, node->elems};
+  for (size_t i = 0; i < sizeof(lists) / sizeof(lists[0]); i++) {
+    for (Node *k = lists[i]; k; k = k->next) {
+      hoist_node(k, region);
+    }
+  }
+}
+
+// =============================
+// 循环向量化
+// =============================
+
+// 识别可以向量化的for循环，代码生成时用SIMD指令每次处理多个元素（见codegen.c）。循环必须是下面的形状：
+//
+//   for i < n { 语句; …; i = i + 1 }
+//
+// n是循环里的不变量，i只在最后一条语句里加1。其他语句只能是：
+//   - 逐元素计算：c[i] = E，例如c[i] = a[i] + b[i]，也包括填充c[i] = 0和复制c[i] = a[i]
+//   - 求和：s = s + E或者s = s - E
+//   - 求最小值和最大值：if a[i] < s {s = a[i]}、if s < a[i] {s = a[i]}
+//
+// E由int数组的元素a[i]、不变的整数和加减法、负号组成，数组都是局部或全局的数组（不会互相重叠），
+// 下标都是i，因此每个元素的计算互不依赖。没有64位整数乘法的向量指令，乘法不能向量化。
+
+bool opt_vectorize = true;
+bool vec_report = false;
+
+// 向量寄存器的分配：xmm0到xmm7计算表达式，xmm8到xmm11是归约的累加器，xmm12到xmm15存放不变量
+#define VEC_MAX_TMP 8
+#define VEC_MAX_ACC 4
+#define VEC_MAX_INV 4
+
+typedef struct {
+  Node *loop;
+  Meta *iv;
+  Meta *accs[VEC_MAX_ACC]; // 归约的值量
+  int nacc;
+  Node *invs[VEC_MAX_INV]; // 不变量
+  int ninv;
+  char *reason;
+} VecCheck;
+
+static bool vec_fail(VecCheck *c, char *reason) {
+  if (c->reason == NULL) {
+    c->reason = reason;
+  }
+  return false;
+}
+
+static bool is_int_array(Node *node) {
+  return node->kind == ND_IDENT && node->meta->type->kind == TY_ARRAY && node->meta->type->target->kind == TY_INT;
+}
+
+// a[i]：int数组的元素，下标是归纳变量
+static bool vec_elem(VecCheck *c, Node *node) {
+  if (node->kind != ND_INDEX) {
+    return false;
+  }
+  if (!is_int_array(node->lhs)) {
+    return vec_fail(c, "下标的对象不是int数组");
+  }
+  if (node->rhs->kind != ND_IDENT || node->rhs->meta != c->iv) {
+    return vec_fail(c, "下标不是归纳变量");
+  }
+  return true;
+}
+
+static bool same_leaf(Node *a, Node *b) {
+  return a->kind == b->kind && (a->kind == ND_NUM ? a->val == b->val : a->meta == b->meta);
+}
+
+// 检查表达式E，返回计算需要的向量寄存器个数，不能向量化时返回0
+static int vec_expr(VecCheck *c, Node *node) {
+  switch (node->kind) {
+    case ND_INDEX:
+      return vec_elem(c, node) ? 1 : 0;
+    case ND_NUM:
+    case ND_IDENT: {
+      if (node->kind == ND_IDENT) {
+        Meta *m = node->meta;
+        if (m == c->iv) {
+          return vec_fail(c, "归纳变量不只用作下标");
+        }
+        if ((m->kind != META_LET && m->kind != META_CONST) || m->type->kind != TY_INT) {
+          return vec_fail(c, "用到了int以外的值量");
+        }
+        if (count_ops(c->loop, ND_ASN, m) > 0) {
+          return vec_fail(c, "用到的值量在循环里被赋值");
+        }
+      }
+      for (int k = 0; k < c->ninv; k++) {
+        if (same_leaf(c->invs[k], node)) {
+          return 1;
+        }
+      }
+      if (c->ninv == VEC_MAX_INV) {
+        return vec_fail(c, "不变量太多");
+      }
+      c->invs[c->ninv++] = node;
+      return 1;
+    }
+    case ND_NEG: {
+      // 用0减去运算数，要多用一个寄存器
+      int n = vec_expr(c, node->rhs);
+      if (n == 0) {
+        return 0;
+      }
+      n = n > 2 ? n : 2;
+      return n > VEC_MAX_TMP ? vec_fail(c, "表达式太复杂") : n;
+    }
+    case ND_PLUS:
+    case ND_MINUS: {
+      int l = vec_expr(c, node->lhs);
+      int r = l ? vec_expr(c, node->rhs) : 0;
+      if (!r) {
+        return 0;
+      }
+      // 先算左边，右边的结果放在下一个寄存器里
+      int n = l > r + 1 ? l : r + 1;
+      return n > VEC_MAX_TMP ? vec_fail(c, "表达式太复杂") : n;
+    }
+    case ND_MUL:
+      return vec_fail(c, "64位整数的乘法没有对应的向量指令");
+    default:
+      return vec_fail(c, "表达式里有不支持的运算");
+  }
+}
+
+static bool vec_acc(VecCheck *c, Meta *m) {
+  if (m == c->iv || m->kind != META_LET || m->type->kind != TY_INT) {
+    return vec_fail(c, "归约的值量不是int");
+  }
+  for (int k = 0; k < c->nacc; k++) {
+    if (c->accs[k] == m) {
+      return vec_fail(c, "同一个值量有多处归约");
+    }
+  }
+  if (c->nacc == VEC_MAX_ACC) {
+    return vec_fail(c, "归约的值量太多");
+  }
+  c->accs[c->nacc++] = m;
+  return true;
+}
+
+// 加减法的链条最左边是s时，返回去掉s之后的表达式，例如s + x - y返回x - y
+static Node *without_acc(Node *node, Meta *s) {
+  if (node->kind != ND_PLUS && node->kind != ND_MINUS) {
+    return NULL;
+  }
+  if (node->lhs->kind == ND_IDENT && node->lhs->meta == s) {
+    if (node->kind == ND_PLUS) {
+      return node->rhs;
+    }
+    Node *neg = new_node(ND_NEG, TYPE_INT, node);
+    neg->rhs = node->rhs;
+    return neg;
+  }
+  Node *rest = without_acc(node->lhs, s);
+  if (rest == NULL) {
+    return NULL;
+  }
+  Node *n = new_node(node->kind, TYPE_INT, node);
+  n->lhs = rest;
+  n->rhs = node->rhs;
+  return n;
+}
+
+static VecStmt *vec_stmt(VecCheck *c, Node *node) {
+  VecStmt *vs = calloc(1, sizeof(VecStmt));
+  if (node->kind == ND_ASN && node->lhs->kind == ND_INDEX) {
+    if (!vec_elem(c, node->lhs) || !vec_expr(c, node->rhs)) {
+      return NULL;
+    }
+    vs->kind = VS_STORE;
+    vs->target = node->lhs;
+    vs->expr = node->rhs;
+    return vs;
+  }
+  if (node->kind == ND_ASN && node->lhs->kind == ND_IDENT) {
+    Meta *s = node->lhs->meta;
+    Node *rhs = node->rhs;
+    if (rhs->kind != ND_PLUS && rhs->kind != ND_MINUS) {
+      vec_fail(c, "赋值不是求和的形式");
+      return NULL;
+    }
+    vs->kind = rhs->kind == ND_PLUS ? VS_ADD : VS_SUB;
+    vs->target = node->lhs;
+    Node *rest;
+    if (rhs->lhs->kind == ND_IDENT && rhs->lhs->meta == s) {
+      vs->expr = rhs->rhs;
+    } else if (rhs->kind == ND_PLUS && rhs->rhs->kind == ND_IDENT && rhs->rhs->meta == s) {
+      vs->expr = rhs->lhs;
+    } else if ((rest = without_acc(rhs->lhs, s)) != NULL) {
+      // s + x - y：累加的是(x - y)
+      vs->kind = VS_ADD;
+      vs->expr = new_node(rhs->kind, TYPE_INT, rhs);
+      vs->expr->lhs = rest;
+      vs->expr->rhs = rhs->rhs;
+    } else {
+      vec_fail(c, "赋值不是求和的形式");
+      return NULL;
+    }
+    if (!vec_acc(c, s) || !vec_expr(c, vs->expr)) {
+      return NULL;
+    }
+    // 累加器在循环里不能有其他用处：读取它的表达式会因为它在循环里被赋值而被vec_expr()拒绝
+    if (count_ops(c->loop, ND_ASN, s) != 1) {
+      vec_fail(c, "归约的值量有其他的赋值");
+      return NULL;
+    }
+    return vs;
+  }
+  // if a[i] < s {s = a[i]}
+  if (node->kind == ND_IF && !node->els && (node->cond->kind == ND_LT || node->cond->kind == ND_LE)) {
+    Node *then = node->then;
+    if (then->kind == ND_BLOCK && then->body && !then->body->next) {
+      then = then->body;
+    }
+    Node *l = node->cond->lhs;
+    Node *r = node->cond->rhs;
+    bool is_min = l->kind == ND_INDEX && r->kind == ND_IDENT;
+    Node *elem = is_min ? l : r;
+    Node *acc = is_min ? r : l;
+    if (then->kind == ND_ASN && acc->kind == ND_IDENT && then->lhs->kind == ND_IDENT && then->lhs->meta == acc->meta &&
+        same_expr(then->rhs, elem) && vec_elem(c, elem)) {
+      if (!target_avx2) {
+        vec_fail(c, "SSE2没有64位整数的比较指令，需要-mavx2");
+        return NULL;
+      }
+      if (!vec_acc(c, acc->meta) || count_ops(c->loop, ND_ASN, acc->meta) != 1) {
+        vec_fail(c, "归约的值量有其他的赋值");
+        return NULL;
+      }
+      vs->kind = is_min ? VS_MIN : VS_MAX;
+      vs->target = then->lhs;
+      vs->expr = elem;
+      return vs;
+    }
+  }
+  vec_fail(c, "循环体里有不支持的语句");
+  return NULL;
+}
+
+bool can_vectorize(Node *loop, VecLoop *v, char **reason) {
+  VecCheck c = {.loop = loop};
+  Node *cond = loop->cond;
+  Node *body = loop->body;
+  if (cond == NULL || cond->kind != ND_LT || cond->lhs->kind != ND_IDENT) {
+    *reason = "循环条件不是i < n的形式";
+    return false;
+  }
+  c.iv = cond->lhs->meta;
+  Node *last = body && body->kind == ND_BLOCK ? body->body : NULL;
+  while (last && last->next) {
+    last = last->next;
+  }
+  long step;
+  if (!last || induction_var(last, &step) != c.iv || step != 1 || count_ops(loop, ND_ASN, c.iv) != 1) {
+    *reason = "循环体的最后一条语句不是i = i + 1";
+    return false;
+  }
+  Node *bound = cond->rhs;
+  if (!(bound->kind == ND_NUM || (bound->kind == ND_IDENT && bound->meta->kind != META_FN &&
+                                  bound->meta != c.iv && count_ops(loop, ND_ASN, bound->meta) == 0))) {
+    *reason = "循环的上界在循环里会变化";
+    return false;
+  }
+
+  VecStmt head = {0};
+  VecStmt *cur = &head;
+  for (Node *s = body->body; s != last; s = s->next) {
+    VecStmt *vs = vec_stmt(&c, s);
+    if (!vs) {
+      *reason = c.reason;
+      return false;
+    }
+    cur = cur->next = vs;
+  }
+  if (!head.next) {
+    *reason = "循环体是空的";
+    return false;
+  }
+  v->iv = c.iv;
+  v->bound = bound;
+  v->stmts = head.next;
+  return true;
+}
+
+// 报告循环向量化的结果。节点没有准确的源码位置，用所在的函数和循环条件来指明是哪个循环。
+// 要在强度削减之前报告，强度削减会改写没有向量化的循环
+static void report_vec(Node *node, const char *where) {
+  if (node == NULL || node->kind == ND_FN) {
+    return;
+  }
+  if (node->kind == ND_FOR) {
+    Node *c = node->cond;
+    char *cond = "…";
+    if (c && (c->kind == ND_LT || c->kind == ND_LE) && c->lhs->kind == ND_IDENT) {
+      const char *bound = c->rhs->kind == ND_NUM     ? format("%ld", c->rhs->val)
+                          : c->rhs->kind == ND_IDENT ? c->rhs->name
+                                                     : "…";
+      cond = format("%s %s %s", c->lhs->name, c->kind == ND_LT ? "<" : "<=", bound);
+    }
+    VecLoop v;
+    char *reason;
+    if (can_vectorize(node, &v, &reason)) {
+      fprintf(stderr, "循环向量化：%s里的for %s：已向量化（%s，每次%d个元素）\n", where, cond, target_avx2 ? "AVX2" : "SSE2",
+                     target_avx2 ? 4 : 2);
+    } else {
+      fprintf(stderr, "循环向量化：%s里的for %s：没有向量化，%s\n", where, cond, reason);
+    }
+  }
+  report_vec(node->lhs, where);
+  report_vec(node->rhs, where);
+  report_vec(node->cond, where);
+  report_vec(node->then, where);
+  report_vec(node->els, where);
+  for (Node *k = node->body; k; k = k->next) {
+    report_vec(k, where);
+  }
+}
+
+// =============================
+// 循环优化的入口
+// =============================
+
+// 变换后的函数体只用于生成代码，在副本上进行
+Node *opt_loops(Meta *fn, Node *body, Region *region) {
+  bool loops = false;
+  for (Node *n = body; n; n = n->next) {
+    loops = loops || has_loop(n);
+  }
+  if (!loops) {
+    return body;
+  }
+  sr_body = clone_list(body, NULL);
+  for (Node *n = sr_body; n && opt_licm; n = n->next) {
+    hoist_node(n, region);
+  }
+  for (Node *n = sr_body; n && opt_vectorize && vec_report; n = n->next) {
+    report_vec(n, fn ? format("%s()", fn->name) : "顶层代码");
+  }
+  for (Node *n = sr_body; n; n = n->next) {
+    reduce_node(n, region);
+  }
+  return sr_body;
+}
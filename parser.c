@@ -2,34 +2,49 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
+#include <pthread.h>
 
 #include "zc.h"
 
 Parser *new_parser(Box *box, Lexer *lexer) {
   Parser *parser = calloc(1, sizeof(Parser));
   parser->box = box;
+  parser->scope = box->scope;
+  parser->region = box->region;
   parser->lexer = lexer;
   return parser;
 }
 
 static void enter_scope(Parser *p) {
   Scope *sc = calloc(1, sizeof(Scope));
-  sc->parent = p->box->scope;
-  p->box->scope = sc;
+  sc->parent = p->scope;
+  p->scope = sc;
 }
 
 static void leave_scope(Parser *p) {
-  p->box->scope = p->box->scope->parent;
+  p->scope = p->scope->parent;
+}
+
+// 复制作用域链。之后再往原来的作用域里添加名称，不会影响到复制出来的作用域
+static Scope *freeze_scope(Scope *scope) {
+  if (scope == NULL) {
+    return NULL;
+  }
+  Scope *sc = calloc(1, sizeof(Scope));
+  sc->parent = freeze_scope(scope->parent);
+  sc->spots = scope->spots;
+  return sc;
 }
 
 static void enter_region(Parser *p) {
   Region *r = calloc(1, sizeof(Region));
-  r->parent = p->box->region;
-  p->box->region = r;
+  r->parent = p->region;
+  p->region = r;
 }
 
 static void leave_region(Parser *p) {
-  p->box->region = p->box->region->parent;
+  p->region = p->region->parent;
 }
 
 static const char* const NODE_KIND_NAMES[] = {
@@ -40,6 +55,7 @@ static const char* const NODE_KIND_NAMES[] = {
   [ND_MINUS] = "MINUS",
   [ND_MUL] = "MUL",
   [ND_DIV] = "DIV",
+  [ND_MOD] = "MOD",
   [ND_NOT] = "NOT",
   [ND_EQ] = "EQ",
   [ND_NE] = "NE",
@@ -62,6 +78,7 @@ static const char* const NODE_KIND_NAMES[] = {
   [ND_INDEX] = "INDEX",
   [ND_PATH] = "PATH",
   [ND_TYPE] = "TYPE",
+  [ND_INTRIN] = "INTRIN",
   [ND_UNKNOWN] = "UNKNOWN",
 };
 
@@ -143,6 +160,11 @@ void print_node(Node *node, int level) {
     print_binary(node->lhs, "/", node->rhs, level+1);
     print_level(level);
     break;
+  case ND_MOD:
+    printf("\n");
+    print_binary(node->lhs, "%", node->rhs, level+1);
+    print_level(level);
+    break;
   case ND_EQ:
     printf("\n");
     print_binary(node->lhs, "==", node->rhs, level+1);
@@ -236,6 +258,14 @@ void print_node(Node *node, int level) {
     print_level(level);
     break;
   }
+  case ND_INTRIN: {
+    printf(" %s:%s\n", node->name, type_name(node->type));
+    for (Node *n = node->args; n; n = n->next) {
+      print_node(n, level+1);
+    }
+    print_level(level);
+    break;
+  }
   case ND_BLOCK: {
     printf("\n");
     for (Node *n = node->body; n; n = n->next) {
@@ -298,7 +328,7 @@ static char *token_name(Token *tok) {
 // 查看名符是否已经在locals中记录了。包括所有的量名符和函数名符。
 // TODO：由于现在没有做出hash算法，这里的查找是O(n)的，未来需要改为用哈希查找需要优化。
 static Meta *find_local(Parser *p, Token *tok) {
-  return box_lookup(p->box, token_name(tok));
+  return scope_lookup(p->scope, token_name(tok));
 }
 
 static void advance(Parser *p) {
@@ -309,7 +339,9 @@ static void advance(Parser *p) {
 static Node *new_node(Parser *p, NodeKind kind) {
   Node *node = calloc(1, sizeof(Node));
   node->kind = kind;
-  node->token = &p->cur_tok;
+  // 复制当前的词符：cur_tok会随着解析不断变化，节点要记住自己的位置（报错、分层执行和性能分析都要用到）
+  node->token = malloc(sizeof(Token));
+  *node->token = p->cur_tok;
   return node;
 }
 
@@ -349,8 +381,8 @@ static Spot *set_scope(Parser *p, char *name, Meta *meta) {
   Spot *s = calloc(1, sizeof(Spot));
   s->name = name;
   s->meta = meta;
-  s->next = p->box->scope->spots;
-  p->box->scope->spots = s;
+  s->next = p->scope->spots;
+  p->scope->spots = s;
   return s;
 }
 
@@ -358,8 +390,9 @@ static Spot *set_scope(Parser *p, char *name, Meta *meta) {
 static Meta *new_local(Parser *p, char *name) {
   Meta *meta= calloc(1, sizeof(Meta));
   meta->name = name;
-  meta->next = p->box->region->locals;
-  p->box->region->locals = meta;
+  meta->owner = p->box;
+  meta->next = p->region->locals;
+  p->region->locals = meta;
   set_scope(p, name, meta);
   return meta;
 }
@@ -382,7 +415,7 @@ static bool expect(Parser *p, TokenKind kind, const char* expected) {
     return true;
   }
   error_tok(&p->cur_tok, "expected '%s'\n", expected);
-  exit(1);
+  quit(1);
 }
 
 static void expect_expr_sep(Parser *p) {
@@ -393,7 +426,7 @@ static void expect_expr_sep(Parser *p) {
     return;
   }
   error_tok(&p->prev_tok, "expected ';', newline or EOF\n");
-  exit(1);
+  quit(1);
 }
 
 
@@ -401,6 +434,7 @@ static Node *expr(Parser *p);
 static Node *use(Parser *p);
 static Node *decl(Parser *p);
 static Node *fn(Parser *p);
+static void skip_body(Parser *p, Meta *fmeta);
 static Node *type_decl(Parser *p);
 static Node *asn(Parser *p);
 static Node *equality(Parser *p);
@@ -413,6 +447,7 @@ static Node *primary(Parser *p);
 static Node *array(Parser *p);
 static Node *block(Parser *p);
 static Node *ident_or_call(Parser *p);
+static Node *intrinsic(Parser *p);
 static Node *ct_call(Parser *p);
 static Node *number(Parser *p);
 static Node *character(Parser *p);
@@ -460,36 +495,35 @@ Node *program(Parser *p) {
   Meta *meta= calloc(1, sizeof(Meta));
   meta->kind= META_FN;
   meta->type= fn_type(TYPE_INT);
-  meta->region = p->box->region;
+  meta->region = p->region;
   prog->meta= meta;
   return prog;
 }
 
 static Node *use(Parser *p) {
   Node *node = new_node(p, ND_USE);
+  char *name = token_name(&p->cur_tok);
   // 如果find_local能找到，说明之前已经导入过了
   Meta *meta = find_local(p, &p->cur_tok);
-  // 没有导入过，需要先解析对应的模块文件
+  // 没有导入过，需要先找到对应的模块
   if (meta == NULL) {
     // 先找一下，以免重复导入（多个文件都use同一个模块时，这一步可以避免重复导入）
-    char *name = token_name(&p->cur_tok);
+    // 注意：load_deps()预先并行解析好的模块也是在这里找到的
     Box *box = find_box(name);
-    // 没有找到模块，需要新建模块并导入
+    // 没有找到模块，需要新建模块并解析
     if (box == NULL) {
-      // 注意：暂时只支持从lib目录导入单个文件
-      char path[1024];
-      snprintf(path, sizeof(path), "lib/%s.z", name);
-      box = create_file_box(path);
-      box->name = name;
-      box->path = path;
-      Node *box_tree = parse_file(box);
-      meta = new_local(p, name);
-      meta->kind = META_BOX;
-      meta->body = box_tree;
-      meta->box = box;
+      box = create_lib_box(name);
+      parse_file(box);
+    } else if (!box_ready(box)) {
+      error_tok(&p->cur_tok, "模块之间存在循环依赖：%s", name);
     }
-    node->name = name;
+    add_dep(p->box, box);
+    meta = new_local(p, name);
+    meta->kind = META_BOX;
+    meta->body = box->prog;
+    meta->box = box;
   }
+  node->name = name;
   advance(p);
   return node;
 }
@@ -596,7 +630,7 @@ static Type *type(Parser *p) {
   // 类型名称必然是一个TK_IDENT
   if (!peek(p, TK_IDENT)) {
     error_tok(&p->cur_tok, "expected a type name\n");
-    exit(1);
+    quit(1);
   }
   // 暂时只支持int和char类型
   Type *typ = box_find_type(p->box, token_name(&p->cur_tok));
@@ -608,12 +642,14 @@ static Type *type(Parser *p) {
 static Node *fn(Parser *p) {
   if (p->cur_tok.kind != TK_IDENT) {
     error_tok(&p->cur_tok, "expected function name\n");
-    exit(1);
+    quit(1);
   }
 
   // 把函数定义添加到局部名量中
   Meta *fmeta = new_local(p, token_name(&p->cur_tok));
   fmeta->kind = META_FN;
+  // 记录函数定义的源码位置，从"fn"开始
+  fmeta->src_pos = p->prev_tok.pos;
   advance(p);;
 
   enter_region(p);
@@ -624,7 +660,7 @@ static Node *fn(Parser *p) {
   if (match(p, TK_LPAREN)) {
     Type *cur_param = &param_head;
     while (!match(p, TK_RPAREN)) {
-      if (p->box->region->locals != NULL) {
+      if (p->region->locals != NULL) {
         expect(p, TK_COMMA, "','");
       }
       // 参数名称
@@ -633,22 +669,44 @@ static Node *fn(Parser *p) {
       pmeta->kind = META_LET;
       // 参数类型。在参数里类型是必须的。
       pmeta->type = type(p);
+      if (is_vec(pmeta->type)) {
+        error_tok(&p->prev_tok, "向量暂时不能作为函数的参数\n");
+      }
       cur_param = cur_param->next = copy_type(pmeta->type);
     }
-    fmeta->params = p->box->region->locals;
+    // copy_type()也复制了全局类型列表的next，参数链表要在最后一个参数处结束
+    cur_param->next = NULL;
+    // 新的值量都加在链表的头部，因此要把参数反转回声明的顺序
+    Meta *params = NULL;
+    for (Meta *m = p->region->locals, *next; m; m = next) {
+      next = m->next;
+      m->next = params;
+      params = m;
+    }
+    p->region->locals = params;
+    fmeta->params = params;
   }
 
   fmeta->type = fn_type(TYPE_INT);
   fmeta->type->param_types = param_head.next;
 
-  if (peek(p, TK_LCURLY)) {
+  if (peek(p, TK_LCURLY) && p->box->lazy) {
+    skip_body(p, fmeta);
+  } else if (peek(p, TK_LCURLY)) {
     Node *body = block(p);
     fmeta->body = body;
+    for (Node *n = body->body; n; n = n->next) {
+      if (n->next == NULL && is_vec(n->type)) {
+        error_tok(&p->prev_tok, "向量暂时不能作为函数的返回值\n");
+      }
+    }
+    mark_tail_calls(body);
   } else {
     fmeta->is_decl = true;
   }
 
-  fmeta->region = p->box->region;
+  fmeta->region = p->region;
+  fmeta->src_len = p->prev_tok.pos + p->prev_tok.len - fmeta->src_pos;
   Node *node = new_fn_node(p, fmeta);
   fmeta->def = node;
 
@@ -658,11 +716,89 @@ static Node *fn(Parser *p) {
   return node;
 }
 
+// 延迟解析：记录函数体的位置和当前作用域链的快照，然后跳过配对的花括号。
+// 作用域要冻结下来，这样函数体以后解析时看到的名称，和在这里立即解析时是一样的
+static void skip_body(Parser *p, Meta *fmeta) {
+  fmeta->body_pos = p->cur_tok.pos;
+  fmeta->scope = freeze_scope(p->scope);
+  int depth = 0;
+  do {
+    if (peek(p, TK_EOF)) {
+      error_tok(&p->cur_tok, "函数体缺少'}'\n");
+    }
+    if (peek(p, TK_LCURLY)) {
+      depth++;
+    } else if (peek(p, TK_RCURLY)) {
+      depth--;
+    }
+    advance(p);
+  } while (depth > 0);
+}
+
+// 延迟解析的函数体可能在解析其他模块的线程里用到（编译期调用），因此解析时要加锁。
+// 解析函数体时还可能遇到编译期调用，再次解析其他函数，所以用可重入的锁
+static pthread_mutex_t body_lock;
+static pthread_once_t body_lock_once = PTHREAD_ONCE_INIT;
+
+static void init_body_lock(void) {
+  pthread_mutexattr_t attr;
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_init(&body_lock, &attr);
+  pthread_mutexattr_destroy(&attr);
+}
+
+// 从记录的位置开始解析函数体，并标记类型
+static void parse_body(Meta *m) {
+  Lexer *l = init_src_lexer(m->owner->path, m->body_pos);
+  Parser *p = new_parser(m->owner, l);
+  p->scope = m->scope;
+  p->region = m->region;
+  advance(p);
+  m->body = block(p);
+  m->body_pos = NULL;
+  m->scope = NULL;
+  mark_tail_calls(m->body);
+  for (Node *n = m->body; n; n = n->next) {
+    mark_type(n);
+  }
+}
+
+// 补全函数的定义：延迟解析的函数只解析函数体；只从接口文件加载的函数没有参数和函数体，需要单独解析整个定义
+void load_fn_body(Meta *m) {
+  if (m->body || m->is_decl || !m->src_pos) {
+    return;
+  }
+  pthread_once(&body_lock_once, init_body_lock);
+  pthread_mutex_lock(&body_lock);
+  if (m->body) {
+    // 其他线程已经解析好了
+  } else if (m->body_pos) {
+    parse_body(m);
+  } else {
+    Lexer *l = init_src_lexer(m->owner->path, strndup(m->src_pos, m->src_len));
+    Parser *p = new_parser(m->owner, l);
+    advance(p);
+    expect(p, TK_FN, "fn");
+    Node *node = fn(p);
+    Meta *def = node->meta;
+    m->params = def->params;
+    m->region = def->region;
+    m->def = node;
+    mark_type(node);
+    if (def->body_pos) {
+      parse_body(def);
+    }
+    m->body = def->body;
+  }
+  pthread_mutex_unlock(&body_lock);
+}
+
 // decl = "let" ident (type)? ("=" expr)?
 static Node *decl(Parser *p) {
   if (p->cur_tok.kind != TK_IDENT) {
     error_tok(&p->cur_tok, "expected an identifier\n");
-    exit(1);
+    quit(1);
   }
   Meta *meta = new_local(p, token_name(&p->cur_tok));
   advance(p);;
@@ -685,7 +821,7 @@ static Node *type_decl(Parser *p) {
   // parse type name
   if (p->cur_tok.kind != TK_IDENT) {
     error_tok(&p->cur_tok, "expected a type name\n");
-    exit(1);
+    quit(1);
   }
 
   // type name
@@ -697,7 +833,7 @@ static Node *type_decl(Parser *p) {
   // fields
   if (!match(p, TK_LCURLY)) {
     error_tok(&p->cur_tok, "expected '{' for type decl \n");
-    exit(1);
+    quit(1);
   }
 
   Field head = {0};
@@ -725,7 +861,7 @@ static Node *type_decl(Parser *p) {
 
   if (!match(p, TK_RCURLY)) {
     error_tok(&p->cur_tok, "expected '}' for type decl \n");
-    exit(1);
+    quit(1);
   };
   return node;
 }
@@ -735,7 +871,7 @@ static Node *type_decl(Parser *p) {
 static Node *block(Parser *p) {
   if (!match(p, TK_LCURLY)) {
     error_tok(&p->cur_tok, "expected '{'\n");
-    exit(1);
+    quit(1);
   }
 
   Node head;
@@ -746,11 +882,13 @@ static Node *block(Parser *p) {
   while (!peek(p, TK_RCURLY)) {
     skip_empty(p);
     cur = cur->next = expr(p);
+    // 和顶层代码一样，每条语句解析完就标记类型，后面的语句用到它定义的值量时才有类型
+    mark_type(cur);
     skip_empty(p);
   }
   if (!match(p, TK_RCURLY)) {
     error_tok(&p->cur_tok, "expected '}'\n");
-    exit(1);
+    quit(1);
   }
 
   leave_scope(p);
@@ -883,7 +1021,7 @@ static Node *add(Parser *p) {
   return node;
 }
 
-// mul = unary ("*" unary | "/" unary )*
+// mul = unary ("*" unary | "/" unary | "%" unary )*
 static Node *mul(Parser *p) {
   Node *node = unary(p);
   for (;;) {
@@ -891,6 +1029,8 @@ static Node *mul(Parser *p) {
       node = new_binary(p, ND_MUL, node, unary(p));
     } else if (match(p, TK_SLASH)) {
       node = new_binary(p, ND_DIV, node, unary(p));
+    } else if (match(p, TK_PERCENT)) {
+      node = new_binary(p, ND_MOD, node, unary(p));
     } else {
       return node;
     }
@@ -972,7 +1112,7 @@ static Node *primary(Parser *p) {
     Node *node = expr(p);
     if (!match(p, TK_RPAREN)) {
       error_tok(&p->cur_tok, "expected ')'\n");
-      exit(1);
+      quit(1);
     }
     return node;
   }
@@ -1056,6 +1196,10 @@ static Node *ident_or_call(Parser *p) {
   Meta *meta = find_local(p, &p->cur_tok);
 
   if (meta== NULL) {
+    Node *node = intrinsic(p);
+    if (node) {
+      return node;
+    }
     error_tok(&p->cur_tok, "undefined local identifier: %.*s\n", p->cur_tok.len, p->cur_tok.pos);
   }
 
@@ -1068,6 +1212,183 @@ static Node *ident_or_call(Parser *p) {
   return new_ident_node(p, meta);
 }
 
+// =============================
+// 内建函数
+// =============================
+
+// 向量类型的构造和向量运算用内建函数表示，例如`v4i32(1, 2, 3, 4)`、`v16i8.load(s, i)`、`hsum(v)`。
+// 名称没有定义成值量或函数时才是内建函数，因此程序里的同名值量和函数会覆盖它们。
+// 参数的个数和类型在解析时就检查，元素的下标必须是整数字面量
+
+static const char *const INTRIN_NAMES[] = {
+  [IN_MAKE] = "make",
+  [IN_LOAD] = "load",
+  [IN_STORE] = "store",
+  [IN_LANE] = "lane",
+  [IN_SET_LANE] = "set_lane",
+  [IN_SHUFFLE] = "shuffle",
+  [IN_CMPEQ] = "cmpeq",
+  [IN_MASK] = "mask",
+  [IN_HSUM] = "hsum",
+};
+
+static Node *intrin_arg(Node *node, int i) {
+  Node *arg = node->args;
+  while (arg && i-- > 0) {
+    arg = arg->next;
+  }
+  return arg;
+}
+
+static void expect_vec_arg(Node *node, Node *arg) {
+  if (!is_vec(arg->type)) {
+    error_tok(node->token, "%s()的参数必须是向量\n", node->name);
+  }
+}
+
+// 元素的下标：0到len-1的整数字面量
+static void expect_lane(Node *node, Node *arg, size_t len) {
+  if (arg->kind != ND_NUM || arg->val < 0 || (size_t)arg->val >= len) {
+    error_tok(node->token, "%s()的元素下标必须是0到%zu之间的整数\n", node->name, len - 1);
+  }
+}
+
+// 向量读写的数组：v16i8对应char数组或字符串，v2i64和v4i32对应int数组。
+// v4i32的每个元素读取时截断成32位，写入时符号扩展成int
+static void expect_vec_array(Node *node, Type *vec, Node *arr, Node *idx, bool is_store) {
+  Type *t = arr->type;
+  TypeKind want = vec->len == 16 ? TY_CHAR : TY_INT;
+  bool ok = t && (t->kind == TY_ARRAY || (t->kind == TY_STR && !is_store)) && t->target->kind == want;
+  if (!ok) {
+    error_tok(node->token, "%s只能读写%s数组%s\n", type_name(vec), want == TY_CHAR ? "char" : "int",
+              want == TY_CHAR && !is_store ? "或字符串" : "");
+  }
+  if (!is_num(idx->type)) {
+    error_tok(node->token, "%s()的下标必须是整数\n", node->name);
+  }
+  if (idx->kind == ND_NUM && (idx->val < 0 || (size_t)idx->val + vec->len > t->len)) {
+    error_tok(node->token, "%s()越界：下标%ld开始的%zu个元素超出了数组的长度%zu\n", node->name, idx->val, vec->len,
+              t->len);
+  }
+}
+
+static void check_intrin(Node *node, Type *vec) {
+  int nargs = 0;
+  for (Node *arg = node->args; arg; arg = arg->next) {
+    mark_type(arg);
+    nargs++;
+  }
+  int want;
+  switch (node->intrin) {
+    case IN_MAKE: want = nargs == 1 ? 1 : (int)vec->len; break;
+    case IN_LOAD: want = 2; break;
+    case IN_STORE: want = 3; break;
+    case IN_LANE: want = 2; break;
+    case IN_SET_LANE: want = 3; break;
+    case IN_SHUFFLE:
+      want = node->args && is_vec(node->args->type) ? 1 + (int)node->args->type->len : nargs;
+      break;
+    case IN_CMPEQ: want = 2; break;
+    default: want = 1; break;
+  }
+  if (nargs != want) {
+    const char *name = node->intrin == IN_MAKE ? type_name(vec) : node->name;
+    error_tok(node->token, "%s()需要%d个参数，实际是%d个\n", name, want, nargs);
+  }
+
+  Node *a0 = intrin_arg(node, 0);
+  Node *a1 = intrin_arg(node, 1);
+  Node *a2 = intrin_arg(node, 2);
+  switch (node->intrin) {
+    case IN_MAKE:
+      for (Node *arg = node->args; arg; arg = arg->next) {
+        if (!is_num(arg->type)) {
+          error_tok(node->token, "%s()的参数必须是整数\n", type_name(vec));
+        }
+      }
+      node->type = vec;
+      return;
+    case IN_LOAD:
+      expect_vec_array(node, vec, a0, a1, false);
+      node->type = vec;
+      return;
+    case IN_STORE:
+      expect_vec_arg(node, a2);
+      expect_vec_array(node, a2->type, a0, a1, true);
+      node->type = TYPE_INT;
+      return;
+    case IN_LANE:
+      expect_vec_arg(node, a0);
+      expect_lane(node, a1, a0->type->len);
+      node->type = TYPE_INT;
+      return;
+    case IN_SET_LANE:
+      expect_vec_arg(node, a0);
+      expect_lane(node, a1, a0->type->len);
+      if (!is_num(a2->type)) {
+        error_tok(node->token, "set_lane()的第三个参数必须是整数\n");
+      }
+      node->type = a0->type;
+      return;
+    case IN_SHUFFLE:
+      expect_vec_arg(node, a0);
+      for (Node *arg = a1; arg; arg = arg->next) {
+        expect_lane(node, arg, a0->type->len);
+      }
+      node->type = a0->type;
+      return;
+    case IN_CMPEQ:
+      expect_vec_arg(node, a0);
+      if (!is_vec(a1->type) || a1->type->len != a0->type->len) {
+        error_tok(node->token, "cmpeq()的两个参数必须是同一种向量\n");
+      }
+      node->type = a0->type;
+      return;
+    case IN_MASK:
+    case IN_HSUM:
+      expect_vec_arg(node, a0);
+      node->type = TYPE_INT;
+      return;
+  }
+}
+
+// intrinsic = vec_type "(" args ")"
+//           | vec_type "." "load" "(" args ")"
+//           | intrin_name "(" args ")"
+// 不是内建函数时返回NULL
+static Node *intrinsic(Parser *p) {
+  char *name = token_name(&p->cur_tok);
+  Type *vec = box_find_type(p->box, name);
+  IntrinKind kind = IN_MAKE;
+  if (is_vec(vec)) {
+    advance(p);
+    if (match(p, TK_DOT)) {
+      if (!peek(p, TK_IDENT) || strcmp(token_name(&p->cur_tok), "load") != 0) {
+        error_tok(&p->cur_tok, "向量类型只有load()方法\n");
+      }
+      advance(p);
+      kind = IN_LOAD;
+    }
+  } else {
+    size_t n = sizeof(INTRIN_NAMES) / sizeof(INTRIN_NAMES[0]);
+    for (kind = IN_STORE; (size_t)kind < n && strcmp(INTRIN_NAMES[kind], name) != 0; kind++) {
+    }
+    if ((size_t)kind == n) {
+      return NULL;
+    }
+    advance(p);
+  }
+  if (!peek(p, TK_LPAREN)) {
+    error_tok(&p->cur_tok, "内建函数%s后面需要'('\n", name);
+  }
+  Node *node = call(p, NULL);
+  node->kind = ND_INTRIN;
+  node->intrin = kind;
+  node->name = INTRIN_NAMES[kind];
+  check_intrin(node, vec);
+  return node;
+}
+
 static Node *ct_call(Parser *p) {
   advance(p);; // 跳过'#'
 
@@ -1095,11 +1416,16 @@ static Node *number(Parser *p) {
   return node;
 }
 
-static char *new_uniq_global_name(void) {
-  static int id = 0;
-  char *buf = calloc(1, 20);
-  sprintf(buf, "L..%d", id++);
-  return buf;
+// 常量标签由模块名和模块内的序号组成，这样同一个模块每次编译生成的标签都相同，缓存的汇编代码才能和其他模块一起链接。
+// 注意：模块内的计数器只会被解析该模块的线程使用，因此不需要加锁。
+static char *new_uniq_global_name(Parser *p) {
+  char *name = format("L..%s.%d", p->box->name, p->box->nconst++);
+  for (char *c = name + 3; *c; c++) {
+    if (!isalnum((unsigned char)*c) && *c != '.') {
+      *c = '_';
+    }
+  }
+  return name;
 }
 
 static Node *string(Parser *p) {
@@ -1112,7 +1438,7 @@ static Node *string(Parser *p) {
   Type* type = str_type(p->cur_tok.len);
   node->type = type;
 
-  Meta* meta = new_local(p, new_uniq_global_name());
+  Meta* meta = new_local(p, new_uniq_global_name(p));
   meta->kind = META_CONST;
   meta->type = type;
   meta->str = lit;
@@ -0,0 +1,262 @@
+#define _POSIX_C_SOURCE 200809L
+#include "zc.h"
+#include <time.h>
+
+// 解释器的性能分析（zi --profile）：
+// - 函数：调用次数、包含时间（包括调用的其他函数）和独占时间，用clock_gettime计时。递归调用只在最外层计入包含时间
+// - 节点：解释器每执行一个语法树节点，就给它的hits加1，报告时按源码的行汇总，找出执行最多的行
+// 程序结束时把报告输出到标准错误；指定了--profile-stacks=<文件>时，还把每个调用栈的独占时间（纳秒）
+// 按折叠栈的格式（"main;f;g 1234"）写入文件，可以直接交给flamegraph.pl等火焰图工具。
+// 即时编译的函数只能整体计时，里面的节点不计数。
+
+bool profile_enabled = false;
+char *profile_stacks = NULL;
+
+// 一个函数的统计
+typedef struct FnProf FnProf;
+struct FnProf {
+  FnProf *next;
+  Meta *fn; // 顶层代码是NULL
+  long calls;
+  long total; // 包含时间，纳秒
+  long self; // 独占时间
+  int active; // 在调用栈上的层数，递归时只在最外层计入包含时间
+};
+
+// 调用栈上的一帧
+typedef struct Frame Frame;
+struct Frame {
+  Frame *parent;
+  FnProf *prof;
+  long start;
+  long children; // 调用其他函数用掉的时间
+};
+
+// 一个折叠栈的独占时间
+typedef struct Stack Stack;
+struct Stack {
+  Stack *next;
+  char *key;
+  long self;
+};
+
+static FnProf *fns;
+static Frame *top;
+static Stack *stacks;
+
+static long now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static const char *fn_name(FnProf *p) {
+  return p->fn ? p->fn->name : "main";
+}
+
+static FnProf *find_fn(Meta *fn) {
+  for (FnProf *p = fns; p; p = p->next) {
+    if (p->fn == fn) {
+      return p;
+    }
+  }
+  FnProf *p = calloc(1, sizeof(FnProf));
+  p->fn = fn;
+  p->next = fns;
+  fns = p;
+  return p;
+}
+
+void prof_enter(Meta *fn) {
+  Frame *f = calloc(1, sizeof(Frame));
+  f->prof = find_fn(fn);
+  f->prof->calls++;
+  f->prof->active++;
+  f->parent = top;
+  top = f;
+  f->start = now();
+}
+
+// 当前调用栈的折叠格式：从最外层到最内层，用';'分隔
+static char *stack_key(Frame *f) {
+  if (f->parent == NULL) {
+    return (char *)fn_name(f->prof);
+  }
+  return format("%s;%s", stack_key(f->parent), fn_name(f->prof));
+}
+
+static void add_stack(char *key, long self) {
+  for (Stack *s = stacks; s; s = s->next) {
+    if (strcmp(s->key, key) == 0) {
+      s->self += self;
+      return;
+    }
+  }
+  Stack *s = calloc(1, sizeof(Stack));
+  s->key = key;
+  s->self = self;
+  s->next = stacks;
+  stacks = s;
+}
+
+void prof_exit(void) {
+  Frame *f = top;
+  long total = now() - f->start;
+  long self = total - f->children;
+  f->prof->self += self;
+  if (--f->prof->active == 0) {
+    f->prof->total += total;
+  }
+  if (profile_stacks) {
+    add_stack(stack_key(f), self);
+  }
+  top = f->parent;
+  if (top) {
+    top->children += total;
+  }
+  free(f);
+}
+
+// =============================
+// 报告
+// =============================
+
+// 按源码的行汇总的节点执行次数
+typedef struct Line Line;
+struct Line {
+  Line *next;
+  Lexer *lexer;
+  const char *pos; // 行首
+  int line;
+  long hits;
+};
+
+static Line *lines;
+
+static void count_line(Node *node) {
+  Token *tok = node->token;
+  if (tok == NULL || tok->lexer == NULL || tok->pos == NULL) {
+    return;
+  }
+  const char *pos = tok->pos;
+  while (pos > tok->lexer->line && pos[-1] != '\n') {
+    pos--;
+  }
+  for (Line *l = lines; l; l = l->next) {
+    if (l->pos == pos) {
+      l->hits += node->hits;
+      return;
+    }
+  }
+  Line *l = calloc(1, sizeof(Line));
+  l->lexer = tok->lexer;
+  l->pos = pos;
+  l->line = tok_line(tok);
+  l->hits = node->hits;
+  l->next = lines;
+  lines = l;
+}
+
+static void count_nodes(Node *node) {
+  if (node == NULL) {
+    return;
+  }
+  if (node->hits) {
+    count_line(node);
+  }
+  count_nodes(node->lhs);
+  count_nodes(node->rhs);
+  count_nodes(node->cond);
+  count_nodes(node->then);
+  count_nodes(node->els);
+  for (Node *n = node->body; n; n = n->next) {
+    count_nodes(n);
+  }
+  for (Node *n = node->args; n; n = n->next) {
+    count_nodes(n);
+  }
+  for (Node *n = node->elems; n; n = n->next) {
+    count_nodes(n);
+  }
+}
+
+static int by_self(const void *a, const void *b) {
+  long x = (*(FnProf **)a)->self;
+  long y = (*(FnProf **)b)->self;
+  return x < y ? 1 : x > y ? -1 : 0;
+}
+
+static int by_hits(const void *a, const void *b) {
+  long x = (*(Line **)a)->hits;
+  long y = (*(Line **)b)->hits;
+  return x < y ? 1 : x > y ? -1 : 0;
+}
+
+static void report_fns(void) {
+  int n = 0;
+  for (FnProf *p = fns; p; p = p->next) {
+    n++;
+  }
+  FnProf *sorted[n];
+  int i = 0;
+  for (FnProf *p = fns; p; p = p->next) {
+    sorted[i++] = p;
+  }
+  qsort(sorted, n, sizeof(FnProf *), by_self);
+  fprintf(stderr, "【性能分析】函数（按独占时间排序）：\n");
+  fprintf(stderr, "    调用次数   包含时间(ms)   独占时间(ms)  函数\n");
+  for (i = 0; i < n; i++) {
+    FnProf *p = sorted[i];
+    fprintf(stderr, "%12ld %14.3f %14.3f  %s\n", p->calls, p->total / 1e6, p->self / 1e6, fn_name(p));
+  }
+}
+
+// 只列出执行最多的行
+#define MAX_HOT_LINES 10
+
+static void report_lines(Node *prog) {
+  count_nodes(prog);
+  for (FnProf *p = fns; p; p = p->next) {
+    if (p->fn) {
+      count_nodes(p->fn->body);
+    }
+  }
+  int n = 0;
+  for (Line *l = lines; l; l = l->next) {
+    n++;
+  }
+  Line *sorted[n + 1];
+  int i = 0;
+  for (Line *l = lines; l; l = l->next) {
+    sorted[i++] = l;
+  }
+  qsort(sorted, n, sizeof(Line *), by_hits);
+  fprintf(stderr, "【性能分析】热点（按节点的执行次数排序）：\n");
+  fprintf(stderr, "    执行次数  位置\n");
+  for (i = 0; i < n && i < MAX_HOT_LINES; i++) {
+    Line *l = sorted[i];
+    int len = strcspn(l->pos, "\n");
+    fprintf(stderr, "%12ld  %s:%d: %.*s\n", l->hits, l->lexer->file ? l->lexer->file : "-", l->line, len > 60 ? 60 : len, l->pos);
+  }
+}
+
+static void write_stacks(void) {
+  FILE *out = fopen(profile_stacks, "w");
+  if (out == NULL) {
+    fprintf(stderr, "【性能分析】无法写入折叠栈文件：%s\n", profile_stacks);
+    return;
+  }
+  for (Stack *s = stacks; s; s = s->next) {
+    fprintf(out, "%s %ld\n", s->key, s->self);
+  }
+  fclose(out);
+  fprintf(stderr, "【性能分析】折叠栈已写入%s\n", profile_stacks);
+}
+
+void prof_report(Node *prog) {
+  report_fns();
+  report_lines(prog);
+  if (profile_stacks) {
+    write_stacks();
+  }
+}
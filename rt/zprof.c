@@ -0,0 +1,57 @@
+// zc --instrument的运行时：程序退出时把每个函数的调用次数和周期数写入报告。
+// 生成的汇编给每个函数在.bss里留4个计数，并在zprof段里放一条记录（函数名、计数的地址），
+// 链接器会为这个段生成__start_zprof和__stop_zprof，这里遍历它们就能找到所有插桩的函数，包括其他模块里的。
+//
+// 报告默认写到zprof.out，可以用环境变量ZPROF_OUT指定别的文件。格式是纯文本，方便作为PGO的输入：
+// 以'#'开头的是注释，其余每行是一个函数：函数名 调用次数 周期数，按周期数从多到少排列。
+// 周期数是rdtsc计的包含时间，递归只在最外层计入。
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef struct {
+  long calls;
+  long cycles;
+  long depth;
+  long start;
+} Counters;
+
+typedef struct {
+  const char *name;
+  Counters *counters;
+} Entry;
+
+extern Entry __start_zprof[] __attribute__((weak));
+extern Entry __stop_zprof[] __attribute__((weak));
+
+static int by_cycles(const void *a, const void *b) {
+  long x = ((const Entry *)a)->counters->cycles;
+  long y = ((const Entry *)b)->counters->cycles;
+  return x < y ? 1 : x > y ? -1 : 0;
+}
+
+static void zprof_dump(void) {
+  size_t n = __stop_zprof - __start_zprof;
+  if (n == 0) {
+    return;
+  }
+  const char *path = getenv("ZPROF_OUT");
+  if (path == NULL || *path == '\0') {
+    path = "zprof.out";
+  }
+  FILE *out = fopen(path, "w");
+  if (out == NULL) {
+    return;
+  }
+  qsort(__start_zprof, n, sizeof(Entry), by_cycles);
+  fprintf(out, "# zprof 1\n");
+  fprintf(out, "# 函数 调用次数 周期数\n");
+  for (size_t i = 0; i < n; i++) {
+    Entry *e = &__start_zprof[i];
+    fprintf(out, "%s %ld %ld\n", e->name, e->counters->calls, e->counters->cycles);
+  }
+  fclose(out);
+}
+
+__attribute__((constructor)) static void zprof_init(void) {
+  atexit(zprof_dump);
+}
@@ -0,0 +1,290 @@
+#define _POSIX_C_SOURCE 200809L
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "zc.h"
+
+// 编译服务器（代码工厂）：常驻进程，在本地套接字上接收编译和求值请求。
+// 解析好的依赖模块常驻在服务器中，每次请求只重新解析源码文件有变化的模块（以及依赖它们的模块）；
+// 生成的汇编由编译缓存（见cache.c）保存，项目完全没有变化时，直接回复app.exe已是最新。
+//
+// 主模块的解析、代码生成和解释执行都在fork出来的子进程里进行：
+// 子进程继承了常驻的模块，出错退出也不会影响服务器。
+// 依赖模块在服务器进程里解析，出错时通过error_jmp跳回主循环，并丢掉所有常驻的模块。
+//
+// 请求的格式：`<命令> <参数长度>\n<参数><正文>`，正文一直到客户端关闭写端为止，用来传递标准输入。
+// 回复的格式：命令的输出（包括标准错误），然后是一个'\0'和十进制的退出码。
+
+#define SOCKET_PATH ".zc.sock"
+
+static const char *socket_path(void) {
+  char *path = getenv("ZC_SOCKET");
+  return path ? path : SOCKET_PATH;
+}
+
+// 最近一次成功编译的结果。app.exe只有一个，因此只需要记住最近的一次
+static struct {
+  char *file;
+  long mtime;
+  long exe_mtime;
+} last;
+
+// 读入客户端发来的全部内容
+static char *read_all(int fd, size_t *len) {
+  char *buf;
+  FILE *out = open_memstream(&buf, len);
+  char chunk[4096];
+  ssize_t n;
+  while ((n = read(fd, chunk, sizeof(chunk))) > 0) {
+    fwrite(chunk, 1, n, out);
+  }
+  fclose(out);
+  return buf;
+}
+
+// 与read_file()一样，保证源码末尾有一个'\n'
+static char *src_text(char *body) {
+  size_t len = strlen(body);
+  if (len == 0 || body[len - 1] != '\n') {
+    return format("%s\n", body);
+  }
+  return body;
+}
+
+// 在子进程中执行f，等待它结束并返回退出码
+static int run_child(Box *b, const char *arg, int (*f)(Box *b, const char *arg)) {
+  fflush(stdout);
+  fflush(stderr);
+  pid_t pid = fork();
+  if (pid == 0) {
+    // 子进程出错时直接退出，不能跳回服务器的主循环
+    error_jmp = NULL;
+    int code = f(b, arg);
+    fflush(stdout);
+    exit(code);
+  }
+  int status;
+  if (pid < 0 || waitpid(pid, &status, 0) < 0) {
+    return 1;
+  }
+  return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
+
+static int do_build(Box *b, const char *arg) {
+  (void)arg;
+  prune_boxes(b);
+  return build(b) == 0 ? 0 : 1;
+}
+
+static int do_eval(Box *b, const char *src) {
+  prune_boxes(b);
+  Node *prog = parse_code(b, src);
+  fold_consts(prog);
+  return exit_code(interpret(prog));
+}
+
+static int serve_compile(const char *file, char *body) {
+  bool is_stdin = strcmp(file, "-") == 0;
+  long mtime = is_stdin ? -1 : file_mtime(file);
+  int dropped = drop_changed_boxes();
+  if (!is_stdin && dropped == 0 && last.file && strcmp(last.file, file) == 0 &&
+      last.mtime == mtime && last.exe_mtime == file_mtime("app.exe")) {
+    printf("app.exe已是最新\n");
+    return 0;
+  }
+  last.file = NULL;
+  // 和compile()一样，出错时不能留下旧的app.exe
+  remove("app.exe");
+
+  Box *b = create_file_box(strdup(file));
+  if (is_stdin) {
+    b->src = src_text(body);
+  }
+  load_deps(b);
+  stamp_boxes();
+  // 主模块每次都重新解析，不常驻
+  drop_box(b);
+  int code = run_child(b, file, do_build);
+  if (code == 0 && !is_stdin) {
+    last.file = strdup(file);
+    last.mtime = mtime;
+    last.exe_mtime = file_mtime("app.exe");
+  }
+  return code;
+}
+
+static int serve_eval(const char *src, char *body) {
+  drop_changed_boxes();
+  // 源码是"-"时，要求值的是客户端的标准输入
+  if (strcmp(src, "-") == 0) {
+    src = src_text(body);
+  }
+  Box *b = create_code_box();
+  b->src = is_src_file(src) ? read_file(src) : src_text((char *)src);
+  load_deps(b);
+  stamp_boxes();
+  drop_box(b);
+  b->src = NULL;
+  return run_child(b, src, do_eval);
+}
+
+static int dispatch(const char *cmd, const char *arg, char *body) {
+  if (strcmp(cmd, "compile") == 0) {
+    return serve_compile(arg, body);
+  }
+  if (strcmp(cmd, "eval") == 0) {
+    return serve_eval(arg, body);
+  }
+  fprintf(stderr, "【服务器错误】：未知的命令：%s\n", cmd);
+  return 1;
+}
+
+// 执行一个请求。解析依赖模块出错时，模块可能只解析了一半，因此丢掉所有常驻的模块，下次请求重新加载
+static int handle(const char *cmd, const char *arg, char *body) {
+  jmp_buf env;
+  int code = setjmp(env);
+  if (code != 0) {
+    error_jmp = NULL;
+    init_root_box();
+    last.file = NULL;
+    return code;
+  }
+  error_jmp = &env;
+  int ret = dispatch(cmd, arg, body);
+  error_jmp = NULL;
+  return ret;
+}
+
+// 处理一个连接，返回false表示要停止服务器
+static bool serve_conn(int fd) {
+  size_t len;
+  char *req = read_all(fd, &len);
+  char cmd[16];
+  size_t arg_len;
+  char *nl = memchr(req, '\n', len);
+  size_t n = nl ? (size_t)(nl - req) + 1 : 0;
+  if (!nl || sscanf(req, "%15s %zu", cmd, &arg_len) != 2 || n + arg_len > len) {
+    free(req);
+    return true;
+  }
+  if (strcmp(cmd, "stop") == 0) {
+    free(req);
+    return false;
+  }
+  char *arg = strndup(req + n, arg_len);
+  char *body = req + n + arg_len;
+
+  // 请求的输出直接写给客户端
+  fflush(stdout);
+  fflush(stderr);
+  int out = dup(STDOUT_FILENO);
+  int err = dup(STDERR_FILENO);
+  dup2(fd, STDOUT_FILENO);
+  dup2(fd, STDERR_FILENO);
+  int code = handle(cmd, arg, body);
+  fflush(stdout);
+  fflush(stderr);
+  dup2(out, STDOUT_FILENO);
+  dup2(err, STDERR_FILENO);
+  close(out);
+  close(err);
+
+  char trailer[16];
+  int tn = snprintf(trailer, sizeof(trailer), "%c%d", '\0', code);
+  if (write(fd, trailer, tn) < 0) {
+    fprintf(stderr, "【服务器错误】：无法回复客户端\n");
+  }
+  return true;
+}
+
+void serve(void) {
+  // 客户端提前断开时，不要因为SIGPIPE退出
+  signal(SIGPIPE, SIG_IGN);
+  // 出错时要用longjmp跳回主循环，因此只能在当前线程里解析模块
+  setenv("ZC_JOBS", "1", 1);
+
+  const char *path = socket_path();
+  int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+  struct sockaddr_un addr = {.sun_family = AF_UNIX};
+  snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+  unlink(path);
+  if (sock < 0 || bind(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(sock, 16) != 0) {
+    fprintf(stderr, "【服务器错误】：无法监听套接字：%s\n", path);
+    exit(1);
+  }
+  printf("编译服务器已启动：%s\n", path);
+  fflush(stdout);
+
+  init_root_box();
+  for (;;) {
+    int fd = accept(sock, NULL, NULL);
+    if (fd < 0) {
+      continue;
+    }
+    bool more = serve_conn(fd);
+    close(fd);
+    if (!more) {
+      break;
+    }
+  }
+  close(sock);
+  unlink(path);
+  printf("编译服务器已停止\n");
+}
+
+// =============================
+// 客户端
+// =============================
+
+static bool write_all(int fd, const char *buf, size_t len) {
+  while (len > 0) {
+    ssize_t n = write(fd, buf, len);
+    if (n <= 0) {
+      return false;
+    }
+    buf += n;
+    len -= n;
+  }
+  return true;
+}
+
+int remote(const char *cmd, const char *arg) {
+  const char *path = socket_path();
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  struct sockaddr_un addr = {.sun_family = AF_UNIX};
+  snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+  if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+    fprintf(stderr, "【客户端错误】：无法连接编译服务器：%s，请先运行`./zc.exe serve`\n", path);
+    return 1;
+  }
+
+  char *head = format("%s %zu\n", cmd, strlen(arg));
+  bool ok = write_all(fd, head, strlen(head)) && write_all(fd, arg, strlen(arg));
+  // 源码是"-"时，把标准输入也发给服务器
+  if (ok && strcmp(arg, "-") == 0) {
+    char buf[4096];
+    size_t n;
+    while (ok && (n = fread(buf, 1, sizeof(buf), stdin)) > 0) {
+      ok = write_all(fd, buf, n);
+    }
+  }
+  shutdown(fd, SHUT_WR);
+
+  // 输出服务器的回复，直到遇到'\0'，后面是退出码
+  size_t len;
+  char *reply = read_all(fd, &len);
+  close(fd);
+  size_t out = strnlen(reply, len);
+  fwrite(reply, 1, out, stdout);
+  if (strcmp(cmd, "stop") == 0) {
+    return 0;
+  }
+  if (!ok || out == len) {
+    fprintf(stderr, "【客户端错误】：编译服务器没有正常回复\n");
+    return 1;
+  }
+  return atoi(reply + out + 1);
+}
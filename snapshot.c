@@ -0,0 +1,485 @@
+#define _POSIX_C_SOURCE 200809L
+#include <fcntl.h>
+#include <stddef.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "zc.h"
+
+// AST快照：把解析并标记好类型的语法树（包括节点、值量、类型、作用域、模块和源码）原样写入源码旁边的文件。
+// 下次解释同一个脚本时，只需要映射快照文件，再修正其中的指针，就能直接解释执行，不需要重新词法分析和语法分析。
+//
+// 文件格式：
+//   Header | 数据区 | 重定位表
+// 数据区中的每个对象都是内存中结构体的原样拷贝，按8字节对齐。对象中的指针字段存放的是目标对象在数据区中的偏移量，
+// 重定位表记录了所有指针字段的位置，加载时逐个加上数据区的基地址即可。
+// 指向内置类型（int、char）的指针不能这样处理，它们在重定位表里有单独的标记。
+//
+// 注意：结构体里增加指针字段时，需要同步修改下面对应的fix_xxx()函数。
+
+#define SNAP_MAGIC "ZAS7"
+
+typedef struct {
+  char magic[4];
+  uint32_t nfiles; // 校验的源码文件数量，文件哈希紧跟在Header之后
+  uint64_t data_size;
+  uint64_t nrelocs;
+  uint64_t root; // 根节点的偏移量
+} SnapHeader;
+
+// 重定位项：低2位是标记，其余是指针字段的偏移量
+typedef enum {
+  RELOC_DATA, // 指向数据区内部
+  RELOC_INT, // 指向TYPE_INT
+  RELOC_CHAR, // 指向TYPE_CHAR
+} RelocTag;
+
+typedef enum {
+  OBJ_STR,
+  OBJ_NODE,
+  OBJ_META,
+  OBJ_TYPE,
+  OBJ_FIELD,
+  OBJ_REGION,
+  OBJ_SCOPE,
+  OBJ_SPOT,
+  OBJ_TOKEN,
+  OBJ_LEXER,
+  OBJ_BOX,
+  OBJ_BOXLIST,
+  OBJ_NODELINK,
+} ObjKind;
+
+static const size_t OBJ_SIZES[] = {
+  [OBJ_NODE] = sizeof(Node),
+  [OBJ_META] = sizeof(Meta),
+  [OBJ_TYPE] = sizeof(Type),
+  [OBJ_FIELD] = sizeof(Field),
+  [OBJ_REGION] = sizeof(Region),
+  [OBJ_SCOPE] = sizeof(Scope),
+  [OBJ_SPOT] = sizeof(Spot),
+  [OBJ_TOKEN] = sizeof(Token),
+  [OBJ_LEXER] = sizeof(Lexer),
+  [OBJ_BOX] = sizeof(Box),
+  [OBJ_BOXLIST] = sizeof(BoxList),
+  [OBJ_NODELINK] = sizeof(NodeLink),
+};
+
+// =============================
+// 写入
+// =============================
+
+// 已写入对象的哈希表：对象地址 -> 数据区偏移量
+typedef struct {
+  const void *key;
+  size_t off;
+} ObjSlot;
+
+// 等待修正指针字段的对象
+typedef struct {
+  size_t off;
+  ObjKind kind;
+} Pending;
+
+typedef struct {
+  char *data;
+  size_t len;
+  size_t cap;
+
+  ObjSlot *slots;
+  size_t nslots;
+  size_t used;
+
+  uint64_t *relocs;
+  size_t nrelocs;
+  size_t cap_relocs;
+
+  Pending *pending;
+  size_t npending;
+  size_t cap_pending;
+
+  // 所有模块的源码。源码中间的指针（如词符位置）记录为源码对象的偏移量加上相对位置
+  Box *boxes;
+  const char **srcs;
+  size_t *src_lens;
+  int nsrcs;
+} Writer;
+
+static size_t slot_index(Writer *w, const void *key) {
+  size_t i = ((uintptr_t)key >> 3) * 0x9E3779B97F4A7C15ULL % w->nslots;
+  while (w->slots[i].key && w->slots[i].key != key) {
+    i = (i + 1) % w->nslots;
+  }
+  return i;
+}
+
+static void grow_slots(Writer *w) {
+  ObjSlot *old = w->slots;
+  size_t n = w->nslots;
+  w->nslots = n ? n * 2 : 1024;
+  w->slots = calloc(w->nslots, sizeof(ObjSlot));
+  for (size_t i = 0; i < n; i++) {
+    if (old[i].key) {
+      w->slots[slot_index(w, old[i].key)] = old[i];
+    }
+  }
+  free(old);
+}
+
+static size_t reserve(Writer *w, size_t size) {
+  size_t off = (w->len + 7) & ~(size_t)7;
+  while (off + size > w->cap) {
+    w->cap = w->cap ? w->cap * 2 : 4096;
+    w->data = realloc(w->data, w->cap);
+  }
+  memset(w->data + w->len, 0, off + size - w->len);
+  w->len = off + size;
+  return off;
+}
+
+static void add_reloc(Writer *w, size_t field, RelocTag tag) {
+  if (w->nrelocs == w->cap_relocs) {
+    w->cap_relocs = w->cap_relocs ? w->cap_relocs * 2 : 1024;
+    w->relocs = realloc(w->relocs, w->cap_relocs * sizeof(uint64_t));
+  }
+  w->relocs[w->nrelocs++] = (uint64_t)field << 2 | tag;
+}
+
+// 把对象拷贝到数据区，返回它的偏移量。对象的指针字段稍后由fix_pending()修正
+static size_t put_obj(Writer *w, const void *obj, ObjKind kind) {
+  if (w->used * 2 >= w->nslots) {
+    grow_slots(w);
+  }
+  size_t i = slot_index(w, obj);
+  if (w->slots[i].key) {
+    return w->slots[i].off;
+  }
+
+  size_t size = kind == OBJ_STR ? strlen(obj) + 1 : OBJ_SIZES[kind];
+  size_t off = reserve(w, size);
+  memcpy(w->data + off, obj, size);
+  w->slots[i] = (ObjSlot){obj, off};
+  w->used++;
+
+  if (kind != OBJ_STR) {
+    if (w->npending == w->cap_pending) {
+      w->cap_pending = w->cap_pending ? w->cap_pending * 2 : 1024;
+      w->pending = realloc(w->pending, w->cap_pending * sizeof(Pending));
+    }
+    w->pending[w->npending++] = (Pending){off, kind};
+  }
+  return off;
+}
+
+// 修正数据区中off处的指针字段，它原本指向ptr
+static void fix_ptr(Writer *w, size_t field, const void *ptr, ObjKind kind) {
+  void *val = NULL;
+  if (ptr == NULL) {
+    memcpy(w->data + field, &val, sizeof(val));
+    return;
+  }
+  if (kind == OBJ_TYPE && (ptr == TYPE_INT || ptr == TYPE_CHAR)) {
+    memcpy(w->data + field, &val, sizeof(val));
+    add_reloc(w, field, ptr == TYPE_INT ? RELOC_INT : RELOC_CHAR);
+    return;
+  }
+
+  size_t off = 0;
+  bool found = false;
+  // 源码中间的指针
+  if (kind == OBJ_STR) {
+    const char *p = ptr;
+    for (int i = 0; i < w->nsrcs; i++) {
+      if (p >= w->srcs[i] && p <= w->srcs[i] + w->src_lens[i]) {
+        off = put_obj(w, w->srcs[i], OBJ_STR) + (p - w->srcs[i]);
+        found = true;
+        break;
+      }
+    }
+  }
+  if (!found) {
+    off = put_obj(w, ptr, kind);
+  }
+  val = (void *)off;
+  memcpy(w->data + field, &val, sizeof(val));
+  add_reloc(w, field, RELOC_DATA);
+}
+
+#define FIX(obj_off, type, field, kind) \
+  fix_ptr(w, (obj_off) + offsetof(type, field), ((type *)(w->data + (obj_off)))->field, kind)
+
+static void fix_token(Writer *w, size_t off) {
+  FIX(off, Token, pos, OBJ_STR);
+  FIX(off, Token, lexer, OBJ_LEXER);
+}
+
+static void fix_pending(Writer *w, Pending pd) {
+  size_t off = pd.off;
+  switch (pd.kind) {
+  case OBJ_NODE:
+    FIX(off, Node, type, OBJ_TYPE);
+    FIX(off, Node, token, OBJ_TOKEN);
+    FIX(off, Node, name, OBJ_STR);
+    FIX(off, Node, next, OBJ_NODE);
+    FIX(off, Node, lhs, OBJ_NODE);
+    FIX(off, Node, rhs, OBJ_NODE);
+    FIX(off, Node, body, OBJ_NODE);
+    FIX(off, Node, cond, OBJ_NODE);
+    FIX(off, Node, then, OBJ_NODE);
+    FIX(off, Node, els, OBJ_NODE);
+    FIX(off, Node, meta, OBJ_META);
+    FIX(off, Node, args, OBJ_NODE);
+    FIX(off, Node, elems, OBJ_NODE);
+    FIX(off, Node, str, OBJ_STR);
+    FIX(off, Node, field, OBJ_FIELD);
+    return;
+  case OBJ_META:
+    FIX(off, Meta, next, OBJ_META);
+    FIX(off, Meta, name, OBJ_STR);
+    FIX(off, Meta, type, OBJ_TYPE);
+    FIX(off, Meta, owner, OBJ_BOX);
+    FIX(off, Meta, body, OBJ_NODE);
+    FIX(off, Meta, params, OBJ_META);
+    FIX(off, Meta, region, OBJ_REGION);
+    FIX(off, Meta, def, OBJ_NODE);
+    FIX(off, Meta, src_pos, OBJ_STR);
+    FIX(off, Meta, body_pos, OBJ_STR);
+    FIX(off, Meta, scope, OBJ_SCOPE);
+    FIX(off, Meta, str, OBJ_STR);
+    FIX(off, Meta, box, OBJ_BOX);
+    FIX(off, Meta, ref, OBJ_META);
+    return;
+  case OBJ_TYPE:
+    fix_token(w, off + offsetof(Type, token));
+    FIX(off, Type, name, OBJ_STR);
+    FIX(off, Type, target, OBJ_TYPE);
+    FIX(off, Type, ret_type, OBJ_TYPE);
+    FIX(off, Type, param_types, OBJ_TYPE);
+    FIX(off, Type, fields, OBJ_FIELD);
+    FIX(off, Type, next, OBJ_TYPE);
+    return;
+  case OBJ_FIELD:
+    FIX(off, Field, next, OBJ_FIELD);
+    FIX(off, Field, ty, OBJ_TYPE);
+    FIX(off, Field, name, OBJ_STR);
+    return;
+  case OBJ_REGION:
+    FIX(off, Region, parent, OBJ_REGION);
+    FIX(off, Region, locals, OBJ_META);
+    return;
+  case OBJ_SCOPE:
+    FIX(off, Scope, parent, OBJ_SCOPE);
+    FIX(off, Scope, spots, OBJ_SPOT);
+    return;
+  case OBJ_SPOT:
+    FIX(off, Spot, next, OBJ_SPOT);
+    FIX(off, Spot, name, OBJ_STR);
+    FIX(off, Spot, meta, OBJ_META);
+    return;
+  case OBJ_TOKEN:
+    fix_token(w, off);
+    return;
+  case OBJ_LEXER:
+    FIX(off, Lexer, file, OBJ_STR);
+    FIX(off, Lexer, line, OBJ_STR);
+    FIX(off, Lexer, start, OBJ_STR);
+    FIX(off, Lexer, current, OBJ_STR);
+    return;
+  case OBJ_BOX:
+    FIX(off, Box, name, OBJ_STR);
+    FIX(off, Box, path, OBJ_STR);
+    FIX(off, Box, src, OBJ_STR);
+    FIX(off, Box, nodes, OBJ_NODELINK);
+    FIX(off, Box, prog, OBJ_NODE);
+    FIX(off, Box, children, OBJ_BOX);
+    FIX(off, Box, used, OBJ_SPOT);
+    FIX(off, Box, next, OBJ_BOX);
+    FIX(off, Box, deps, OBJ_BOXLIST);
+    FIX(off, Box, global, OBJ_REGION);
+    FIX(off, Box, region, OBJ_REGION);
+    FIX(off, Box, scope, OBJ_SCOPE);
+    FIX(off, Box, types, OBJ_TYPE);
+    return;
+  case OBJ_BOXLIST:
+    FIX(off, BoxList, next, OBJ_BOXLIST);
+    FIX(off, BoxList, box, OBJ_BOX);
+    return;
+  case OBJ_NODELINK:
+    FIX(off, NodeLink, head, OBJ_NODE);
+    FIX(off, NodeLink, tail, OBJ_NODE);
+    return;
+  case OBJ_STR:
+    return;
+  }
+}
+
+static char *snapshot_path(const char *file) {
+  return format("%s.ast", file);
+}
+
+static uint64_t src_hash(const char *src) {
+  return hash_str(src, hash_str(ZC_VERSION, 0));
+}
+
+// 快照依赖的所有源码文件：文件名和源码哈希。源码模块的文件就是file
+static void put_file_hashes(FILE *out, const char *file, Box *boxes, uint32_t *n) {
+  *n = 0;
+  for (Box *b = boxes; b; b = b->next) {
+    if (!b->src) {
+      continue;
+    }
+    const char *path = b->kind == BOX_CODE ? file : b->path;
+    uint64_t h = src_hash(b->src);
+    uint32_t len = strlen(path);
+    fwrite(&h, sizeof(h), 1, out);
+    fwrite(&len, sizeof(len), 1, out);
+    fwrite(path, 1, len, out);
+    (*n)++;
+  }
+}
+
+void save_snapshot(const char *file, Node *prog) {
+  if (strcmp(file, "-") == 0) {
+    return;
+  }
+  Writer w = {0};
+  w.boxes = all_boxes();
+  for (Box *b = w.boxes; b; b = b->next) {
+    w.nsrcs++;
+  }
+  w.srcs = calloc(w.nsrcs, sizeof(char*));
+  w.src_lens = calloc(w.nsrcs, sizeof(size_t));
+  w.nsrcs = 0;
+  for (Box *b = w.boxes; b; b = b->next) {
+    if (b->src) {
+      w.srcs[w.nsrcs] = b->src;
+      w.src_lens[w.nsrcs++] = strlen(b->src);
+    }
+  }
+  size_t root = put_obj(&w, prog, OBJ_NODE);
+  // 注意：修正指针时还会继续添加新对象，因此这里每次都要重新读取npending
+  for (size_t i = 0; i < w.npending; i++) {
+    fix_pending(&w, w.pending[i]);
+  }
+
+  char *path = snapshot_path(file);
+  char *tmp = format("%s.%d.tmp", path, (int)getpid());
+  FILE *out = fopen(tmp, "wb");
+  if (!out) {
+    return;
+  }
+
+  // 先占位写入Header，文件哈希写完后再回填
+  SnapHeader h = {0};
+  memcpy(h.magic, SNAP_MAGIC, 4);
+  fwrite(&h, sizeof(h), 1, out);
+  put_file_hashes(out, file, w.boxes, &h.nfiles);
+  // 数据区按8字节对齐
+  while (ftell(out) % 8) {
+    fputc(0, out);
+  }
+  fwrite(w.data, 1, w.len, out);
+  fwrite(w.relocs, sizeof(uint64_t), w.nrelocs, out);
+
+  h.data_size = w.len;
+  h.nrelocs = w.nrelocs;
+  h.root = root;
+  fseek(out, 0, SEEK_SET);
+  fwrite(&h, sizeof(h), 1, out);
+  fclose(out);
+  rename(tmp, path);
+
+  free(w.data);
+  free(w.slots);
+  free(w.relocs);
+  free(w.pending);
+  free(w.srcs);
+  free(w.src_lens);
+}
+
+// =============================
+// 加载
+// =============================
+
+// 检查快照记录的源码文件是否都没有变化
+static bool files_fresh(char **pos, char *end, uint32_t n) {
+  for (uint32_t i = 0; i < n; i++) {
+    uint64_t h;
+    uint32_t len;
+    if (end - *pos < (long)(sizeof(h) + sizeof(len))) {
+      return false;
+    }
+    memcpy(&h, *pos, sizeof(h));
+    memcpy(&len, *pos + sizeof(h), sizeof(len));
+    *pos += sizeof(h) + sizeof(len);
+    if (end - *pos < (long)len) {
+      return false;
+    }
+    char *path = strndup(*pos, len);
+    *pos += len;
+    if (access(path, R_OK) != 0 || src_hash(read_file(path)) != h) {
+      free(path);
+      return false;
+    }
+    free(path);
+  }
+  return true;
+}
+
+Node *load_snapshot(const char *file) {
+  if (strcmp(file, "-") == 0) {
+    return NULL;
+  }
+  int fd = open(snapshot_path(file), O_RDONLY);
+  if (fd < 0) {
+    return NULL;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(SnapHeader)) {
+    close(fd);
+    return NULL;
+  }
+  // 私有映射：修正指针以及解释执行时写入的数据都不会影响快照文件
+  char *map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    return NULL;
+  }
+
+  SnapHeader *h = (SnapHeader *)map;
+  char *end = map + st.st_size;
+  char *pos = map + sizeof(SnapHeader);
+  if (memcmp(h->magic, SNAP_MAGIC, 4) != 0 || !files_fresh(&pos, end, h->nfiles)) {
+    munmap(map, st.st_size);
+    return NULL;
+  }
+  pos = map + (((pos - map) + 7) & ~(long)7);
+  if ((uint64_t)(end - pos) != h->data_size + h->nrelocs * sizeof(uint64_t)) {
+    munmap(map, st.st_size);
+    return NULL;
+  }
+
+  char *base = pos;
+  uint64_t *relocs = (uint64_t *)(base + h->data_size);
+  for (uint64_t i = 0; i < h->nrelocs; i++) {
+    size_t field = relocs[i] >> 2;
+    void *val;
+    switch (relocs[i] & 3) {
+    case RELOC_INT:
+      val = TYPE_INT;
+      break;
+    case RELOC_CHAR:
+      val = TYPE_CHAR;
+      break;
+    default: {
+      uintptr_t off;
+      memcpy(&off, base + field, sizeof(off));
+      val = base + off;
+      break;
+    }
+    }
+    memcpy(base + field, &val, sizeof(val));
+  }
+  return (Node *)(base + h->root);
+}
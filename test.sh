@@ -26,21 +26,161 @@ test() {
     assert "$want" "$input" "$got"
 
 
+    echo "---- testing C backend ----"
+    rm -f app.exe
+    echo "$input" | ./zc.exe --emit=c -
+    ./app.exe
+    got="$?"
+    assert "$want" "$input" "$got"
+
+    # 没有装LLVM时跳过
+    if command -v llc > /dev/null; then
+        echo "---- testing LLVM backend ----"
+        rm -f app.exe
+        echo "$input" | ./zc.exe --emit=llvm -
+        ./app.exe
+        got="$?"
+        assert "$want" "$input" "$got"
+    fi
+
+    # 插桩不应该改变结果，报告写到/dev/null
+    echo "---- testing instrumented build ----"
+    rm -f app.exe
+    echo "$input" | ./zc.exe --instrument -
+    ZPROF_OUT=/dev/null ./app.exe
+    got="$?"
+    assert "$want" "$input" "$got"
+
     echo "---- testing interpreter ----"
     echo "$input" | ./zi.exe -
     got="$?"
 
     assert "$want" "$input" "$got"
+
+    # 阈值设得很低，让用例经过每一个层级和栈上替换
+    echo "---- testing JIT ----"
+    echo "$input" | ./zi.exe --jit --jit-threshold=1 --jit-opt-threshold=2 --osr-threshold=3 -
+    got="$?"
+
+    assert "$want" "$input" "$got"
+
+    # 性能分析不应该改变结果。报告很长，这里不输出
+    echo "---- testing profiler ----"
+    echo "$input" | ./zi.exe --profile-stacks=/dev/null - 2> /dev/null
+    got="$?"
+
+    assert "$want" "$input" "$got"
+}
+
+# 测试多层模块的增量编译：main.z导入lib/a.z，a导入lib/b.z。连续编译两次，第二次a和b都从接口文件加载。
+# 各次调用共用同一个目录和编译缓存，后面的调用可以修改b，检查依赖它的程序是否重新编译
+rebuild_dir="${TMPDIR:-/tmp}/zc_rebuild_test"
+rm -rf "$rebuild_dir"
+test_rebuild() {
+    want="$1"
+    zc="$(pwd)/zc.exe"
+    mkdir -p "$rebuild_dir/lib"
+    echo "$2" > "$rebuild_dir/main.z"
+    echo "$3" > "$rebuild_dir/lib/a.z"
+    echo "$4" > "$rebuild_dir/lib/b.z"
+
+    for i in 1 2; do
+        echo "---- testing rebuild #$i ----"
+        (cd "$rebuild_dir" && "$zc" main.z && ./app.exe)
+        got="$?"
+        assert "$want" "$2 | $3 | $4" "$got"
+    done
 }
 
-# 基本的自定义类型
-test 21 "type Point { x int; y int }; let p Point; p.x=21; p.y=34; p.x"
-exit
+# 多层模块的增量编译
+test_rebuild 108 "use a; a.af(0)" "use b; fn af(x int) {b.bf(x) + 8}" "fn bf(x int) {x + 100}"
+test_rebuild 111 "use a; a.af(0)" "use b; fn af(x int) {b.bf(x) + 8}" "fn bf(x int) {x + 103}"
+test_rebuild 209 "use a; let v = v2i64(a.af(3), 5); lane(v, 0) + lane(v, 1)" "use b; fn af(x int) {b.bfc('a', x) + b.bfm(x, 'b', 2)}" "fn bfc(c char, d int) {c + d}; fn bfm(x int, c char, y int) {x * y + c}"
+
+# 插桩
+test 175 "fn f3(a int, b int, c int){a * 100 + b * 10 + c}; fn h(a int, b int, c int){f3(c, b, a)}; fn k(a int, b int, c int){if a == 0 {h(a, b, c)} else {k(a - 1, b, c + 1)}}; (k(5, 2, 3) + f3(1, 2, 3)) % 256"
+test 13 "fn add(a int, b int, c int){a + b + c}; let s=0; let i=0; for i < 30 {s = s + add(i, 1, 2); i = i + 1}; s % 256"
+
+# 性能分析
+test 54 "fn sq(n int){n*n}; fn sum(n int, acc int){if n == 0 {acc} else {sum(n-1, acc + sq(n))}}; sum(20, 0) % 256"
+test 78 "fn f(n int){n + 1}; let s=0; let i=0; for i < 12 {s = s + f(i); i = i + 1}; s"
+
+# 分层执行与栈上替换
+test 188 "fn sq(n int){n*n}; fn sum(n int, acc int){if n == 0 {acc} else {sum(n-1, acc + sq(n) % 10)}}; sum(3000, 0) % 256"
+test 125 "let s=0; let c='a'; let i=0; for i < 5000 {s = s + i % 13; i = i + 1}; s % 256 + c"
+
+# 即时编译
+test 186 "fn loop(n int){let s=0; let i=0; for i < n {s = s + i % 7; i = i + 1}; s}; loop(200000) % 256"
+test 67 "fn g(a int, b int){if a < b {b - a} else {a - b}}; fn f(n int, acc int){if n == 0 {acc} else {f(n-1, acc + g(n, 5))}}; let c='a'; f(10, c) - 55"
+
+# LLVM IR生成
+test 21 "fn f(n int){let c=0; let i=0; for i < n {if i < 4 {c = c + 2} else {c = c + 1}; i = i + 1}; c}; f(10) + 7"
+test 45 "let a=22;let b=23;let p=&b; p=p-1; *p + b"
+
+# C代码生成
+test 23 "let a=1; let b=a + {a=a+10; a} * 2; b"
+test 55 "fn fib(n int, a int, b int){if n == 0 {a} else {fib(n-1, b, a+b)}}; let s=\"fib\"; let c=s[2]; fib(10, 0, 1) + c - 'b'"
+
+# 向量类型
+test 120 "let a=[1,2,3,4,5,6,7,8]; let b=[8,7,6,5,4,3,2,1]; let acc=v4i32(0); let i=0; for i < 8 {acc = acc + v4i32.load(a, i) * v4i32.load(b, i); i = i + 4}; hsum(acc)"
+test 62 "let s=\"hello world, hello\"; let m=mask(cmpeq(v16i8.load(s, 0), v16i8('l'))); let v=shuffle(set_lane(v2i64(m), 1, 5), 1, 0); lane(v, 0) * 10 + lane(v, 1) % 256"
+
+# 循环向量化
+test 35 "fn f(n int){let a=[5,3,8,1,9,2,7]; let s=0; let i=0; for i < n {s = s - a[i] + 10; i = i + 1}; s}; f(7)"
+test 17 "let a=[-4, 6, -1, 3, 8]; let s=1; let i=1; for i < 5 {s = s + a[i]; i = i + 1}; s"
+
+# 取余与除以常量
+test 21 "let s=\"hello\"; let t=0; let i=0; for i < 5 {t = t + s[i] % 7; i = i + 1}; t"
+test 13 "let c='z'; c % 7 + 'a' / 9"
+test 18 "fn h(x int){x % 7 + x / 3}; h(100) + h(0 - 50)"
+test 196 "let i=0; let s=0; for i < 100 {if i % 3 == 0 {s = s + i / 8}; i = i + 1}; s"
+
+# 循环不变量外提
+test 160 "fn f(n int){let s=0; for s < (if n != 0 {100/n} else {10}) {s = s + 1}; s}; let t = 0; let i = 0; for i < 3 {t = t + f(i); i = i + 1}; t"
+test 21 "fn f(b int){let c=0; let i=0; for i < 3 {c = c + -('x' - b); i = i + 1}; c}; f(-300) + 1"
+test 62 "fn f(n int, m int){let s=0; let i=0; for i < n*2 {let j=0; for j < m+n {s = s + (n*m - 1); j = j + 1}; i = i + 1}; s}; f(3, 4) - 400"
+test 10 "let n=0; let s=0; for s < 10 {if n != 0 {s = s + 10/n}; s = s + 1}; s"
+
+# 下标寻址与归纳变量
+test 31 "let a=[3,1,4,1,5,9,2,6]; let s=0; let i=0; for i < 8 {s = s + a[i]; i = i + 1}; s"
+test 2 "let c=\"hello\"; let n=0; let i=0; for i < 5 {if c[i] == 'l' {n = n + 1}; i = i + 1}; n"
+
+# 寄存器分配与运算数
+test 251 "fn f2(q int){q*3}; fn f(a int, b int, c int){let x = (a+b)*(c-a) + (b*c - a/(c+1)); let y = x*2 - (a+1)*(b+1); x - y + f2(a)}; f(3, 4, 5)"
+test 9 "let a=2; let b=a*(a+1) + (a=a+1); b"
+
+# 条件直接生成跳转
+test 7 "let a=3; let b=0; if a == 3 {b = b + 1}; if a != 4 {b = b + 2}; if a > 2 {b = b + 4}; if a >= 4 {b = b + 8}; b"
+test 3 "let n=3; for n < 0 {n = n + 1}; let c='x'; if c <= 'y' {n} else {0}"
+
+# 尾调用
+test 7 "fn sub(a int, b int){a-b}; sub(9,2)"
+test 100 "fn count(n int, acc int){if n == 0 {acc} else {count(n-1, acc+2)}}; count(1000000, 0) / 20000"
+
+# 省略帧指针与叶子函数
+test 81 "fn f(n int){let a=n; let s=0; let i=0; let p=&a; for i < n {s = s + *p; i = i + 1}; s}; f(9)"
+test 45 "fn sum(n int){let s=0; let i=0; for i < n {s = s + i; i = i + 1}; s}; sum(10)"
+test 10 "fn sq(n int){let m=n*n; m}; fn f(x int){let y=sq(x); y+1}; let k=3; f(k)"
+
+# 栈槽复用与按类型对齐
+test 7 "{let a=3; a}; {let b=4; b}; let c='a'; let d=7; d"
+test 6 "let s=['a','b','c']; let t=\"hi\"; let n=5; s[1]-'a'+n"
+
+# 常量折叠与常量传播
+test 5 "let a=22; let b=23; let p=&b; p=p-1; *p=5; a"
+test 65 "let c='x'; (c - 2147483647) % 256 + 200"
+test 7 "let m = 0 - 9223372036854775807 - 1; (m - 1) % 256 + (m * 3) % 7 + 9"
+test 7 "1+2*3"
+test 11 "let a=5; let b=a*2; if b == 10 {b+1} else {0}"
+test 2 "let a=1; a=2; a"
+test 12 "fn add(a int, b int){a+b}; add(5, 7)"
 
 # 基本的模块化
 test 25 "use math; math.square(5)"
 
 # 简单的编译期脚本
+test 30 "fn fact(n int){if n < 2 {1} else {n * fact(n-1)}}; fn f(a int, b int){let c = fact(a); let d = fact(b); c + d}; let r = #f(3, 4); r"
+test 55 "fn fib(n int){if n < 2 {n} else {fib(n-1) + fib(n-2)}}; fib(10)"
 test 5 "fn a{5}; let b = #a(); b"
 
 # 指针类型
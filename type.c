@@ -6,6 +6,10 @@
 Type *TYPE_INT= &(Type){.kind = TY_INT,.size = INT_SIZE, .name = "int"}; // Z语言中int类型总是32位的，即4个字节。相当于i32。
 // 字符类型
 Type *TYPE_CHAR = &(Type){.kind = TY_CHAR, .size = CHAR_SIZE, .name = "char"};
+// 向量类型：128位，对应一个SSE寄存器，元素是有符号整数。名称里的数字是元素个数和每个元素的位数
+Type *TYPE_V2I64 = &(Type){.kind = TY_VEC, .size = 16, .len = 2, .name = "v2i64"};
+Type *TYPE_V4I32 = &(Type){.kind = TY_VEC, .size = 16, .len = 4, .name = "v4i32"};
+Type *TYPE_V16I8 = &(Type){.kind = TY_VEC, .size = 16, .len = 16, .name = "v16i8"};
 
 bool is_ptr(Type *t) {
   if (!t) {
@@ -21,6 +25,15 @@ bool is_num(Type *t) {
   return t->kind == TY_INT || t->kind == TY_CHAR;
 }
 
+bool is_vec(Type *t) {
+  return t && t->kind == TY_VEC;
+}
+
+// 两个类型是同一种向量。注意类型可能是从快照或接口文件里复制出来的，不能比较指针
+static bool same_vec(Type *a, Type *b) {
+  return is_vec(a) && is_vec(b) && a->len == b->len;
+}
+
 Type *pointer_to(Type *target) {
   Type *type = calloc(1, sizeof(Type));
   type->kind = TY_PTR;
@@ -78,11 +91,38 @@ char *type_name(Type *type) {
       return format("str[%zu]", type->len);
     case TY_FN:
       return format("fn %s", type_name(type->ret_type));
+    case TY_VEC:
+      return format("v%zui%zu", type->len, 128 / type->len);
     default:
       return "unknown";
   }
 }
 
+// 向量只支持逐个元素的加减法和乘法，两侧必须是同一种向量。8位整数没有向量乘法指令。
+// 比较用内建函数cmpeq()，结果也是向量
+static void check_vec_op(Node *node) {
+  Type *l = node->lhs ? node->lhs->type : NULL;
+  Type *r = node->rhs ? node->rhs->type : NULL;
+  if (!is_vec(l) && !is_vec(r)) {
+    return;
+  }
+  bool ok = false;
+  switch (node->kind) {
+    case ND_PLUS:
+    case ND_MINUS:
+      ok = same_vec(l, r);
+      break;
+    case ND_MUL:
+      ok = same_vec(l, r) && l->len != 16;
+      break;
+    default:
+      break;
+  }
+  if (!ok) {
+    error_tok(node->token, "【错误】：向量不支持这个运算：%s和%s", type_name(l), type_name(r));
+  }
+}
+
 void mark_type(Node *node) {
   // node不存在或者已经标记了类型就不用处理了
   if (!node || node->type) {
@@ -96,8 +136,8 @@ void mark_type(Node *node) {
   mark_type(node->then);
   mark_type(node->els);
 
-  // 递归标记函数体的类型
-  if (node->meta && node->meta->kind == META_FN) {
+  // 递归标记函数体的类型。调用节点不进入被调用函数的函数体，否则递归函数会无限递归下去
+  if (node->kind == ND_FN && node->meta && node->meta->kind == META_FN) {
     for (Node *n=node->meta->body; n; n=n->next) {
       mark_type(n);
     }
@@ -112,16 +152,28 @@ void mark_type(Node *node) {
     mark_type(n);
   }
 
+  // 递归标记数组元素的类型
+  for (Node *n=node->elems; n; n=n->next) {
+    mark_type(n);
+  }
+
   // 具体标记
   switch (node->kind) {
     case ND_PLUS:
     case ND_MINUS:
     case ND_MUL:
     case ND_DIV:
+    case ND_MOD:
     case ND_NOT:
+      check_vec_op(node);
       node->type = node->lhs->type;
       return;
     case ND_ASN: {
+      if (node->rhs && node->lhs->type && (is_vec(node->lhs->type) || is_vec(node->rhs->type)) &&
+          !same_vec(node->lhs->type, node->rhs->type)) {
+        error_tok(node->token, "【错误】：赋值两侧的类型不一致：%s和%s", type_name(node->lhs->type),
+                  type_name(node->rhs->type));
+      }
       // 类型推导：如果左侧没有声明类型，就用右侧的类型
       if (!node->lhs->type) {
         node->lhs->type = node->rhs->type;
@@ -134,12 +186,16 @@ void mark_type(Node *node) {
       return;
     }
     case ND_NEG:
+      check_vec_op(node);
       node->type = node->rhs->type;
       return;
     case ND_EQ:
     case ND_NE:
     case ND_LT:
     case ND_LE:
+      check_vec_op(node);
+      node->type = TYPE_INT;
+      return;
     case ND_NUM:
       node->type = TYPE_INT;
       return;
@@ -156,10 +212,9 @@ void mark_type(Node *node) {
       return;
     }
     case ND_CALL:
-      node->type = TYPE_INT;
-      return;
     case ND_CTCALL:
-      node->type = node->meta->type;
+      // 编译期调用的结果和普通调用一样，也是一个整数，而不是函数类型
+      node->type = TYPE_INT;
       return;
     case ND_ADDR: {
       // let arr int[] = {1,2,3}; let p = &arr; // p的类型是int*
@@ -206,6 +261,9 @@ void mark_type(Node *node) {
     case ND_USE: {
       return;
     }
+    case ND_INTRIN:
+      // 内建函数在解析时就检查了参数并标记了类型（见parser.c的intrinsic()）
+      return;
     default:
       printf("【警告】：未知的节点类型: %d，无法标记\n", node->kind);
       // 其他类型不是末端节点，不需要单独处理
@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include <stdarg.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "zc.h"
 
@@ -30,3 +31,39 @@ bool ends_with(const char *str, const char *suffix) {
   }
   return strncmp(str + len - suffix_len, suffix, suffix_len) == 0;
 }
+
+// =============================
+// 哈希
+// =============================
+
+// FNV-1a哈希，seed可以用来串联多段数据的哈希
+uint64_t hash_bytes(const void *data, size_t len, uint64_t seed) {
+  const unsigned char *p = data;
+  uint64_t h = seed ? seed : 0xcbf29ce484222325ULL;
+  for (size_t i = 0; i < len; i++) {
+    h ^= p[i];
+    h *= 0x100000001b3ULL;
+  }
+  return h;
+}
+
+uint64_t hash_str(const char *str, uint64_t seed) {
+  return hash_bytes(str, strlen(str), seed);
+}
+
+// =============================
+// 文件路径
+// =============================
+
+// 当前可执行文件所在的目录。和编译器一起安装的运行时（例如rt/zprof.o）要按这个目录查找，而不是当前目录
+const char *exe_dir(void) {
+  static char *dir = NULL;
+  if (dir == NULL) {
+    char buf[4096];
+    ssize_t n = readlink("/proc/self/exe", buf, sizeof(buf) - 1);
+    buf[n > 0 ? n : 0] = '\0';
+    char *slash = strrchr(buf, '/');
+    dir = slash ? strndup(buf, slash - buf) : ".";
+  }
+  return dir;
+}
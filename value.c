@@ -40,6 +40,14 @@ char *val_to_str(Value *val) {
     }
     case VAL_STR:
       return format("\"%s\"", val->as.str->str);
+    case VAL_VEC: {
+      ValVec *v = val->as.vec;
+      char *buf = format("v%di%d(", v->len, 128 / v->len);
+      for (int i = 0; i < v->len; i++) {
+        buf = format("%s%s%ld", buf, i > 0 ? ", " : "", v->lanes[i]);
+      }
+      return format("%s)", buf);
+    }
   }
 
 }
@@ -53,3 +61,20 @@ void print_values(void) {
     }
   }
 }
+
+// 把求值的结果转换成进程的退出码
+int exit_code(Value *val) {
+  switch (val->kind) {
+  case VAL_INT:
+    return val->as.num;
+  case VAL_CHAR:
+    return val->as.cha;
+  case VAL_ARRAY:
+    return val->as.array->elems[0].as.num;
+  case VAL_STR:
+    return val->as.str->str[0];
+  case VAL_VEC:
+    return val->as.vec->lanes[0];
+  }
+  return 0;
+}
@@ -5,10 +5,59 @@
 #include "zc.h"
 
 static void help(void) {
-  printf("【用法】：./zc h|v|<源码>\n");
+  printf("【用法】：./zc [选项] h|v|serve|stop|r <源码>|<源码>\n");
+  printf("【选项】：-fno-inline 关闭函数内联；-finline-limit=N 内联函数体的节点数上限；-fno-licm 关闭循环不变量外提；-fno-vectorize 关闭循环向量化；-fvec-report 报告循环向量化的结果；-mavx2 向量化时使用AVX2指令；-fno-omit-frame-pointer 保留帧指针；--emit=c 生成C代码，--emit=llvm 生成LLVM IR，都交给clang编译；-O0~-O3 clang的优化级别（默认-O2）；-flto 链接时优化；--instrument 插桩，程序退出时把每个函数的调用次数和周期数写入zprof.out\n");
+}
+
+// 解析编译选项。影响生成代码的选项要加入编译缓存的键
+static bool set_option(const char *opt) {
+  if (strcmp(opt, "-fno-inline") == 0) {
+    opt_inline = false;
+  } else if (strcmp(opt, "-fno-licm") == 0) {
+    opt_licm = false;
+  } else if (strcmp(opt, "-fno-vectorize") == 0) {
+    opt_vectorize = false;
+  } else if (strcmp(opt, "-fvec-report") == 0) {
+    vec_report = true;
+  } else if (strcmp(opt, "-mavx2") == 0) {
+    target_avx2 = true;
+  } else if (strncmp(opt, "-finline-limit=", 15) == 0) {
+    inline_limit = atoi(opt + 15);
+  } else if (strcmp(opt, "-fomit-frame-pointer") == 0) {
+    omit_frame_pointer = true;
+  } else if (strcmp(opt, "-fno-omit-frame-pointer") == 0) {
+    omit_frame_pointer = false;
+  } else if (strcmp(opt, "--emit=c") == 0) {
+    emit_kind = EMIT_C;
+  } else if (strcmp(opt, "--emit=llvm") == 0) {
+    emit_kind = EMIT_LLVM;
+  } else if (strcmp(opt, "--emit=asm") == 0) {
+    emit_kind = EMIT_ASM;
+  } else if (strcmp(opt, "-O0") == 0 || strcmp(opt, "-O1") == 0 || strcmp(opt, "-O2") == 0 || strcmp(opt, "-O3") == 0) {
+    cc_opt_level = (char *)opt;
+  } else if (strcmp(opt, "-flto") == 0) {
+    cc_lto = true;
+  } else if (strcmp(opt, "--instrument") == 0) {
+    instrument = true;
+  } else {
+    return false;
+  }
+  cache_salt(opt);
+  return true;
 }
 
 int main(int argc, char *argv[]) {
+  // 选项都以'-'开头，放在命令前面。注意单独的"-"表示从标准输入读取源码
+  int i = 1;
+  for (; i < argc && argv[i][0] == '-' && argv[i][1] != '\0'; i++) {
+    if (!set_option(argv[i])) {
+      printf("未知的选项：%s\n", argv[i]);
+      return 1;
+    }
+  }
+  argc -= i - 1;
+  argv += i - 1;
+
   if (argc < 2) {
     help();
     return 1;
@@ -31,9 +80,19 @@ int main(int argc, char *argv[]) {
       return 1;
     }
     parse(argv[2]);
+  } else if (strcmp(cmd, "serve") == 0) { // 启动编译服务器
+    serve();
+  } else if (strcmp(cmd, "stop") == 0) { // 停止编译服务器
+    return remote("stop", "");
+  } else if (strcmp(cmd, "r") == 0) { // 交给编译服务器编译
+    if (argc < 3) {
+      printf("缺少源码\n");
+      return 1;
+    }
+    return remote("compile", argv[2]);
   } else { // 编译
     char *src = cmd;
-    compile(src);
+    return compile(src);
   }
 
   return 0;
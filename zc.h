@@ -1,6 +1,8 @@
 #pragma once
 
+#include <setjmp.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -34,6 +36,9 @@ static const char *ZC_VERSION = "0.0.1";
 // =============================
 char *format(char *fmt, ...);
 bool ends_with(const char *str, const char *suffix);
+uint64_t hash_bytes(const void *data, size_t len, uint64_t seed);
+uint64_t hash_str(const char *str, uint64_t seed);
+const char *exe_dir(void);
 
 
 // =============================
@@ -50,6 +55,7 @@ typedef enum {
   TK_MINUS, // -
   TK_STAR, // *
   TK_SLASH, // /
+  TK_PERCENT, // %
   TK_ASN, // =
   TK_NOT, // !
   TK_GT, // >
@@ -102,6 +108,15 @@ struct Lexer {
 // 新建一个词法分析器，接收src源码 
 Lexer *init_lexer(const char *src);
 
+// 用已经读入的源码新建一个词法分析器
+Lexer *init_src_lexer(const char *file, const char *src);
+
+// 读取整个源码文件
+char *read_file(const char *file);
+
+// 判断是源码文件名还是源码本身
+bool is_src_file(const char *src);
+
 // 解析并获取下一个词符
 Token next_token(Lexer *lexer);
 
@@ -111,6 +126,15 @@ void print_token(Token t);
 // 打印错误信息
 void error_tok(Token *tok, char *fmt, ...);
 
+// 词符所在的行号，从1开始
+int tok_line(Token *tok);
+
+// 出错时的跳转点。编译服务器处理请求时会设置它，这样出错时只是放弃当前请求，而不会退出进程
+extern jmp_buf *error_jmp;
+
+// 因为出错而退出：设置了error_jmp时跳转回去，否则退出进程
+_Noreturn void quit(int code);
+
 
 // =============================
 // 语法分析
@@ -121,6 +145,8 @@ struct Parser {
   Token prev_tok;
   // Meta *locals;
   Lexer *lexer;
+  Scope *scope; // 当前的作用域，开始时是模块的顶层作用域
+  Region *region; // 当前的存储域
 };
 
 Parser *new_parser(Box *box, Lexer *lexer);
@@ -143,9 +169,12 @@ struct Meta {
 
   bool is_global; 
   bool is_decl; // 是否只声明
+  Box *owner; // 值量所属的模块
 
   // 标量
   int offset; // 相对RBP的偏移量
+  int reg; // 常驻的寄存器编号，0表示存放在栈上（见codegen.c）
+  bool addr_taken; // 取过地址，只能放在栈上
 
   // 函数
   Node *body; // 函数的主体
@@ -154,6 +183,15 @@ struct Meta {
   Region *region; // 对应的存储域
   size_t stack_size; // 栈的尺寸
   Node *def; // 函数的定义节点，方便编译期脚本调用
+  const char *src_pos; // 函数定义在源码中的位置
+  size_t src_len; // 函数定义的源码长度
+  const char *body_pos; // 延迟解析的函数体在源码中的位置（即'{'），解析后清空
+  Scope *scope; // 延迟解析时要用到的作用域，是定义函数时作用域链的快照
+  long calls; // 解释器和基线JIT统计的调用次数（见jit.c）
+  int tier; // 执行的层级：Tier
+  void *jit_code; // 即时编译出的机器码
+  bool jit_busy; // 正在编译
+  bool jit_failed; // 不能编译，继续由解释器执行
 
   // 字符串
   char *str; // 字符串的内容
@@ -173,6 +211,7 @@ typedef enum {
   ND_MINUS, // -
   ND_MUL, // *
   ND_DIV, // /
+  ND_MOD, // %
   ND_NOT, // !
   ND_EQ, // ==
   ND_NE, // !=
@@ -196,9 +235,23 @@ typedef enum {
   ND_ARRAY, // 数组字面值
   ND_INDEX, // 数组下标
   ND_TYPE, // 类型定义
+  ND_INTRIN, // 内建函数，例如向量运算
   ND_UNKNOWN, // 未知 
 } NodeKind;
 
+// 内建函数的种类。向量类型见type.c
+typedef enum {
+  IN_MAKE, // v4i32(x)把x广播到每个元素，v4i32(a, b, c, d)逐个给出元素
+  IN_LOAD, // v4i32.load(arr, i)：读取arr[i]开始的元素
+  IN_STORE, // store(arr, i, v)：把v的元素写入arr[i]开始的位置
+  IN_LANE, // lane(v, k)：取出第k个元素
+  IN_SET_LANE, // set_lane(v, k, x)：把第k个元素换成x，得到新的向量
+  IN_SHUFFLE, // shuffle(v, k0, k1, …)：第j个元素取v的第kj个元素
+  IN_CMPEQ, // cmpeq(a, b)：逐个元素比较，相等的元素所有的位都是1，否则是0
+  IN_MASK, // mask(v)：每个元素的最高位组成的整数，第k个元素对应第k位
+  IN_HSUM, // hsum(v)：所有元素之和
+} IntrinKind;
+
 // 语法树节点，为了避免过早优化，这里没有使用tagged-union设计，而是把所有种类节点的信息都放在一起了。
 struct Node {
   NodeKind kind; // 节点种类
@@ -229,6 +282,16 @@ struct Node {
 
   // 函数调用
   Node *args;
+  bool is_tail; // 是否是尾调用，即函数体或if分支的最后一个表达式
+  IntrinKind intrin; // 内建函数的种类
+
+  // 循环的栈上替换（见jit.c）
+  long count; // 解释器执行循环体的次数
+  void *osr; // 编译出的JitLoop
+  bool osr_failed; // 不能编译
+
+  // 性能分析（见prof.c）
+  long hits; // 解释器执行这个节点的次数
 
   // 字符
   char cha;
@@ -269,6 +332,7 @@ typedef enum {
   TY_FN, // 函数
   TY_STR, // 字符串
   TY_TYPE, // 类型
+  TY_VEC, // 向量，len是元素的个数
 } TypeKind;
 
 struct Type {
@@ -299,9 +363,13 @@ struct Field {
 
 extern Type *TYPE_INT;
 extern Type *TYPE_CHAR;
+extern Type *TYPE_V2I64;
+extern Type *TYPE_V4I32;
+extern Type *TYPE_V16I8;
 
 bool is_num(Type *type);
 bool is_ptr(Type *type);
+bool is_vec(Type *type);
 
 void mark_type(Node *node);
 char *type_name(Type *type);
@@ -325,6 +393,7 @@ typedef enum {
   VAL_CHAR,
   VAL_ARRAY,
   VAL_STR,
+  VAL_VEC,
 } ValueKind;
 
 // 数组类型的动态值
@@ -338,6 +407,12 @@ typedef struct {
   size_t len;
 } Str;
 
+// 向量类型的动态值：每个元素都按元素的宽度截断，再符号扩展成long
+typedef struct {
+  int len;
+  long lanes[16];
+} ValVec;
+
 // 动态值：采用tagged-union模式，支持不同种类的动态值
 struct Value {
   ValueKind kind;
@@ -346,12 +421,16 @@ struct Value {
     char cha;
     ValArray *array;
     Str *str;
+    ValVec *vec;
   } as;
 };
 
 char *val_to_str(Value *val);
 void print_values(void);
 
+// 把求值的结果转换成进程的退出码
+int exit_code(Value *val);
+
 #define MAX_VALUES 2048
 
 Value *get_val_by_addr(size_t addr);
@@ -389,11 +468,158 @@ struct Region {
 // =============================
 Value *interpret(Node *prog);
 
+// =============================
+// 即时编译：jit.c
+// =============================
+
+// 执行的层级：函数调用得越多，升级到越高的层级
+typedef enum {
+  TIER_INTERP, // 解释执行
+  TIER_BASELINE, // 基线JIT：直接翻译成机器码，并在入口统计调用次数
+  TIER_OPT, // 优化JIT：常量和值量直接作为指令的操作数，比较直接用于跳转
+} Tier;
+
+// 栈上替换编译出的循环：long code(long *vars, long ret)，vars是循环用到的值量，ret是循环当前的值
+typedef struct {
+  void *code;
+  Meta **vars;
+  int nvars;
+} JitLoop;
+
+// 是否开启即时编译（zi --jit），以及是否输出层级的变化（zi --trace-tiers）
+extern bool jit_enabled;
+extern bool trace_tiers;
+// 函数调用多少次之后编译成基线JIT、优化JIT，循环执行多少次之后栈上替换
+extern long jit_threshold;
+extern long jit_opt_threshold;
+extern long osr_threshold;
+
+// 解释器调用函数之前调用：统计调用次数，达到阈值时升级。返回当前的机器码，可以按C函数long f(long, …)调用；仍然解释执行时返回NULL
+void *jit_entry(Meta *fn);
+
+// 解释器每执行一次循环体之后调用：统计次数，达到阈值时把循环编译成机器码。仍然解释执行时返回NULL
+JitLoop *jit_loop(Node *loop);
+
+// =============================
+// 性能分析：prof.c
+// =============================
+
+// 是否开启性能分析（zi --profile），以及折叠栈的输出文件（zi --profile-stacks=<文件>）
+extern bool profile_enabled;
+extern char *profile_stacks;
+
+// 进入、退出一个函数的调用，fn为NULL表示顶层代码
+void prof_enter(Meta *fn);
+void prof_exit(void);
+
+// 解释完成后输出报告：函数的调用次数和时间，以及执行最多的源码行
+void prof_report(Node *prog);
+
 // =============================
 // 代码生成：codegen.c
 // =============================
 void codegen_main(Node *prog);
-void codegen_box(Box *b);
+
+// 是否省略帧指针（-fno-omit-frame-pointer关闭）：用rsp寻址局部值量，叶子函数的值量尽量放在寄存器里
+extern bool omit_frame_pointer;
+
+// 向量化的目标指令集：默认用SSE2（每次2个int），-mavx2时用AVX2（每次4个int）
+extern bool target_avx2;
+
+// 是否插桩（--instrument）：统计每个函数的调用次数和周期数，程序退出时由rt/zprof.c写出报告
+extern bool instrument;
+
+// 生成主模块和用到的模块的汇编，返回所有汇编文件的路径，用空格分隔
+char *codegen_box(Box *b);
+
+// 编译期调用：把函数定义和调用组成一段程序，交给解释器求值
+Node *new_ctcall_node(Node *def, Node *ctcall);
+
+// =============================
+// C代码生成：cgen.c
+// =============================
+
+// 生成的代码：汇编（默认），或者交给clang编译的C代码（--emit=c）、LLVM IR（--emit=llvm）
+typedef enum {
+  EMIT_ASM,
+  EMIT_C,
+  EMIT_LLVM,
+} EmitKind;
+
+extern EmitKind emit_kind;
+// clang编译C代码和LLVM IR时的优化级别（-O0~-O3，默认-O2），以及是否做链接时优化（-flto）
+extern char *cc_opt_level;
+extern bool cc_lto;
+
+// 生成主模块和用到的模块的C代码，返回所有C文件的路径，用空格分隔
+char *cgen_box(Box *b);
+
+// =============================
+// LLVM IR生成：llgen.c
+// =============================
+
+// 生成主模块和用到的模块的LLVM IR，返回所有.ll文件的路径，用空格分隔
+char *llgen_box(Box *b);
+
+// =============================
+// 优化：opt.c
+// =============================
+
+// 可达性分析：标记从主模块出发能用到的函数和常量
+void mark_reachable(Box *b);
+
+// 值量是否被用到了
+bool is_used(Meta *m);
+
+// 是否开启函数内联（-fno-inline关闭），以及可以内联的函数体的节点数上限（-finline-limit=N）
+extern bool opt_inline;
+extern int inline_limit;
+
+// 把模块里小函数的调用替换成函数体。is_main表示主模块，要同时处理顶层代码
+void inline_box(Box *b, bool is_main);
+
+// 常量折叠与常量传播，返回消除的节点数
+int fold_consts(Node *prog);
+
+// 标记函数体里的尾调用
+void mark_tail_calls(Node *body);
+
+// 是否开启循环不变量外提（-fno-licm关闭）
+extern bool opt_licm;
+
+// 循环优化：循环不变量外提，以及归纳变量的强度削减（把arr[i]换成每次循环递增的指针）。函数体有循环时返回变换后的副本。
+// fn是所在的函数，顶层代码为NULL
+Node *opt_loops(Meta *fn, Node *body, Region *region);
+
+// 是否开启循环向量化（-fno-vectorize关闭），以及是否报告每个循环向量化的结果（-fvec-report）
+extern bool opt_vectorize;
+extern bool vec_report;
+
+// 可以向量化的循环里的语句
+typedef enum {
+  VS_STORE, // a[i] = E
+  VS_ADD, // s = s + E
+  VS_SUB, // s = s - E
+  VS_MIN, // if a[i] < s {s = a[i]}
+  VS_MAX, // if s < a[i] {s = a[i]}
+} VecStmtKind;
+
+typedef struct VecStmt VecStmt;
+struct VecStmt {
+  VecStmt *next;
+  VecStmtKind kind;
+  Node *target; // 存入的数组元素a[i]，或者归约的值量s
+  Node *expr; // 每个元素要计算的表达式E
+};
+
+typedef struct {
+  Meta *iv; // 归纳变量i，每次循环加1
+  Node *bound; // 循环条件i < bound的上界，是循环里的不变量
+  VecStmt *stmts; // 循环体里除了i = i + 1之外的语句
+} VecLoop;
+
+// 判断循环能否向量化。能时把结果写到v里；不能时reason是原因
+bool can_vectorize(Node *loop, VecLoop *v, char **reason);
 
 // =============================
 // 模块化
@@ -411,6 +637,13 @@ struct NodeLink {
   Node* tail;
 };
 
+// 模块链表，用来记录模块之间的依赖关系
+typedef struct BoxList BoxList;
+struct BoxList {
+  BoxList *next;
+  Box *box;
+};
+
 struct Box {
   BoxKind kind;
   const char *name;
@@ -425,6 +658,17 @@ struct Box {
   Box *children;
   Box *next;
 
+  BoxList *deps; // 依赖的模块，即源码中use到的模块
+  int nconst; // 模块内常量的计数，用来生成常量标签
+  bool from_iface; // 只从接口文件加载了签名，还没有解析源码
+  bool lazy; // 延迟解析函数体，第一次用到函数时才解析
+  Spot *used; // 可达性分析找到的、本模块中被用到的函数和常量
+
+  // 编译缓存
+  uint64_t cache_key; // 源码、编译器版本和依赖模块接口的哈希
+  uint64_t iface_hash; // 本模块对外接口的哈希
+  long mtime; // 源码文件的修改时间，编译服务器用它判断模块是否需要重新解析
+
   Region *global;
   Region *region;
   Scope *scope;
@@ -436,6 +680,8 @@ void init_root_box(void);
 Box *create_code_box(void);
 Node *parse_code(Box *b, const char *src);
 Box *create_file_box(const char* path);
+Box *create_lib_box(const char *name);
+void add_dep(Box *b, Box *dep);
 Node *parse_file(Box *b);
 void print_boxes(void);
 
@@ -445,11 +691,85 @@ Box *find_box(const char *name);
 // 查找模块中的值量
 Meta *box_lookup(Box *b, const char *name);
 
+// 从scope开始逐层向外查找值量
+Meta *scope_lookup(Scope *scope, const char *name);
+
 // 查找模块中的类型
 Type *box_find_type(Box *b, const char *name);
 
 Box *all_boxes(void);
 
+// 预扫描模块的use依赖，并在线程池中并行解析所有依赖模块
+void load_deps(Box *b);
+
+// 模块是否已经可用：已经解析，或者已经从接口文件加载
+bool box_ready(Box *b);
+
+// 补全函数的定义：延迟解析的函数要解析函数体，只从接口文件加载的函数要重新解析整个定义
+void load_fn_body(Meta *m);
+
+// 常驻模块的管理，编译服务器用
+void drop_box(Box *b);
+void prune_boxes(Box *b);
+long file_mtime(const char *path);
+void stamp_boxes(void);
+int drop_changed_boxes(void);
+
+// =============================
+// 编译缓存：cache.c
+// =============================
+
+// 把影响代码生成的编译选项加入缓存键
+void cache_salt(const char *opt);
+
+// 如果缓存中有模块b对应的汇编，就复制到path，并返回true
+bool cache_restore(Box *b, const char *path);
+
+// 把刚生成的汇编文件存入缓存
+void cache_save(Box *b, const char *path);
+
+// 打印缓存命中统计
+void print_cache_stats(void);
+
+bool cache_enabled(void);
+const char *cache_dir(void);
+
+// =============================
+// 模块接口文件：iface.c
+// =============================
+
+// 模块对外接口（顶层值量的签名）的哈希
+uint64_t box_iface_hash(Box *b);
+
+// 把解析好的模块的接口写入缓存目录
+void write_iface(Box *b);
+
+// 从缓存目录映射模块的接口文件，deps返回依赖模块的名称
+bool load_iface(Box *b, char ***deps);
+
+// 依赖的模块都加载之后，把它们的名称绑定到从接口文件加载的模块的作用域里，和源码里的use一样
+void bind_iface_deps(Box *b);
+
+// =============================
+// AST快照：snapshot.c
+// =============================
+
+// 把解析好的语法树写入源码文件旁边的快照文件
+void save_snapshot(const char *file, Node *prog);
+
+// 如果快照文件存在并且源码都没有变化，就映射快照并返回语法树
+Node *load_snapshot(const char *file);
+
+// =============================
+// 编译服务器：server.c
+// =============================
+
+// 启动编译服务器，在本地套接字上等待请求
+void serve(void);
+
+// 把命令发给编译服务器，输出服务器的回复，返回命令的退出码
+int remote(const char *cmd, const char *arg);
+
 // =============================
 // 命令：cmd.c
 // =============================
@@ -463,5 +783,8 @@ void parse(const char *src);
 // 求值
 Value *eval(const char *src);
 
-// 编译
-void compile(const char *src);
+// 编译，成功时返回0
+int compile(const char *src);
+
+// 解析主模块并链接成可执行文件，返回链接命令的退出码
+int build(Box *b);
@@ -1,10 +1,47 @@
 #include "zc.h"
 
 static void help(void) {
-  printf("【用法】：./zi h|v|<源码>\n");
+  printf("【用法】：./zi [选项] h|v|r <源码>|<源码>\n");
+  printf("【选项】：--jit 分层执行，把调用得多的函数和循环即时编译成机器码；--jit-threshold=N 函数调用N次后编译成基线JIT（默认2）；"
+         "--jit-opt-threshold=N 调用N次后编译成优化JIT（默认1000）；--osr-threshold=N 循环执行N次后栈上替换（默认1000）；--trace-tiers 输出层级的变化；"
+         "--profile 性能分析，输出函数的调用次数和时间，以及执行最多的源码行；--profile-stacks=<文件> 同时把折叠栈写入文件，用于生成火焰图\n");
+}
+
+// 解析选项
+static bool set_option(const char *opt) {
+  if (strcmp(opt, "--jit") == 0) {
+    jit_enabled = true;
+  } else if (strncmp(opt, "--jit-threshold=", 16) == 0) {
+    jit_threshold = atol(opt + 16);
+  } else if (strncmp(opt, "--jit-opt-threshold=", 20) == 0) {
+    jit_opt_threshold = atol(opt + 20);
+  } else if (strncmp(opt, "--osr-threshold=", 16) == 0) {
+    osr_threshold = atol(opt + 16);
+  } else if (strcmp(opt, "--trace-tiers") == 0) {
+    trace_tiers = true;
+  } else if (strcmp(opt, "--profile") == 0) {
+    profile_enabled = true;
+  } else if (strncmp(opt, "--profile-stacks=", 17) == 0) {
+    profile_enabled = true;
+    profile_stacks = (char *)opt + 17;
+  } else {
+    return false;
+  }
+  return true;
 }
 
 int main(int argc, char *argv[]) {
+  // 选项都以'-'开头，放在命令前面。注意单独的"-"表示从标准输入读取源码
+  int i = 1;
+  for (; i < argc && argv[i][0] == '-' && argv[i][1] != '\0'; i++) {
+    if (!set_option(argv[i])) {
+      printf("未知的选项：%s\n", argv[i]);
+      return 1;
+    }
+  }
+  argc -= i - 1;
+  argv += i - 1;
+
   if (argc < 2) {
     help();
     return 1;
@@ -15,19 +52,16 @@ int main(int argc, char *argv[]) {
     help();
   } else if (strcmp(cmd, "v") == 0) { //  version
     printf("Z语言解释器，版本号：%s。\n", ZC_VERSION);
+  } else if (strcmp(cmd, "r") == 0) { // 交给编译服务器求值
+    if (argc < 3) {
+      printf("缺少源码\n");
+      return 1;
+    }
+    return remote("eval", argv[2]);
   } else {
     char *src = cmd;
     Value * ret = eval(src);
-    switch (ret->kind) {
-    case VAL_INT:
-      return ret->as.num;
-    case VAL_CHAR:
-      return ret->as.cha;
-    case VAL_ARRAY:
-      return ret->as.array->elems[0].as.num;
-    case VAL_STR:
-      return ret->as.str->str[0];
-    }
+    return exit_code(ret);
   }
   return 0;
 }